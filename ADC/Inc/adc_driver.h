@@ -28,25 +28,42 @@ extern "C" {
 /* Includes ----------------------------------------------------------------------------*/
 #include "main.h"
 #include "stm32_family.h"
+#include "adc_filter.h"
 //#include "stm32f105xc.h"
 
 /* Exported Macros (Object Type)---------------------------------------------------------- */
 #define ADC_MAX_CHANNELS       16
-#define ADC_AVERAGED_MEASURES  5
-#define ADC_BUFF_SIZE (ADC_MAX_CHANNELS * ADC_AVERAGED_MEASURES)
+#define ADC_MAX_INSTANCES      5						// ADC peripherals driven at once (G4 has up to 5)
+#define ADC_INJECTED_MAX_RANKS 4						// JDR1..JDR4
+#define ADC_INJECTED_RETRIES   4						// attempts of reading slot updated meanwhile by ISR
+#define ADC_CHANNEL_COUNT      19						// channel numbers 0..18 allowed by F3/F4 parts (incl. internal channels)
+#define ADC_RANK_ABSENT        0xFFU					// channel is not a part of regular sequence
+#define ADC_AVERAGED_MEASURES  5						// default depth | sequences in one half of DMA buffer
+#define ADC_OVERSAMPLING_MAX_BITS  4					// extra bits of software oversampling (0..4) | needs depth of at least 4^bits
+#define ADC_SCALE_SHIFT        16U						// fraction bits of fixed-point scale coefficient (Q16.16)
+#define ADC_DMA_MAX_TRANSFERS  65535U					// DMA counter limit, both halves together
+
+#ifndef ADC_DMA_ALIGNMENT
+#define ADC_DMA_ALIGNMENT      4U						// alignment of DMA buffers carved from arena | 32 on cores with D-cache
+#endif
 
-/* Exported Private Variables---------------------------------------------------------- */
-extern 			ADC_HandleTypeDef   hadc1;
-static volatile int                 ADC_CONVERTED_CHANNELS = 1;
+/**
+  * @brief  Bytes of arena taken by DMA buffer of one instance | both halves, alignment padding included
+  * 		 __CONVERSIONS__ - ranks in regular sequence, __DEPTH__ - sequences in one half, __DUAL__ - 1 for master in dual mode
+  */
+#define ADC_DMA_BUFF_BYTES(__CONVERSIONS__, __DEPTH__, __DUAL__)																	\
+											((((2U * (__CONVERSIONS__) * (__DEPTH__) * ((__DUAL__) ? 4U : 2U)) + ADC_DMA_ALIGNMENT - 1U)	\
+											 / ADC_DMA_ALIGNMENT) * ADC_DMA_ALIGNMENT)
 
 /* Private Typedefs ------------------------------------------------------------------- */
 /**
   * @brief  DMA buffer typedef for ADCs in multimode
+  * 		 Every 32-bit word packs one conversion of both ADCs: master (ADC1) in bits 15:0, slave (ADC2) in bits 31:16.
+  * 		 Seen as halfwords (little endian), master samples sit at even and slave samples at odd indexes
   */
 typedef union{
-		uint32_t BufferMultiMode[ADC_BUFF_SIZE];
-		uint16_t BufferADC_Master[ADC_BUFF_SIZE];
-		uint16_t BufferADC_Slave[ADC_BUFF_SIZE];
+		uint32_t* BufferMultiMode;
+		uint16_t* BufferHalfWords;
 
 }DMA_DualmodeBufferTypeDef;
 
@@ -54,17 +71,41 @@ typedef union{
   * @brief  DMA buffer typedef for ADCs in independent mode
   */
 typedef union{
-	uint16_t BufferADC[ADC_BUFF_SIZE];
+	uint16_t* BufferADC;
 
 }DMA_IndependentModeBufferTypeDef;
 
+/**
+  * @brief  Ping-pong state of circular DMA buffer | written only by DMA half/full transfer callbacks
+  */
 typedef struct{
+	uint16_t           halfLength;						// number of DMA transfers in one half of buffer
+	volatile uint8_t   readyHalf;						// latest completed half | 0 - lower half, 1 - upper half
+	volatile uint32_t  sequence;						// number of completed halves, 0 - no half completed yet
 
-	DMA_DualmodeBufferTypeDef 		 ddma;				// dma buffer for dualmode
+}ADC_PingPongTypeDef;
 
-	DMA_IndependentModeBufferTypeDef idma;				// dma buffer for independent mode
+/**
+  * @brief  Static memory provided by application, DMA buffers of all instances are carved from it at ADC_Init
+  */
+typedef struct{
+	uint8_t*           memory;							// start of memory
+	uint32_t           size;							// size of memory in bytes
+	uint32_t           used;							// bytes already given to instances
+
+}ADC_ArenaTypeDef;
+
+typedef struct{
 
-	uint32_t ADC_Buff[ADC_BUFF_SIZE];								// adc buff for all channels, in situation ADC is single shot mode
+	DMA_DualmodeBufferTypeDef 		 ddma;				// dma buffer for dualmode | carved from arena
+
+	DMA_IndependentModeBufferTypeDef idma;				// dma buffer for independent mode | carved from arena
+
+	uint16_t ADC_Buff[ADC_CHANNEL_COUNT];				// adc buff for all channels, in situation ADC is single shot mode
+
+	uint16_t depth;										// sequences in one half of DMA buffer | averaging depth
+
+	ADC_PingPongTypeDef pingpong;						// hand over of completed DMA halves to consumers
 
 }ADC_BufferTypeDef;
 
@@ -75,10 +116,66 @@ typedef struct{
 typedef struct{
 
 	uint8_t channels[ADC_MAX_CHANNELS];						// Channels for all ranks | auto detect
+	uint8_t ranks[ADC_CHANNEL_COUNT];						// Inverse table: rank of every channel | ADC_RANK_ABSENT if not converted
 
 }ADC_ChannelsTypeDef;
 
 
+/**
+  * @brief  Averaged values of all ranks | filled by ADC_ReadAll in one pass over DMA buffer
+  */
+typedef struct{
+
+	uint16_t raw[ADC_MAX_CHANNELS];							// averaged binary values, indexed by rank
+	float    value[ADC_MAX_CHANNELS];						// averaged values scaled to full scale of rank, indexed by rank
+	uint8_t  size;											// number of valid ranks
+
+}ADC_ValuesTypeDef;
+
+
+/**
+  * @brief  Fixed-point conversion of channel | value = ((raw - offset) * gain) >> ADC_SCALE_SHIFT
+  */
+typedef struct{
+
+	int32_t gain;											// units per LSB in Q16.16, includes calibration gain
+	int32_t offset;											// calibration offset in LSB, subtracted before scaling
+
+}ADC_ScaleTypeDef;
+
+
+/**
+  * @brief  Latest-value slot of injected group | written by injected conversion ISR, read lock-free by application.
+  * 		 Sequence is odd while ISR writes, reader retries if sequence was odd or changed during reading
+  */
+typedef struct{
+
+	volatile uint16_t value[ADC_INJECTED_MAX_RANKS];		// latest JDRx, indexed by injected rank
+	volatile uint32_t sequence;								// 2 * number of published conversions (+1 while writing)
+	uint8_t           size;									// number of injected ranks
+	uint8_t           enabled;								// injected group started by ADC_InjectedStart
+
+}ADC_InjectedTypeDef;
+
+
+/**
+  * @brief  ADC driver context | all state of one ADC instance, instances work independently of each other
+  */
+typedef struct ADC_DriverContext{
+
+	ADC_HandleTypeDef*        hadc;							// ADC handle of instance
+	struct ADC_DriverContext* source;						// context, whose DMA fills buffer | itself, master's context for slave in dual mode
+	ADC_ChannelsTypeDef       cadc;							// ranks of channels
+	ADC_BufferTypeDef         badc;							// DMA buffer, used only if context is its own source
+	ADC_FilterTypeDef         fadc[ADC_MAX_CHANNELS];		// filters of channels, indexed by rank
+	ADC_ScaleTypeDef          sadc[ADC_MAX_CHANNELS];		// fixed-point conversions of channels, indexed by rank
+	ADC_InjectedTypeDef       jadc;							// injected group, works alongside regular DMA group
+	uint8_t                   conversions;					// number of ranks in regular sequence
+	uint8_t                   oversamplingBits;				// extra bits of software oversampling, 0 - disabled
+
+}ADC_DriverContextTypeDef;
+
+
 /**
   * @brief  ADC Status structures definition
   */
@@ -96,10 +193,19 @@ typedef enum{
 
 
 /* Private Macros (Function type)------------------------------------------------------------------- */
+/**
+  * @brief  Dual mode accessors | sample of master/slave ADC read straight from packed 32-bit word, no unpacking
+  */
+#define __ADC_DUALMODE_MASTER(__WORD__)                                                     												\
+											((uint16_t)((__WORD__) & 0xFFFFU))
+
+#define __ADC_DUALMODE_SLAVE(__WORD__)                                                      												\
+											((uint16_t)((__WORD__) >> 16U))
+
 #if defined(STM32F1_FAMILY)
 
 	#define __ADC_IS_DMA_MULTIMODE(__HANDLE__)                                              												\
-											((((((__HANDLE__)->Instance->CR1      >> ADC_CR1_DUALMOD_Pos) & 0xF) == 0U) ? 0U : 1U))
+											((((((ADC1)->CR1                     >> ADC_CR1_DUALMOD_Pos) & 0xF) == 0U) ? 0U : 1U))
 
 	#define __ADC_IS_CONV_STARTED(__HANDLE__)                                               												\
 											(((((__HANDLE__)->Instance->SR)       >> ADC_SR_STRT_Pos ) & 0x1U))
@@ -119,10 +225,16 @@ typedef enum{
 	#define __ADC_MODE(__HANDLE__)                                                          												\
 											((((__HANDLE__)->Instance->CR2         >> ADC_CR2_CONT_Pos) & 0x1U))
 
+	#define __ADC_INJECTED_LENGTH(__HANDLE__)                                               												\
+											((((__HANDLE__)->Instance->JSQR        >> ADC_JSQR_JL_Pos) & 0x3U) + 1U)
+
+	#define __ADC_INJECTED_TRIGGER_IS_EXTERNAL(__HANDLE__)                                  												\
+											((((__HANDLE__)->Instance->CR2 & ADC_CR2_JEXTSEL) == ADC_INJECTED_SOFTWARE_START) ? 0U : 1U)
+
 #elif defined(STM32F2_FAMILY)
 
-	#define __ADC_IS_DMA_MULTIMODE                                                          												\
-											((READ_REG(ADC_COMMON->CCR, ADC_CCR_MULTI_Msk) == ADC_CCR_MULTI_0) ? 0U : 1U)
+	#define __ADC_IS_DMA_MULTIMODE(__HANDLE__)                                              												\
+											((READ_BIT(ADC_COMMON->CCR, ADC_CCR_MULTI_Msk) == 0U) ? 0U : 1U)
 
 	#define __ADC_IS_CONV_STARTED(__HANDLE__)                                               												\
 											(((((__HANDLE__)->Instance->SR) >> ADC_SR_STRT_Pos) & 0x1U))
@@ -144,10 +256,16 @@ typedef enum{
 	#define __ADC_MODE(__HANDLE__)                                                          												\
 											((((__HANDLE__)->Instance->CR2 >> ADC_CR2_CONT_Pos) & 0x1U))
 
+	#define __ADC_INJECTED_LENGTH(__HANDLE__)                                               												\
+											((((__HANDLE__)->Instance->JSQR >> ADC_JSQR_JL_Pos) & 0x3U) + 1U)
+
+	#define __ADC_INJECTED_TRIGGER_IS_EXTERNAL(__HANDLE__)                                  												\
+											((((__HANDLE__)->Instance->CR2 >> ADC_CR2_JEXTEN_Pos) & 0x3U) == 0U ? 0U : 1U)
+
 #elif defined(STM32F3_FAMILY)
 
-	#define __ADC_IS_DMA_MULTIMODE                                                          												\
-											((READ_REG(ADC_COMMON->CCR, ADC12_CCR_MULTI_Msk) == 0U) ? 0U : 1U)
+	#define __ADC_IS_DMA_MULTIMODE(__HANDLE__)                                              												\
+											((READ_BIT(ADC_COMMON->CCR, ADC12_CCR_MULTI_Msk) == 0U) ? 0U : 1U)
 
 	#define __ADC_IS_CONV_STARTED(__HANDLE__)                                               												\
 											(((((__HANDLE__)->Instance->CR >> ADC_CR_ADSTART_Pos) & 0x1U)))
@@ -169,10 +287,16 @@ typedef enum{
 	#define __ADC_MODE(__HANDLE__)                                                          												\
 											((((__HANDLE__)->Instance->CFGR >> ADC_CFGR_CONT_Pos) & 0x1U))
 
+	#define __ADC_INJECTED_LENGTH(__HANDLE__)                                               												\
+											((((__HANDLE__)->Instance->JSQR >> ADC_JSQR_JL_Pos) & 0x3U) + 1U)
+
+	#define __ADC_INJECTED_TRIGGER_IS_EXTERNAL(__HANDLE__)                                  												\
+											((((__HANDLE__)->Instance->JSQR >> ADC_JSQR_JEXTEN_Pos) & 0x3U) == 0U ? 0U : 1U)
+
 #elif defined(STM32F4_FAMILY)
 
-	#define __ADC_IS_DMA_MULTIMODE                                                          												\
-											((READ_REG(ADC_COMMON->CCR, ADC_CCR_MULTI_Msk) == ADC_CCR_MULTI_0) ? 0U : 1U)
+	#define __ADC_IS_DMA_MULTIMODE(__HANDLE__)                                              												\
+											((READ_BIT(ADC_COMMON->CCR, ADC_CCR_MULTI_Msk) == 0U) ? 0U : 1U)
 
 	#define __ADC_IS_CONV_STARTED(__HANDLE__)                                               												\
 											(((((__HANDLE__)->Instance->SR) >> ADC_SR_STRT_Pos) & 0x1U))
@@ -194,24 +318,78 @@ typedef enum{
 	#define __ADC_MODE(__HANDLE__)                                                          												\
 											((((__HANDLE__)->Instance->CR2 >> ADC_CR2_CONT_Pos) & 0x1U))
 
+	#define __ADC_INJECTED_LENGTH(__HANDLE__)                                               												\
+											((((__HANDLE__)->Instance->JSQR >> ADC_JSQR_JL_Pos) & 0x3U) + 1U)
+
+	#define __ADC_INJECTED_TRIGGER_IS_EXTERNAL(__HANDLE__)                                  												\
+											((((__HANDLE__)->Instance->CR2 >> ADC_CR2_JEXTEN_Pos) & 0x3U) == 0U ? 0U : 1U)
+
+
+#endif
+
+/**
+  * @brief  Role of instance in dual mode | multimode setting is common, but only ADC1 (master) and ADC2 (slave) are paired,
+  * 		 any other instance (ADC3) converts and transfers its results independently
+  */
+#define __ADC_IS_DUAL_MASTER(__HANDLE__)                                                    																							((__ADC_IS_DMA_MULTIMODE(__HANDLE__) != 0U && (__HANDLE__)->Instance == ADC1) ? 1U : 0U)
 
+#ifdef ADC2
+	#define __ADC_IS_DUAL_SLAVE(__HANDLE__)                                                 																							((__ADC_IS_DMA_MULTIMODE(__HANDLE__) != 0U && (__HANDLE__)->Instance == ADC2) ? 1U : 0U)
+#else
+	#define __ADC_IS_DUAL_SLAVE(__HANDLE__)      (0U)
 #endif
 
+#define __ADC_IS_DUAL(__HANDLE__)                                                           																							(__ADC_IS_DUAL_MASTER(__HANDLE__) | __ADC_IS_DUAL_SLAVE(__HANDLE__))
+
 
 /* Private functions Prototypes -------------------------------------------------------  */
-HAL_StatusTypeDef        ADC_Init(ADC_HandleTypeDef* hadc);
+void                     ADC_Arena_Init(ADC_ArenaTypeDef* arena, void* memory, uint32_t size);
+
+HAL_StatusTypeDef        ADC_Init(ADC_DriverContextTypeDef* dadc, ADC_HandleTypeDef* hadc, ADC_ArenaTypeDef* arena, uint16_t depth);
 
-ADC_StatusTypeDef        ADC_ReadChannel(ADC_HandleTypeDef* hadc, uint8_t channel, uint16_t*  retval);
+ADC_StatusTypeDef        ADC_ReadChannel(ADC_DriverContextTypeDef* dadc, uint8_t channel, uint16_t*  retval);
 
-__weak ADC_StatusTypeDef ADC_GetValue(ADC_HandleTypeDef* hadc, float max, uint8_t channel, float * retval);
+__weak ADC_StatusTypeDef ADC_GetValue(ADC_DriverContextTypeDef* dadc, float max, uint8_t channel, float * retval);
+
+void                     HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc);
 
 void                     HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc);
 
-ADC_StatusTypeDef        ADC_Config_GetRanksOfChannels(ADC_HandleTypeDef* hadc);
+ADC_StatusTypeDef        ADC_AcquireHalf(ADC_BufferTypeDef* badc, uint32_t* sequence, uint16_t* offset);
+
+ADC_StatusTypeDef        ADC_ReleaseHalf(ADC_BufferTypeDef* badc, uint32_t sequence);
+
+ADC_StatusTypeDef        ADC_Config_GetRanksOfChannels(ADC_DriverContextTypeDef* dadc);
 
 ADC_StatusTypeDef        ADC_GetRank(ADC_ChannelsTypeDef *cadc, uint8_t channel, uint8_t* rank);
 
-ADC_StatusTypeDef        ADC_Averaging(ADC_HandleTypeDef* hadc, ADC_BufferTypeDef* badc, uint8_t channel , uint16_t* retval);
+ADC_StatusTypeDef        ADC_ConfigScale(ADC_DriverContextTypeDef* dadc, uint8_t channel, int32_t max, float calibrationGain, int32_t calibrationOffset);
+
+ADC_StatusTypeDef        ADC_GetValueFixed(ADC_DriverContextTypeDef* dadc, uint8_t channel, int32_t* retval);
+
+ADC_StatusTypeDef        ADC_ConfigOversampling(ADC_DriverContextTypeDef* dadc, uint8_t bits);
+
+uint32_t                 ADC_GetFullScale(ADC_DriverContextTypeDef* dadc);
+
+ADC_StatusTypeDef        ADC_ReadOversampled(ADC_DriverContextTypeDef* dadc, uint8_t channel, uint16_t* retval);
 
+ADC_StatusTypeDef        ADC_ReadAll(ADC_DriverContextTypeDef* dadc, const float* max, ADC_ValuesTypeDef* retval);
+
+ADC_StatusTypeDef        ADC_GetFilter(ADC_DriverContextTypeDef* dadc, uint8_t channel, ADC_FilterTypeDef** filter);
+
+ADC_StatusTypeDef        ADC_ReadFiltered(ADC_DriverContextTypeDef* dadc, uint8_t channel, uint16_t* retval);
+
+ADC_StatusTypeDef        ADC_Averaging(ADC_DriverContextTypeDef* dadc, uint8_t channel , uint16_t* retval);
+
+ADC_StatusTypeDef        ADC_InjectedStart(ADC_DriverContextTypeDef* dadc);
+
+ADC_StatusTypeDef        ADC_ReadInjected(ADC_DriverContextTypeDef* dadc, uint16_t* values, uint32_t* count);
+
+void                     HAL_ADCEx_InjectedConvCpltCallback(ADC_HandleTypeDef *hadc);
+
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* INC_ADC_DRIVER_H_ */
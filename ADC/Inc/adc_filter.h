@@ -0,0 +1,119 @@
+/**
+  ******************************************************************************
+  * @file    adc_filter.h
+  * @author  Bartosz Rychlicki
+
+  * @Title   Per-channel filters for ADC driver
+
+  * @brief   This file contains typedefs and prototypes of filters fed with samples of ADC channels.
+  * 		 Every filter is updated in O(1) per sample: running-sum boxcar, exponential IIR and CIC decimator
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2025 AGH Eko-Energy.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef INC_ADC_FILTER_H_
+#define INC_ADC_FILTER_H_
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ----------------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported Macros (Object Type)---------------------------------------------------------- */
+#define ADC_FILTER_IIR_MAX_SHIFT   15U						// y += (x - y) / 2^shift | keeps 16-bit samples in 32-bit state
+#define ADC_FILTER_CIC_MAX_ORDER   4U
+#define ADC_FILTER_CIC_MAX_GAIN    65536U					// decimation^order | keeps 16-bit samples in 32-bit state
+
+/* Exported Typedefs ------------------------------------------------------------------- */
+/**
+  * @brief  Filter type
+  */
+typedef enum{
+	ADC_FILTER_NONE = 0,
+	ADC_FILTER_BOXCAR,
+	ADC_FILTER_IIR,
+	ADC_FILTER_CIC
+
+}ADC_FilterModeTypeDef;
+
+/**
+  * @brief  Running-sum moving average | history of samples is provided by caller
+  */
+typedef struct{
+
+	uint16_t* history;										// last window samples, ring buffer
+	uint16_t  window;										// number of averaged samples
+	uint16_t  head;											// oldest sample position
+	uint16_t  count;										// number of samples in history (< window until filled)
+	uint32_t  sum;											// sum of samples in history
+
+}ADC_BoxcarTypeDef;
+
+/**
+  * @brief  Exponential (single pole) IIR filter
+  */
+typedef struct{
+
+	uint8_t   shift;										// smoothing factor as power of two
+	uint8_t   primed;										// state initialized with first sample
+	uint32_t  acc;											// output scaled by 2^shift
+
+}ADC_IIRTypeDef;
+
+/**
+  * @brief  Cascaded integrator-comb decimator (differential delay 1)
+  */
+typedef struct{
+
+	uint8_t   order;										// number of integrator and comb stages
+	uint16_t  decimation;									// input samples per output sample
+	uint16_t  phase;										// input samples since last output
+	uint32_t  gain;											// decimation^order, output is normalized by it
+	uint32_t  integrator[ADC_FILTER_CIC_MAX_ORDER];			// integrators' state, wraps around by design
+	uint32_t  comb[ADC_FILTER_CIC_MAX_ORDER];				// combs' delayed inputs
+
+}ADC_CICTypeDef;
+
+/**
+  * @brief  Filter of one ADC channel
+  */
+typedef struct{
+
+	volatile ADC_FilterModeTypeDef mode;						// switched from thread mode while DMA callbacks feed the filter
+
+	ADC_BoxcarTypeDef     boxcar;
+	ADC_IIRTypeDef        iir;
+	ADC_CICTypeDef        cic;
+
+	volatile uint16_t     output;							// latest filtered value
+	volatile uint32_t     updates;							// number of produced outputs, 0 - no output yet
+
+}ADC_FilterTypeDef;
+
+
+/* Exported functions Prototypes -------------------------------------------------------  */
+HAL_StatusTypeDef ADC_Filter_ConfigBoxcar(ADC_FilterTypeDef* filter, uint16_t* history, uint16_t window);
+
+HAL_StatusTypeDef ADC_Filter_ConfigIIR(ADC_FilterTypeDef* filter, uint8_t shift);
+
+HAL_StatusTypeDef ADC_Filter_ConfigCIC(ADC_FilterTypeDef* filter, uint8_t order, uint16_t decimation);
+
+void              ADC_Filter_Disable(ADC_FilterTypeDef* filter);
+
+void              ADC_Filter_Update(ADC_FilterTypeDef* filter, uint16_t sample);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_ADC_FILTER_H_ */
@@ -17,38 +17,141 @@
 
 
 #include "adc_driver.h"
+#include "probe.h"
 
 /* Private Variables-------------------------------------------------------  */
-ADC_ChannelsTypeDef    cadc;
-ADC_BufferTypeDef 	   badc;
+static ADC_DriverContextTypeDef* ADC_Contexts[ADC_MAX_INSTANCES];	// contexts of initialized instances, searched by DMA callbacks
+static uint8_t                   ADC_ContextsCount = 0;
+
+/* Private functions Prototypes -------------------------------------------------------  */
+static ADC_StatusTypeDef         ADC_RegisterContext(ADC_DriverContextTypeDef* dadc);
+static ADC_DriverContextTypeDef* ADC_FindContext(ADC_TypeDef* instance);
+static void                      ADC_PublishHalf(ADC_HandleTypeDef* hadc, uint8_t half);
+static const uint16_t*           ADC_GetSamples(ADC_DriverContextTypeDef* dadc, uint16_t offset, uint8_t* stride);
+static void                      ADC_FeedFilters(ADC_DriverContextTypeDef* dadc, uint16_t offset);
+static void*                     ADC_Arena_Alloc(ADC_ArenaTypeDef* arena, uint32_t size);
+
+/**
+  * @brief ADC arena initialization function | memory is usually a static array sized with ADC_DMA_BUFF_BYTES
+  * @param  arena  - pointer to arena
+  * @param  memory - static memory reachable by DMA
+  * @param  size   - size of memory in bytes
+  */
+void ADC_Arena_Init(ADC_ArenaTypeDef* arena, void* memory, uint32_t size){
+
+	arena->memory = (uint8_t*)memory;
+	arena->size   = size;
+	arena->used   = 0;
+
+}
+
 /**
-  * @brief ADC1 Initialization Function, does calibration
+  * @brief ADC arena allocation function | memory is never freed, buffers live as long as arena
+  * @param  arena  - pointer to arena
+  * @param  size   - requested bytes
+  * @retval pointer to memory aligned to ADC_DMA_ALIGNMENT, NULL if arena is too small
+  */
+static void* ADC_Arena_Alloc(ADC_ArenaTypeDef* arena, uint32_t size){
+	uintptr_t start   = (uintptr_t)(arena->memory + arena->used);
+	uint32_t  padding = (uint32_t)((ADC_DMA_ALIGNMENT - (start % ADC_DMA_ALIGNMENT)) % ADC_DMA_ALIGNMENT);
+
+	if(arena->used + padding + size > arena->size){
+		return NULL;
+	}
+
+	arena->used += padding + size;
+
+	return (void*)(start + padding);
+}
+
+/**
+  * @brief ADC Initialization Function, does calibration. Binds context with ADC instance,
+  * 	   in dual mode master (ADC1) has to be initialized before slave.
+  * 	   DMA buffer is carved from arena and sized exactly for detected sequence length and depth
+  * 	   Filters, scales, oversampling and injected group of context are reset, context does not have to be zeroed
+  * @param  dadc   - pointer to driver context of instance
   * @param  hadc   - pointer to ADC handle
+  * @param  arena  - memory for DMA buffer, not used by slave in dual mode and by ADC without DMA
+  * @param  depth  - sequences in one half of DMA buffer (averaging depth), 0 - ADC_AVERAGED_MEASURES
   * @retval status - HAL status
   */
-HAL_StatusTypeDef ADC_Init(ADC_HandleTypeDef* hadc){
+HAL_StatusTypeDef ADC_Init(ADC_DriverContextTypeDef* dadc, ADC_HandleTypeDef* hadc, ADC_ArenaTypeDef* arena, uint16_t depth){
+
+	dadc->hadc             = hadc;
+	dadc->source           = dadc;
+	dadc->oversamplingBits = 0;
+	dadc->jadc.enabled     = 0;
+	dadc->jadc.size        = 0;
+	dadc->jadc.sequence    = 0;    // no injected conversion published yet
+	dadc->badc.depth       = 0;    // set below only for instance with its own DMA
+	dadc->badc.pingpong.sequence = 0;
+
+	// context can live on stack or be reused | nothing left from before is fed by DMA callbacks
+	for(uint8_t i = 0; i < ADC_MAX_CHANNELS; ++i){
+		dadc->sadc[i].gain = 0; // fixed-point conversion not configured
+		ADC_Filter_Disable(&dadc->fadc[i]);
+	}
+
+	// detecting ranks | number of conversions sizes the halves of DMA buffer
+	if(ADC_Config_GetRanksOfChannels(dadc) != ADC_OK){
+		return HAL_ERROR;
+	}
+
+	if(ADC_RegisterContext(dadc) != ADC_OK){
+		return HAL_ERROR;
+	}
 
 	// check if ADC is not started
 	if(__ADC_IS_CONV_STARTED(hadc) == 0){
 		HAL_ADC_Start(hadc);
 	}
 
-	// check if dma is enabled
-	if(__ADC_DMA_MODE(hadc) != 0){
+	if(__ADC_IS_DUAL_SLAVE(hadc) != 0){
+
+		// slave in dual mode | its conversions are transferred by master's DMA
+		dadc->source = ADC_FindContext(ADC1);
+
+		if(dadc->source == NULL){
+			return HAL_ERROR;
+		}
+
+	}else if(__ADC_DMA_MODE(hadc) != 0){ // check if dma is enabled | circular DMA is started once here and never restarted by readers
+
+		uint8_t  dual = __ADC_IS_DUAL_MASTER(hadc);
+		uint32_t transfers;
+
+		dadc->badc.depth = (depth == 0) ? ADC_AVERAGED_MEASURES : depth;
+		transfers        = 2U * dadc->conversions * dadc->badc.depth;
+
+		if(arena == NULL || transfers > ADC_DMA_MAX_TRANSFERS){
+			return HAL_ERROR;
+		}
+
+		// both views of buffer point to the same memory
+		dadc->badc.ddma.BufferMultiMode = (uint32_t*)ADC_Arena_Alloc(arena, transfers * (dual ? 4U : 2U));
+		dadc->badc.idma.BufferADC       = (uint16_t*)dadc->badc.ddma.BufferMultiMode;
+
+		if(dadc->badc.ddma.BufferMultiMode == NULL){
+			return HAL_ERROR;
+		}
+
+		dadc->badc.pingpong.halfLength = (uint16_t)(transfers / 2U);
+		dadc->badc.pingpong.readyHalf  = 0;
+		dadc->badc.pingpong.sequence   = 0;
 
 		// check if multimode is enabled
-		if(__ADC_MULTIMODE_IS_ENABLED(hadc) != 0){
+		if(dual != 0){
 
 			// starting DMA with ADC in dual mode
-			if(HAL_ADCEx_MultiModeStart_DMA(hadc, badc.ddma.BufferMultiMode, ADC_CONVERTED_CHANNELS) != HAL_OK){
-				return ADC_Error;
+			if(HAL_ADCEx_MultiModeStart_DMA(hadc, dadc->badc.ddma.BufferMultiMode, 2 * dadc->badc.pingpong.halfLength) != HAL_OK){
+				return HAL_ERROR;
 			}
 
 		}else{
 
 			// starting DMA with ADC in Independent mode
-			if(HAL_ADC_Start_DMA(hadc, (uint32_t*)badc.idma.BufferADC, ADC_CONVERTED_CHANNELS) != HAL_OK){
-				return ADC_Error;
+			if(HAL_ADC_Start_DMA(hadc, (uint32_t*)dadc->badc.idma.BufferADC, 2 * dadc->badc.pingpong.halfLength) != HAL_OK){
+				return HAL_ERROR;
 			}
 
 		}
@@ -59,238 +162,710 @@ HAL_StatusTypeDef ADC_Init(ADC_HandleTypeDef* hadc){
 	return HAL_ADCEx_Calibration_Start(hadc);
 }
 
+/**
+  * @brief ADC context registration function | DMA callbacks find context of instance among registered ones
+  * @param  dadc    - pointer to driver context of instance
+  * @retval status  - ADC status | ADC_Error if ADC_MAX_INSTANCES contexts are already registered
+  */
+static ADC_StatusTypeDef ADC_RegisterContext(ADC_DriverContextTypeDef* dadc){
+
+	for(uint8_t i = 0; i < ADC_ContextsCount; ++i){
+		if(ADC_Contexts[i] == dadc || ADC_Contexts[i]->hadc->Instance == dadc->hadc->Instance){ // re-initialization
+			ADC_Contexts[i] = dadc;
+			return ADC_OK;
+		}
+	}
+
+	if(ADC_ContextsCount >= ADC_MAX_INSTANCES){
+		return ADC_Error;
+	}
+
+	ADC_Contexts[ADC_ContextsCount++] = dadc;
+
+	return ADC_OK;
+}
+
+/**
+  * @brief ADC context search function
+  * @param  instance - ADC peripheral
+  * @retval pointer to context of instance, NULL if instance is not initialized
+  */
+static ADC_DriverContextTypeDef* ADC_FindContext(ADC_TypeDef* instance){
+
+	for(uint8_t i = 0; i < ADC_ContextsCount; ++i){
+		if(ADC_Contexts[i]->hadc->Instance == instance){
+			return ADC_Contexts[i];
+		}
+	}
+
+	return NULL;
+}
+
 /**
   * @brief ADC Reading channel function
-  * @param  hadc    - pointer to ADC handle
+  * @param  dadc    - pointer to driver context of instance
   * @param  channel - number of channel to be read
   * @param  retval  - pointer to variable, whose contains return value
   * @retval status  - HAL status if Reading channel went successfully
   */
-ADC_StatusTypeDef ADC_ReadChannel(ADC_HandleTypeDef* hadc, uint8_t channel, uint16_t*  retval){
+ADC_StatusTypeDef ADC_ReadChannel(ADC_DriverContextTypeDef* dadc, uint8_t channel, uint16_t*  retval){
 
+	ADC_HandleTypeDef* hadc = dadc->hadc;
 	ADC_StatusTypeDef status;
 
 	if(__ADC_IS_CONV_STARTED(hadc) == 0){ // ADC not started
 		return ADC_NotStarted;
 	}
-	if(channel < 0 || channel > 16){
+	if(channel >= ADC_CHANNEL_COUNT){
 		return ADC_Error;
 	}
 
 	uint8_t rank  = 0;
 
-	if(ADC_GetRank(&cadc, channel, &rank) != ADC_OK){
+	if(ADC_GetRank(&dadc->cadc, channel, &rank) != ADC_OK){
 		return ADC_Error;
 	}
 
 
-	if(__ADC_IS_DMA_ENABLED(hadc) == 0){  // DMA Disabled
+	if(__ADC_IS_DMA_ENABLED(dadc->source->hadc) == 0){  // DMA Disabled | in dual mode only master's DMA is enabled
 
 
 		for(int i  = 0 ; i <= rank ; ++i){
-			 if(__ADC_IS_DMA_MULTIMODE(hadc) == 0){  // single conversion | independent mode
-				 badc.ADC_Buff[channel]          = HAL_ADC_GetValue(hadc);
+			 if(__ADC_IS_DUAL(hadc) == 0){            // single conversion | independent mode
+				 dadc->badc.ADC_Buff[channel]          = (uint16_t)HAL_ADC_GetValue(hadc);
 
 			}else{									 // single conversion | dual mode
-				 badc.ddma.BufferMultiMode[rank] = HAL_ADCEx_MultiModeGetValue(hadc);
+				 uint32_t word                   = HAL_ADCEx_MultiModeGetValue(hadc);
+				 dadc->badc.ADC_Buff[channel]          = (hadc->Instance == ADC1) ? __ADC_DUALMODE_MASTER(word) : __ADC_DUALMODE_SLAVE(word);
 			}
 		}
 
-		if(badc.ADC_Buff[channel] > __ADC_RESOLUTION(hadc) || badc.ADC_Buff[channel] < 0){
+		if(dadc->badc.ADC_Buff[channel] > __ADC_RESOLUTION(hadc)){
 			return  ADC_Error;
 		}
 
+		*retval = dadc->badc.ADC_Buff[channel];
+
 		status =  ADC_OK;
 
-	}else{								  // DMA Enabled
+	}else{								  // DMA Enabled | DMA runs in circular mode, only completed half is read
+
+		status = ADC_Averaging(dadc, channel, retval); // averaging transfer
+
+	}
+
 
+	return status;
+}
+
+/**
+  * @brief ADC Basic function of returning value
+  * 	   if calculating value's logic is different, then developer should implement his function
+  * @param  dadc    - pointer to driver context of instance
+  * @param  channel - number of channel to be read
+  * @param  retval  - pointer to variable, whose contains return value
+  * @retval status  - HAL status if Reading channel went successfully
+  */
+__weak ADC_StatusTypeDef  ADC_GetValue(ADC_DriverContextTypeDef* dadc, float max, uint8_t channel, float * retval){
+	uint16_t binary_value = 0;
+	uint32_t adc_resolutiion;
 
-		if(ADC_Averaging(hadc, &badc, channel, retval) != ADC_OK){ // averaging transfer
+	if(dadc->oversamplingBits != 0 && __ADC_IS_DMA_ENABLED(dadc->source->hadc) != 0){ // oversampled value | extended full scale
+		if(ADC_ReadOversampled(dadc, channel, &binary_value) != ADC_OK){
+			return ADC_Error;
+		}
+		adc_resolutiion = ADC_GetFullScale(dadc);
+	}else{
+		if(ADC_ReadChannel(dadc, channel, &binary_value) != ADC_OK){
 			return ADC_Error;
 		}
+		adc_resolutiion = __ADC_RESOLUTION(dadc->hadc);
+	}
 
+	*retval = (float)binary_value / (float)adc_resolutiion * max;
 
-		if(__ADC_MULTIMODE_IS_ENABLED(hadc) != 0){ // ADC in dual mode | DMA [ON]
 
+	return ADC_OK;
 
-			if(__ADC_DMA_MODE(hadc) == 0){
-				if(HAL_ADCEx_MultiModeStart_DMA(hadc, badc.ddma.BufferMultiMode, ADC_CONVERTED_CHANNELS) != HAL_OK){
-					return ADC_Error;
-				}
-			}
+}
 
-		}else{									   // ADC in independent mode | DMA [ON]
+/**
+  * @brief ADC fixed-point conversion configuration function. Coefficients are computed once here,
+  * 	   so ADC_GetValueFixed needs only integer multiply and shift (no FPU needed)
+  * 	   Must be called after ADC_ConfigOversampling, full scale is taken at configuration time
+  * 	   Product of raw value and coefficient has to fit in 32 bits, so single multiply instruction is used
+  * 	   also on Cortex-M0 | |max| is limited to about 32767 units at full scale (e.g. mV, not uV)
+  * @param  dadc              - pointer to driver context of instance
+  * @param  channel           - number of channel
+  * @param  max               - value at full scale in integer engineering units (e.g. 3300 for mV)
+  * @param  calibrationGain   - calibration gain, 1.0f if channel is not calibrated
+  * @param  calibrationOffset - calibration offset in LSB, subtracted from raw value
+  * @retval status            - ADC status | ADC_Error if coefficient is 0 or product does not fit in 32 bits
+  */
+ADC_StatusTypeDef ADC_ConfigScale(ADC_DriverContextTypeDef* dadc, uint8_t channel, int32_t max, float calibrationGain, int32_t calibrationOffset){
+	uint8_t rank; // channel rank
+	float   gain = (float)max * calibrationGain * (float)(1UL << ADC_SCALE_SHIFT) / (float)ADC_GetFullScale(dadc);
+	float   span = (float)ADC_GetFullScale(dadc) + ((calibrationOffset < 0) ? -(float)calibrationOffset : (float)calibrationOffset); // largest |raw - offset|
+	int32_t fixed;
 
+	if(ADC_GetRank(&dadc->cadc, channel, &rank) != ADC_OK){
+		return ADC_Error;
+	}
 
-			if(__ADC_DMA_MODE(hadc) == 0){
-				if(HAL_ADC_Start_DMA(hadc, (uint32_t*)badc.idma.BufferADC, ADC_CONVERTED_CHANNELS) != HAL_OK){
-					return ADC_Error;
-				}
-			}
-		}
+	if(((gain < 0.0f) ? -gain : gain) * span >= (float)INT32_MAX){
+		return ADC_Error;
+	}
 
+	fixed = (int32_t)((gain < 0.0f) ? (gain - 0.5f) : (gain + 0.5f)); // rounding to nearest
 
+	if(fixed == 0){
+		return ADC_Error;
 	}
 
+	dadc->sadc[rank].gain   = fixed;
+	dadc->sadc[rank].offset = calibrationOffset;
 
-	return status;
+	return ADC_OK;
 }
 
 /**
-  * @brief ADC Basic function of returning value
-  * 	   if calculating value's logic is different, then developer should implement his function
-  * @param  hadc    - pointer to ADC handle
+  * @brief ADC fixed-point value return function | integer alternative of ADC_GetValue for cores without FPU
+  * @param  dadc    - pointer to driver context of instance
   * @param  channel - number of channel to be read
-  * @param  retval  - pointer to variable, whose contains return value
-  * @retval status  - HAL status if Reading channel went successfully
+  * @param  retval  - pointer to returning value in units given to ADC_ConfigScale
+  * @retval status  - ADC status | ADC_Error if channel was not configured by ADC_ConfigScale
   */
-__weak ADC_StatusTypeDef  ADC_GetValue(ADC_HandleTypeDef* hadc, float max, uint8_t channel, float * retval){
+ADC_StatusTypeDef ADC_GetValueFixed(ADC_DriverContextTypeDef* dadc, uint8_t channel, int32_t* retval){
 	uint16_t binary_value = 0;
-	uint32_t adc_resolutiion = __ADC_RESOLUTION(hadc);
+	uint8_t  rank; // channel rank
 
-	if(ADC_ReadChannel(hadc, channel, &binary_value) != ADC_OK){
+	if(ADC_GetRank(&dadc->cadc, channel, &rank) != ADC_OK || dadc->sadc[rank].gain == 0){
 		return ADC_Error;
 	}
 
-	*retval = (float)binary_value / (float)adc_resolutiion * max;
+	if(dadc->oversamplingBits != 0 && __ADC_IS_DMA_ENABLED(dadc->source->hadc) != 0){ // oversampled value | extended full scale
+		if(ADC_ReadOversampled(dadc, channel, &binary_value) != ADC_OK){
+			return ADC_Error;
+		}
+	}else{
+		if(ADC_ReadChannel(dadc, channel, &binary_value) != ADC_OK){
+			return ADC_Error;
+		}
+	}
+
+	// product is bounded by ADC_ConfigScale | 32x32 multiply, no __aeabi_lmul on Cortex-M0
+	*retval = ((int32_t)binary_value - dadc->sadc[rank].offset) * dadc->sadc[rank].gain >> ADC_SCALE_SHIFT;
+
+	return ADC_OK;
+}
+
+/**
+  * @brief ADC software oversampling configuration function. Every oversampled value sums 4^bits samples
+  * 	   and is shifted right by bits, which gives bits of extra resolution
+  * @param  dadc    - pointer to driver context of instance
+  * @param  bits    - extra bits of resolution, 0 disables oversampling
+  * @retval status  - ADC status | ADC_Error if DMA half holds less than 4^bits sequences
+  */
+ADC_StatusTypeDef ADC_ConfigOversampling(ADC_DriverContextTypeDef* dadc, uint8_t bits){
+
+	if(bits == 0){ // disabling is always allowed, also for ADC without DMA (depth 0)
+		dadc->oversamplingBits = 0;
+		return ADC_OK;
+	}
 
+	if(bits > ADC_OVERSAMPLING_MAX_BITS || (1U << (2 * bits)) > dadc->source->badc.depth){
+		return ADC_Error;
+	}
+
+	dadc->oversamplingBits = bits;
 
 	return ADC_OK;
+}
 
+/**
+  * @brief ADC full scale return function | hardware resolution extended by oversampling bits
+  * @param  dadc    - pointer to driver context of instance
+  * @retval full scale of values returned by ADC_ReadOversampled
+  */
+uint32_t ADC_GetFullScale(ADC_DriverContextTypeDef* dadc){
+
+	return ((__ADC_RESOLUTION(dadc->hadc) + 1U) << dadc->oversamplingBits) - 1U;
 }
 
-/*
- * @brief Empty implementation of callback function | If body of this function should does some functionalities, then implementation is required
- */
-void               HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc){
+/**
+  * @brief ADC oversampling function. Sums 4^bits latest samples of channel straight from completed half of DMA buffer
+  * 	   and decimates them by right shift | result has up to 16 bits
+  * @param  dadc    - pointer to driver context of instance
+  * @param  channel - number of channel to be read
+  * @param  retval  - pointer to returning value, full scale is returned by ADC_GetFullScale
+  * @retval status  - ADC status
+  */
+ADC_StatusTypeDef ADC_ReadOversampled(ADC_DriverContextTypeDef* dadc, uint8_t channel, uint16_t* retval){
+	uint32_t sum = 0;         // sum of oversampled values
+	uint8_t  rank;            // channel rank
+	uint32_t sequence;        // sequence number of acquired half
+	uint16_t offset;          // first transfer of acquired half
+	uint8_t  stride;          // distance between samples of ADC
+	const uint16_t* samples;  // samples of ADC in acquired half
+	uint8_t  bits = dadc->oversamplingBits;
+	uint32_t measures = 1U << (2 * bits);
+	uint32_t step;            // distance between samples of channel
+
+	if(ADC_GetRank(&dadc->cadc, channel, &rank) != ADC_OK){
+		return ADC_Error;
+	}
+
+	if(ADC_AcquireHalf(&dadc->source->badc, &sequence, &offset) != ADC_OK){
+		return ADC_NotStarted;
+	}
+
+	samples = ADC_GetSamples(dadc, offset, &stride) + rank * stride;
+	step    = dadc->conversions * stride;
 
-	UNUSED(hadc); // unused variable to avoid warnings
+	for(uint32_t i = 0; i < measures; ++i){
+		sum     += *samples;
+		samples += step;
+	}
+
+	// DMA reached acquired half during oversampling
+	if(ADC_ReleaseHalf(&dadc->source->badc, sequence) != ADC_OK){
+		return ADC_Busy;
+	}
+
+	*retval = (uint16_t)(sum >> bits);
+
+	return ADC_OK;
+}
+
+/**
+  * @brief DMA half transfer callback | lower half of buffer is completed and handed over to consumers,
+  * 	   DMA keeps writing the upper half meanwhile
+  * @param  hadc    - pointer to ADC handle
+  */
+void               HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc){
+
+	ADC_PublishHalf(hadc, 0);
 
 }
 
 /**
-  * @brief ADC channels configuration function | auto detects ranks and overwrite ADC_ChannelsTypeDef object's content
+  * @brief DMA transfer complete callback | upper half of buffer is completed and handed over to consumers,
+  * 	   DMA wraps around and keeps writing the lower half meanwhile
   * @param  hadc    - pointer to ADC handle
+  */
+void               HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc){
+
+	ADC_PublishHalf(hadc, 1);
+
+}
+
+/**
+  * @brief ADC half publishing function. Hands completed half over to consumers and feeds filters of every context
+  * 	   reading this DMA buffer (master and slave in dual mode)
+  * @param  hadc    - pointer to ADC handle, which drives the DMA stream
+  * @param  half    - completed half | 0 - lower half, 1 - upper half
+  */
+static void ADC_PublishHalf(ADC_HandleTypeDef* hadc, uint8_t half){
+	ADC_DriverContextTypeDef* dadc = ADC_FindContext(hadc->Instance);
+
+	if(dadc == NULL || dadc->source != dadc){ // callback from ADC, which is not driven by this driver
+		return;
+	}
+
+	dadc->badc.pingpong.readyHalf = half;
+	dadc->badc.pingpong.sequence++;      // published after readyHalf, consumer sees consistent pair
+
+	for(uint8_t i = 0; i < ADC_ContextsCount; ++i){
+		if(ADC_Contexts[i]->source == dadc){
+			ADC_FeedFilters(ADC_Contexts[i], half * dadc->badc.pingpong.halfLength);
+		}
+	}
+}
+
+/**
+  * @brief ADC ping-pong acquire function. Returns position of latest completed half of DMA buffer, no data is copied
+  * @param  badc     - ADC buffer, which stores converted values
+  * @param  sequence - pointer to sequence number of acquired half, needed by ADC_ReleaseHalf
+  * @param  offset   - pointer to index of first transfer of acquired half
+  * @retval status   - ADC status | ADC_NotStarted if no half has been completed yet
+  */
+ADC_StatusTypeDef  ADC_AcquireHalf(ADC_BufferTypeDef* badc, uint32_t* sequence, uint16_t* offset){
+
+	uint32_t seq = badc->pingpong.sequence;
+
+	if(seq == 0){
+		return ADC_NotStarted;
+	}
+
+	*offset   = (uint16_t)(badc->pingpong.readyHalf * badc->pingpong.halfLength);
+	*sequence = seq;
+
+	return ADC_OK;
+}
+
+/**
+  * @brief ADC ping-pong release function. Checks if acquired half was not overwritten while being read
+  * @param  badc     - ADC buffer, which stores converted values
+  * @param  sequence - sequence number returned by ADC_AcquireHalf
+  * @retval status   - ADC status | ADC_Busy if DMA has already moved into acquired half, read data may be torn
+  */
+ADC_StatusTypeDef  ADC_ReleaseHalf(ADC_BufferTypeDef* badc, uint32_t sequence){
+
+	if(badc->pingpong.sequence != sequence){
+		return ADC_Busy;
+	}
+
+	return ADC_OK;
+}
+
+/**
+  * @brief ADC channels configuration function | auto detects ranks and overwrite ADC_ChannelsTypeDef object's content,
+  * 	   builds inverse channel -> rank table used by ADC_GetRank
+  * @param  dadc    - pointer to driver context of instance
   * @retval status  - ADC status
   */
-ADC_StatusTypeDef  ADC_Config_GetRanksOfChannels(ADC_HandleTypeDef* hadc){
+ADC_StatusTypeDef  ADC_Config_GetRanksOfChannels(ADC_DriverContextTypeDef* dadc){
+
+	ADC_HandleTypeDef*   hadc = dadc->hadc;
+	ADC_ChannelsTypeDef* cadc = &dadc->cadc;
 
 	uint32_t numberOfConversions = ((hadc->Instance->SQR1 >> 20) & 0xF) + 1;
 
 
-	if(numberOfConversions > 16 || numberOfConversions < 0){
+	if(numberOfConversions > ADC_MAX_CHANNELS){
 		return ADC_Error;
 	}
 
 
-	ADC_CONVERTED_CHANNELS = numberOfConversions;
+	dadc->conversions = (uint8_t)numberOfConversions;
+
+	// no channel is converted until sequence says otherwise
+	for(int i = 0; i < ADC_CHANNEL_COUNT; ++i){
+		cadc->ranks[i] = ADC_RANK_ABSENT;
+	}
 
 	for(int i = 0; i < numberOfConversions; ++i){
 
-		if(i > 6 && i < 13){
-			cadc.channels[i] = ((hadc->Instance->SQR1 >> (5 * (i - 6))) & 0x1F);
-		}else if(i > 12){
-			cadc.channels[i] = ((hadc->Instance->SQR2 >> (5 * (i - 2 * 6))) & 0x1F);
-		}else{
-			cadc.channels[i] = ((hadc->Instance->SQR3 >> (5 * i)) & 0x1F);
+		if(i < 6){											// ranks 1..6   | SQR3
+			cadc->channels[i] = ((hadc->Instance->SQR3 >> (5 * i)) & 0x1F);
+		}else if(i < 12){									// ranks 7..12  | SQR2
+			cadc->channels[i] = ((hadc->Instance->SQR2 >> (5 * (i - 6))) & 0x1F);
+		}else{												// ranks 13..16 | SQR1
+			cadc->channels[i] = ((hadc->Instance->SQR1 >> (5 * (i - 2 * 6))) & 0x1F);
 		}
 
-		if(cadc.channels[i] > 16 || cadc.channels[i] < 0){
+		if(cadc->channels[i] >= ADC_CHANNEL_COUNT){
 			return ADC_Error;
 		}
 
+		// channel converted more than once in sequence | first rank is kept
+		if(cadc->ranks[cadc->channels[i]] == ADC_RANK_ABSENT){
+			cadc->ranks[cadc->channels[i]] = (uint8_t)i;
+		}
+
 	}
 
 	return ADC_OK;
 }
 
 /**
-  * @brief ADC channels' ranks return function. In case of wanting channel's rank, function returns it
-  * @param  hadc    - pointer to ADC handle
-  * @retval status  - ADC status
+  * @brief ADC channels' ranks return function. In case of wanting channel's rank, function returns it.
+  * 	   Single lookup in table built by ADC_Config_GetRanksOfChannels
+  * @param  cadc    - ADC channels, which store rank table
+  * @param  channel - number of channel
+  * @param  rank    - pointer to returning rank, not modified in case of error
+  * @retval status  - ADC status | ADC_Error if channel is not converted
   */
 ADC_StatusTypeDef  ADC_GetRank(ADC_ChannelsTypeDef *cadc, uint8_t channel, uint8_t* rank){
 
-	for(int i = 0 ; i <= ADC_MAX_CHANNELS; ++i ){
-		if(cadc->channels[i] == channel){
-			*rank = (uint8_t)i;
+	if(channel >= ADC_CHANNEL_COUNT || cadc->ranks[channel] == ADC_RANK_ABSENT){
+		return ADC_Error;
+	}
+
+	*rank = cadc->ranks[channel];
+
+	return ADC_OK;
+}
+
+/**
+  * @brief ADC samples' view function. Returns first sample of ADC in acquired half and distance between its samples,
+  * 	   in dual mode samples of master/slave are read as halfwords straight from packed 32-bit words
+  * @param  dadc    - pointer to driver context of instance
+  * @param  offset  - first transfer of acquired half
+  * @param  stride  - pointer to returning distance (in halfwords) between consecutive samples of ADC
+  * @retval pointer to first sample of ADC in acquired half
+  */
+static const uint16_t* ADC_GetSamples(ADC_DriverContextTypeDef* dadc, uint16_t offset, uint8_t* stride){
+	ADC_BufferTypeDef* badc = &dadc->source->badc; // buffer filled by DMA of source
+
+	if(__ADC_IS_DUAL(dadc->hadc) == 0){ // ADC in independent mode, also ADC3 while ADC1 and ADC2 are paired
+		*stride = 1;
+		return &badc->idma.BufferADC[offset];
+	}
+
+	// ADC in dual mode | master in lower, slave in upper halfword of every transfer
+	*stride = 2;
+	return &badc->ddma.BufferHalfWords[2 * offset + ((dadc->hadc->Instance == ADC1) ? 0 : 1)];
+}
 
-			break;
+/**
+  * @brief ADC filters feeding function. Called from DMA callbacks, passes every sample of completed half
+  * 	   to filter of its rank, ranks without filter are skipped
+  * @param  dadc    - pointer to driver context of instance
+  * @param  offset  - first transfer of completed half
+  */
+static void ADC_FeedFilters(ADC_DriverContextTypeDef* dadc, uint16_t offset){
+	uint8_t  stride;                                                  // distance between samples of ADC
+	const uint16_t* samples = ADC_GetSamples(dadc, offset, &stride);  // samples of ADC in completed half
+	int conversions = dadc->conversions;
+	int depth       = dadc->source->badc.depth;
+
+	for(int i = 0; i < depth; ++i){
+		for(int rank = 0; rank < conversions; ++rank){
+			if(dadc->fadc[rank].mode != ADC_FILTER_NONE){
+				ADC_Filter_Update(&dadc->fadc[rank], samples[rank * stride]);
+			}
 		}
+		samples += conversions * stride;
+	}
+}
+
+/**
+  * @brief ADC channel's filter return function. Returned filter is configured with ADC_Filter_Config* functions,
+  * 	   window length can be changed at runtime
+  * @param  dadc    - pointer to driver context of instance
+  * @param  channel - number of channel
+  * @param  filter  - pointer to returning filter of channel
+  * @retval status  - ADC status | ADC_Error if channel is not converted
+  */
+ADC_StatusTypeDef ADC_GetFilter(ADC_DriverContextTypeDef* dadc, uint8_t channel, ADC_FilterTypeDef** filter){
+	uint8_t rank; // channel rank
+
+	if(ADC_GetRank(&dadc->cadc, channel, &rank) != ADC_OK){
+		return ADC_Error;
 	}
 
-	if(*rank > 16 || *rank < 0){
+	*filter = &dadc->fadc[rank];
+
+	return ADC_OK;
+}
+
+/**
+  * @brief ADC filtered value return function. Output is updated from DMA callbacks, reading costs single load
+  * @param  dadc    - pointer to driver context of instance
+  * @param  channel - number of channel
+  * @param  retval  - pointer to returning value
+  * @retval status  - ADC status | ADC_NotStarted if filter has not produced any output yet
+  */
+ADC_StatusTypeDef ADC_ReadFiltered(ADC_DriverContextTypeDef* dadc, uint8_t channel, uint16_t* retval){
+	uint8_t rank; // channel rank
+
+	if(ADC_GetRank(&dadc->cadc, channel, &rank) != ADC_OK){
 		return ADC_Error;
 	}
 
+	if(dadc->fadc[rank].mode == ADC_FILTER_NONE || dadc->fadc[rank].updates == 0){
+		return ADC_NotStarted;
+	}
+
+	*retval = dadc->fadc[rank].output;
+
 	return ADC_OK;
 }
 
 /**
   * @brief ADC averaging function. ADC's channels' values oscillate in 40 Hz, function averages measures from exact number of conversions.
-  * 	   Macro: ADC_AVERAGED_MEASURES stores information about number of latest conversions to be measured
-  * @param  hadc    - pointer to ADC handle
-  * @param  badc    - ADC buffer, which stores converted values
+  * 	   Depth given to ADC_Init (ADC_AVERAGED_MEASURES by default) is number of latest conversions to be measured
+  * @param  dadc    - pointer to driver context of instance
+  * @param  channel - number of channel to be read
   * @param  retval  - pointer to returning value
   * @retval status  - ADC status
   */
-ADC_StatusTypeDef ADC_Averaging(ADC_HandleTypeDef* hadc, ADC_BufferTypeDef* badc, uint8_t channel , uint16_t* retval){
-	uint64_t sum = 0; // sum of averaged values
-	uint8_t rank;     // channel rank
+ADC_StatusTypeDef ADC_Averaging(ADC_DriverContextTypeDef* dadc, uint8_t channel , uint16_t* retval){
+	ADC_BufferTypeDef* badc = &dadc->source->badc; // buffer filled by DMA of source
+	uint32_t sum = 0;         // sum of averaged values
+	uint8_t  rank;            // channel rank
+	uint32_t sequence;        // sequence number of acquired half
+	uint16_t offset;          // first transfer of acquired half
+	uint8_t  stride;          // distance between samples of ADC
+	const uint16_t* samples;  // samples of ADC in acquired half
+
+	PROBE_START(PROBE_ADC_AVERAGING); // only completed averaging is recorded
 
 	// Getting channel rank
-	if(ADC_GetRank(&cadc, channel, &rank) != ADC_OK){
-		return ADC_Error;;
+	if(ADC_GetRank(&dadc->cadc, channel, &rank) != ADC_OK){
+		return ADC_Error;
 	}
 
-	if(__ADC_IS_DMA_MULTIMODE(hadc) != 0){ // ADC in dual mode
-		if(sizeof(badc->idma.BufferADC)/sizeof(badc->idma.BufferADC[0]) < ADC_AVERAGED_MEASURES){
-			return ADC_Error;
+	if(ADC_AcquireHalf(badc, &sequence, &offset) != ADC_OK){
+		return ADC_NotStarted;
+	}
+
+	samples = ADC_GetSamples(dadc, offset, &stride);
+
+	for(int i = 0; i < badc->depth; ++i){
+		// adding to sum variable next value correlated to current channel
+		sum += samples[(i * dadc->conversions + rank) * stride];
+	}
+
+	// DMA reached acquired half during averaging
+	if(ADC_ReleaseHalf(badc, sequence) != ADC_OK){
+		return ADC_Busy;
+	}
+
+	*retval = (sum / badc->depth); // averaging by dividing sum with number of averaged conversions
+
+	PROBE_STOP(PROBE_ADC_AVERAGING);
+
+	return ADC_OK;
+}
+
+/**
+  * @brief ADC bulk reading function. Averages all ranks in one pass over completed half of DMA buffer,
+  * 	   instead of walking whole buffer once per channel
+  * @param  dadc    - pointer to driver context of instance
+  * @param  max     - full scale of every rank (indexed by rank), NULL if scaled values are not needed
+  * @param  retval  - pointer to returning values of all ranks
+  * @retval status  - ADC status
+  */
+ADC_StatusTypeDef ADC_ReadAll(ADC_DriverContextTypeDef* dadc, const float* max, ADC_ValuesTypeDef* retval){
+	ADC_HandleTypeDef* hadc = dadc->hadc;
+	ADC_BufferTypeDef* badc = &dadc->source->badc; // buffer filled by DMA of source
+	uint32_t sum[ADC_MAX_CHANNELS] = {0}; // sums of averaged values, indexed by rank
+	uint32_t sequence;                    // sequence number of acquired half
+	uint16_t offset;                      // first transfer of acquired half
+	uint8_t  stride;                      // distance between samples of ADC
+	const uint16_t* samples;              // samples of ADC in acquired half
+	int conversions = dadc->conversions;
+
+	if(__ADC_IS_CONV_STARTED(hadc) == 0){ // ADC not started
+		return ADC_NotStarted;
+	}
+
+	if(__ADC_IS_DMA_ENABLED(dadc->source->hadc) == 0){  // buffer is filled only by DMA, of master in dual mode
+		return ADC_DMA_NotEnabled;
+	}
+
+	if(ADC_AcquireHalf(badc, &sequence, &offset) != ADC_OK){
+		return ADC_NotStarted;
+	}
+
+	// choosing buffer once, not for every sample
+	samples = ADC_GetSamples(dadc, offset, &stride);
+
+	// buffer is walked sequentially, every sequence adds one sample to each rank
+	for(int i = 0; i < badc->depth; ++i){
+		for(int rank = 0; rank < conversions; ++rank){
+			sum[rank] += samples[rank * stride];
 		}
+		samples += conversions * stride;
+	}
 
+	// DMA reached acquired half during averaging
+	if(ADC_ReleaseHalf(badc, sequence) != ADC_OK){
+		return ADC_Busy;
+	}
 
-	}else{								   // ADC in independent mode
-		if(sizeof(badc->ddma.BufferMultiMode)/sizeof(badc->ddma.BufferMultiMode) < ADC_AVERAGED_MEASURES){
-			return ADC_Error;
+	uint32_t adc_resolution = __ADC_RESOLUTION(hadc);
+
+	for(int rank = 0; rank < conversions; ++rank){
+		retval->raw[rank] = (uint16_t)(sum[rank] / badc->depth);
+
+		if(max != NULL){
+			retval->value[rank] = (float)retval->raw[rank] / (float)adc_resolution * max[rank];
 		}
+	}
 
-		if(hadc->Instance == ADC1){
+	retval->size = (uint8_t)conversions;
 
-			// Extracting ADC1 values from dual mode buffer
-			for(int  i = 0 ; i <= ADC_BUFF_SIZE ; ++i){
-				badc->ddma.BufferADC_Master[i] = ((badc->ddma.BufferMultiMode[i] >> 16) & 0xFF);
-			}
+	return ADC_OK;
+}
 
-		}else if(hadc->Instance == ADC2){
+/**
+  * @brief ADC injected group start function. Injected ranks are auto detected from JSQR, trigger source (e.g. timer's TRGO
+  * 	   at PWM centre) is taken from injected group configuration. Regular group keeps working with DMA meanwhile
+  * @param  dadc    - pointer to driver context of instance, initialized by ADC_Init
+  * @retval status  - ADC status | ADC_Error if injected group is not triggered externally
+  */
+ADC_StatusTypeDef ADC_InjectedStart(ADC_DriverContextTypeDef* dadc){
+	ADC_HandleTypeDef* hadc = dadc->hadc;
 
-			// Extracting ADC2 values from dual mode buffer
-			for(int  i = 0 ; i <= ADC_BUFF_SIZE ; ++i){
-				badc->ddma.BufferADC_Slave[i] = (badc->ddma.BufferMultiMode[i] & 0xFF);
-			}
+	// software trigger would need polling | only hardware triggered conversions are supported
+	if(__ADC_INJECTED_TRIGGER_IS_EXTERNAL(hadc) == 0){
+		return ADC_Error;
+	}
+
+	dadc->jadc.enabled  = 0;
+	dadc->jadc.size     = (uint8_t)__ADC_INJECTED_LENGTH(hadc);
+	dadc->jadc.sequence = 0;
+	dadc->jadc.enabled  = 1;
+
+	if(HAL_ADCEx_InjectedStart_IT(hadc) != HAL_OK){
+		dadc->jadc.enabled = 0;
+		return ADC_Error;
+	}
+
+	return ADC_OK;
+}
 
+/**
+  * @brief ADC injected values return function. Copies latest injected conversion out of slot without disabling interrupts,
+  * 	   copy is retried if ISR published new conversion during reading
+  * @param  dadc    - pointer to driver context of instance
+  * @param  values  - pointer to returning values, at least ADC_INJECTED_MAX_RANKS elements, indexed by injected rank
+  * @param  count   - pointer to returning number of published conversions, NULL if not needed
+  * @retval status  - ADC status | ADC_NotStarted if no conversion is published yet, ADC_Busy if every retry was torn
+  */
+ADC_StatusTypeDef ADC_ReadInjected(ADC_DriverContextTypeDef* dadc, uint16_t* values, uint32_t* count){
+	ADC_InjectedTypeDef* jadc = &dadc->jadc;
+
+	for(int attempt = 0; attempt < ADC_INJECTED_RETRIES; ++attempt){
+		uint32_t sequence = jadc->sequence;
+
+		if(sequence == 0){
+			return ADC_NotStarted;
 		}
 
+		if((sequence & 0x1U) != 0){ // ISR is writing slot
+			continue;
+		}
 
+		for(uint8_t i = 0; i < jadc->size; ++i){
+			values[i] = jadc->value[i];
+		}
+
+		if(jadc->sequence == sequence){
+			if(count != NULL){
+				*count = sequence / 2U;
+			}
+			return ADC_OK;
+		}
 	}
 
+	return ADC_Busy;
+}
 
-	int16_t id = 0; // current position of averaged value
-	for( int i = 0; i <= ADC_AVERAGED_MEASURES; ++i){
-		id = (i * ADC_AVERAGED_MEASURES + rank);
+/**
+  * @brief Injected conversion complete callback | publishes JDRx of all injected ranks into latest-value slot
+  * @param  hadc    - pointer to ADC handle
+  */
+void               HAL_ADCEx_InjectedConvCpltCallback(ADC_HandleTypeDef *hadc){
+	ADC_DriverContextTypeDef* dadc = ADC_FindContext(hadc->Instance);
+	volatile uint32_t*        jdr  = &hadc->Instance->JDR1; // JDR1..JDR4 are consecutive registers
 
-		// adding to sum variable next value correlated to current channel
-		sum += ((__ADC_IS_DMA_MULTIMODE(hadc) == 0)
-					 ? badc->idma.BufferADC[id] 							 // adding value of ADC in independent mode
-				      :((hadc->Instance == ADC1)
-					 ? badc->ddma.BufferADC_Master[id]
-	                  : badc->ddma.BufferADC_Slave[id]));                   // adding value of ADC in dual mode | checking instance
+	if(dadc == NULL || dadc->jadc.enabled == 0){ // callback from ADC, which is not driven by this driver
+		return;
 	}
 
-	*retval = (sum / ADC_AVERAGED_MEASURES); // averaging by dividing sum with number of averaged conversions
+	dadc->jadc.sequence++;      // odd | slot is being written
 
-	return HAL_OK;
-}
+	for(uint8_t i = 0; i < dadc->jadc.size; ++i){
+		dadc->jadc.value[i] = (uint16_t)jdr[i];
+	}
 
+	dadc->jadc.sequence++;      // even | slot is consistent
+
+}
 
 
 
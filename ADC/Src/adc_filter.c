@@ -0,0 +1,199 @@
+/**
+  ******************************************************************************
+  * @file      adc_filter.c
+  * @author    Bartosz Rychlicki
+  * @Title     Per-channel filters for ADC driver
+  * @brief     This file contains functions' bodies of filters fed with samples of ADC channels
+  ******************************************************************************
+  * @attention Filters are updated from DMA callbacks. Configuration functions disable filter first
+  * 		   and enable it as the last step, so callback never works on half-configured filter
+  *
+  * Copyright (c) 2025 AGH Eko-Energy.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+
+
+#include "adc_filter.h"
+
+/**
+  * @brief Filter disabling function | filter stops consuming samples, last output is kept
+  * @param  filter  - pointer to filter
+  */
+void ADC_Filter_Disable(ADC_FilterTypeDef* filter){
+
+	filter->mode    = ADC_FILTER_NONE;
+	filter->updates = 0;
+
+}
+
+/**
+  * @brief Running-sum moving average configuration function. Window can be changed at runtime
+  * @param  filter  - pointer to filter
+  * @param  history - buffer of at least window samples, owned by caller
+  * @param  window  - number of averaged samples
+  * @retval status  - HAL status
+  */
+HAL_StatusTypeDef ADC_Filter_ConfigBoxcar(ADC_FilterTypeDef* filter, uint16_t* history, uint16_t window){
+
+	if(history == NULL || window == 0){
+		return HAL_ERROR;
+	}
+
+	ADC_Filter_Disable(filter);
+
+	filter->boxcar.history = history;
+	filter->boxcar.window  = window;
+	filter->boxcar.head    = 0;
+	filter->boxcar.count   = 0;
+	filter->boxcar.sum     = 0;
+
+	__DMB();											// state is written before the callback sees the new mode
+	filter->mode = ADC_FILTER_BOXCAR;
+
+	return HAL_OK;
+}
+
+/**
+  * @brief Exponential IIR configuration function | y += (x - y) / 2^shift
+  * @param  filter  - pointer to filter
+  * @param  shift   - smoothing factor, time constant is about 2^shift samples
+  * @retval status  - HAL status
+  */
+HAL_StatusTypeDef ADC_Filter_ConfigIIR(ADC_FilterTypeDef* filter, uint8_t shift){
+
+	if(shift > ADC_FILTER_IIR_MAX_SHIFT){
+		return HAL_ERROR;
+	}
+
+	ADC_Filter_Disable(filter);
+
+	filter->iir.shift  = shift;
+	filter->iir.primed = 0;
+	filter->iir.acc    = 0;
+
+	__DMB();
+	filter->mode = ADC_FILTER_IIR;
+
+	return HAL_OK;
+}
+
+/**
+  * @brief CIC decimator configuration function | one output per decimation input samples
+  * @param  filter     - pointer to filter
+  * @param  order      - number of stages (1..ADC_FILTER_CIC_MAX_ORDER)
+  * @param  decimation - decimation ratio, decimation^order must not exceed ADC_FILTER_CIC_MAX_GAIN
+  * @retval status     - HAL status
+  */
+HAL_StatusTypeDef ADC_Filter_ConfigCIC(ADC_FilterTypeDef* filter, uint8_t order, uint16_t decimation){
+
+	uint32_t gain = 1;
+
+	if(order == 0 || order > ADC_FILTER_CIC_MAX_ORDER || decimation == 0){
+		return HAL_ERROR;
+	}
+
+	for(uint8_t i = 0; i < order; ++i){
+		gain *= decimation;
+
+		if(gain > ADC_FILTER_CIC_MAX_GAIN){
+			return HAL_ERROR;
+		}
+	}
+
+	ADC_Filter_Disable(filter);
+
+	filter->cic.order      = order;
+	filter->cic.decimation = decimation;
+	filter->cic.phase      = 0;
+	filter->cic.gain       = gain;
+
+	for(uint8_t i = 0; i < ADC_FILTER_CIC_MAX_ORDER; ++i){
+		filter->cic.integrator[i] = 0;
+		filter->cic.comb[i]       = 0;
+	}
+
+	__DMB();
+	filter->mode = ADC_FILTER_CIC;
+
+	return HAL_OK;
+}
+
+/**
+  * @brief Filter update function. Consumes one sample in O(1), regardless of window length
+  * @param  filter  - pointer to filter
+  * @param  sample  - new sample of channel
+  */
+void ADC_Filter_Update(ADC_FilterTypeDef* filter, uint16_t sample){
+
+	switch(filter->mode){
+
+	case ADC_FILTER_BOXCAR:{
+		ADC_BoxcarTypeDef* box = &filter->boxcar;
+
+		if(box->count == box->window){ // window filled | oldest sample leaves the sum
+			box->sum -= box->history[box->head];
+		}else{
+			box->count++;
+		}
+
+		box->history[box->head] = sample;
+		box->sum += sample;
+
+		if(++box->head == box->window){
+			box->head = 0;
+		}
+
+		filter->output = (uint16_t)(box->sum / box->count);
+		filter->updates++;
+	}
+	break;
+
+	case ADC_FILTER_IIR:{
+		ADC_IIRTypeDef* iir = &filter->iir;
+
+		if(iir->primed == 0){ // starting from first sample instead of zero
+			iir->acc    = (uint32_t)sample << iir->shift;
+			iir->primed = 1;
+		}else{
+			iir->acc = iir->acc + sample - (iir->acc >> iir->shift);
+		}
+
+		filter->output = (uint16_t)(iir->acc >> iir->shift);
+		filter->updates++;
+	}
+	break;
+
+	case ADC_FILTER_CIC:{
+		ADC_CICTypeDef* cic = &filter->cic;
+		uint32_t value = sample;
+
+		// integrators run at input rate
+		for(uint8_t i = 0; i < cic->order; ++i){
+			cic->integrator[i] += value;
+			value = cic->integrator[i];
+		}
+
+		if(++cic->phase < cic->decimation){
+			break;
+		}
+		cic->phase = 0;
+
+		// combs run at output rate | modular arithmetic cancels integrators' wrap around
+		for(uint8_t i = 0; i < cic->order; ++i){
+			uint32_t delayed = cic->comb[i];
+			cic->comb[i] = value;
+			value -= delayed;
+		}
+
+		filter->output = (uint16_t)(value / cic->gain);
+		filter->updates++;
+	}
+	break;
+
+	default:
+	break;
+	}
+
+}
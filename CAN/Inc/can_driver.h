@@ -9,52 +9,249 @@
 #define INC_CAN_DRIVER_H_
 
 #include "main.h"
+#include "stm32_family.h"
 #include "can_id_list.h"
+#include "can_signal.h"
 #include <stdio.h>
 
 /**
  * Defines
  */
 
-#define CAN_MAX_DLC 8
+#define CAN_MAX_DLC 8									// data bytes of classic frame
 #define CAN_MAX_MSG 32
+#define CAN_NO_DEADLINE 0xFFFFFFFFU					// returned by CAN_HandleScheduled when nothing is scheduled
+#define CAN_TX_QUEUE_SIZE 32
+#define CAN_RX_RING_SIZE 64								// power of two
+#ifndef CAN_MAX_ROUTES
+#define CAN_MAX_ROUTES 32								// handlers of received IDs, 16 bytes of RAM each, raise with -DCAN_MAX_ROUTES
+#endif
+
+/**
+ * Backend
+ * G4 and H7 have FDCAN (up to 64 data bytes), other families bxCAN
+ * Scheduler, TX queue, RX ring and dispatch touch the peripheral only through names below,
+ * CAN_ConfigFilters uses filter banks on bxCAN and filter elements on FDCAN, can_telemetry and can_isotp are bxCAN only
+ */
+#if defined(STM32G4_FAMILY) || defined(STM32H7_FAMILY)
+
+#define CAN_BACKEND_FDCAN
+
+typedef FDCAN_HandleTypeDef 	CAN_Handle;
+typedef FDCAN_TxHeaderTypeDef 	CAN_TxHeader;
+typedef FDCAN_RxHeaderTypeDef 	CAN_RxHeader;
+
+#define CAN_MAX_DATA 64
+
+// bxCAN names are kept, so IDs are registered and FIFOs are passed the same way on both backends
+#define CAN_ID_STD 		FDCAN_STANDARD_ID
+#define CAN_ID_EXT 		FDCAN_EXTENDED_ID
+#define CAN_RX_FIFO0 	FDCAN_RX_FIFO0
+#define CAN_RX_FIFO1 	FDCAN_RX_FIFO1
+
+#define __CAN_HEADER_IDE(__HEADER__) 								((__HEADER__)->IdType)
+#define __CAN_HEADER_ID(__HEADER__) 								((__HEADER__)->Identifier)
+#define __CAN_HEADER_LENGTH(__HEADER__) 							CAN_DlcToLength((__HEADER__)->DataLength)
+
+#define __CAN_TX_FREE_LEVEL(__HANDLE__) 							HAL_FDCAN_GetTxFifoFreeLevel(__HANDLE__)
+#define __CAN_TX_ADD(__HANDLE__, __HEADER__, __DATA__, __QUEUE__) 	HAL_FDCAN_AddMessageToTxFifoQ((__HANDLE__), (FDCAN_TxHeaderTypeDef*)(__HEADER__), (uint8_t*)(__DATA__))
+#define __CAN_RX_FILL_LEVEL(__HANDLE__, __FIFO__) 					HAL_FDCAN_GetRxFifoFillLevel((__HANDLE__), (__FIFO__))
+#define __CAN_RX_GET(__HANDLE__, __FIFO__, __HEADER__, __DATA__) 	HAL_FDCAN_GetRxMessage((__HANDLE__), (__FIFO__), (__HEADER__), (__DATA__))
+#define __CAN_RX_LOST_FLAG(__FIFO__) 								(((__FIFO__) == CAN_RX_FIFO0) ? FDCAN_FLAG_RX_FIFO0_MESSAGE_LOST \
+																			: FDCAN_FLAG_RX_FIFO1_MESSAGE_LOST)
+#define __CAN_GET_FLAG(__HANDLE__, __FLAG__) 						__HAL_FDCAN_GET_FLAG((__HANDLE__), (__FLAG__))
+#define __CAN_CLEAR_FLAG(__HANDLE__, __FLAG__) 						__HAL_FDCAN_CLEAR_FLAG((__HANDLE__), (__FLAG__))
+
+#else
+
+typedef CAN_HandleTypeDef 		CAN_Handle;
+typedef CAN_TxHeaderTypeDef 	CAN_TxHeader;
+typedef CAN_RxHeaderTypeDef 	CAN_RxHeader;
+
+#define CAN_MAX_DATA CAN_MAX_DLC
+
+#define __CAN_HEADER_IDE(__HEADER__) 								((__HEADER__)->IDE)
+#define __CAN_HEADER_ID(__HEADER__) 								(((__HEADER__)->IDE == CAN_ID_EXT) ? (__HEADER__)->ExtId : (__HEADER__)->StdId)
+#define __CAN_HEADER_LENGTH(__HEADER__) 							((__HEADER__)->DLC)
+
+#define __CAN_TX_FREE_LEVEL(__HANDLE__) 							HAL_CAN_GetTxMailboxesFreeLevel(__HANDLE__)
+#define __CAN_TX_ADD(__HANDLE__, __HEADER__, __DATA__, __QUEUE__) 	HAL_CAN_AddTxMessage((__HANDLE__), (__HEADER__), (__DATA__), &(__QUEUE__)->txMailbox)
+#define __CAN_RX_FILL_LEVEL(__HANDLE__, __FIFO__) 					HAL_CAN_GetRxFifoFillLevel((__HANDLE__), (__FIFO__))
+#define __CAN_RX_GET(__HANDLE__, __FIFO__, __HEADER__, __DATA__) 	HAL_CAN_GetRxMessage((__HANDLE__), (__FIFO__), (__HEADER__), (__DATA__))
+#define __CAN_RX_LOST_FLAG(__FIFO__) 								(((__FIFO__) == CAN_RX_FIFO0) ? CAN_FLAG_FOV0 : CAN_FLAG_FOV1)
+#define __CAN_GET_FLAG(__HANDLE__, __FLAG__) 						__HAL_CAN_GET_FLAG((__HANDLE__), (__FLAG__))
+#define __CAN_CLEAR_FLAG(__HANDLE__, __FLAG__) 						__HAL_CAN_CLEAR_FLAG((__HANDLE__), (__FLAG__))
+
+#endif
+
+/**
+ * Frame waiting for a free mailbox
+ */
+typedef struct {
+	CAN_TxHeader 		header;
+	uint8_t 			data[CAN_MAX_DATA];
+	uint32_t 			order;							// enqueue number, keeps FIFO order of frames with equal ID
+}CAN_TxFrame;
+
+/**
+ * Software TX queue, min-heap on arbitration priority (lowest ID is sent first)
+ * Drained from TX mailbox complete interrupts, so the bus is kept busy without polling
+ */
+typedef struct {
+	CAN_TxFrame 		frames[CAN_TX_QUEUE_SIZE];
+	volatile uint8_t 	size;							// current depth
+	volatile uint8_t 	highWater;						// deepest the queue has been
+	volatile uint32_t 	dropped;						// frames rejected because the queue was full
+	volatile uint32_t 	txFrames;						// frames handed to mailboxes
+	volatile uint32_t 	txBits;							// their estimated length on the bus, see CAN_FrameBits
+	uint32_t 			order;
+	uint32_t 			txMailbox;
+}CAN_TxQueue;
+
+/**
+ * Received frame waiting for dispatch
+ */
+typedef struct {
+	CAN_RxHeader 		header;
+	uint8_t 			data[CAN_MAX_DATA];
+	uint32_t 			tick;							// HAL tick of reception
+}CAN_RxFrame;
+
+/**
+ * Ring of received frames, filled by RX interrupts and drained by the main loop
+ * head is written only by interrupts, each claims and publishes a slot with interrupts masked,
+ * so FIFO0 and FIFO1 interrupts may share the ring; tail is written only by main loop
+ */
+typedef struct {
+	CAN_RxFrame 		frames[CAN_RX_RING_SIZE];
+	volatile uint16_t 	head;							// free running write index
+	volatile uint16_t 	tail;							// free running read index
+	volatile uint16_t 	highWater;						// most frames waiting at once
+	volatile uint32_t 	dropped;						// frames lost because the ring was full
+	volatile uint32_t 	overruns;						// frames lost by hardware FIFO before the interrupt emptied it
+	volatile uint32_t 	rxFrames;						// frames read from hardware FIFOs
+	volatile uint32_t 	rxBits;							// their estimated length on the bus, see CAN_FrameBits
+}CAN_RxRing;
+
+/**
+ * Handler of received frame, ctx is the pointer given at registration
+ */
+typedef void (*CAN_RxHandler)(const CAN_RxFrame *frame, void *ctx);
+
+/**
+ * Route of one received ID
+ */
+typedef struct {
+	uint32_t 			key;							// IDE and ID, see CAN_RouteKey
+	CAN_RxHandler 		handler;
+	void 				*ctx;
+	uint8_t 			immediate;						// handler runs in RX interrupt, ID is received through FIFO1
+}CAN_RxRoute;
+
+/**
+ * Routes sorted by key, lookup is a binary search so cost grows with log2 of registered IDs
+ */
+typedef struct {
+	CAN_RxRoute 		routes[CAN_MAX_ROUTES];
+	uint16_t 			size;
+	CAN_RxHandler 		fallback;						// handler of unregistered IDs, may be NULL
+	void 				*fallbackCtx;
+	uint32_t 			unhandled;						// frames of unregistered IDs
+}CAN_RxRouteTable;
+
+/**
+ * Double-buffered payload owned by producer, sent without copying it through GetData
+ * Producer fills CAN_PayloadBeginWrite buffer and publishes it with CAN_PayloadCommit,
+ * it may commit at most once while a frame is being handed to the mailbox
+ */
+typedef struct {
+	uint8_t 			buffer[2][CAN_MAX_DATA];
+	volatile uint8_t 	active;							// buffer read by the driver
+	volatile uint32_t 	generation;						// number of commits
+}CAN_Payload;
 
 /**
  * Periodic CAN message
  */
 typedef struct {
-	CAN_TxHeaderTypeDef header;							// frame header
+	CAN_TxHeader 		header;							// frame header
 	uint32_t 			period_ms;						// period of this message
-	uint32_t 			last_tick;						// time stamp of the last message
-	void 				(*GetData)(uint8_t *data);		// fetches data
+	uint32_t 			last_tick;						// slot of the last message, next one is due at last_tick + period_ms
+	void 				(*GetData)(uint8_t *data);		// fetches data, not used when payload or signals are set
+	CAN_Payload 		*payload;						// static payload sent directly, NULL - signals or GetData are used
+	const CAN_SignalTable *signals;						// packed from bound variables, NULL - GetData is used
+	uint8_t 			onChange;						// payload is sent only when it was committed since the last frame
+	uint32_t 			sentGeneration;					// generation of the last sent payload
 }CAN_ScheduledMsg;
 
 /**
  * Periodic CAN message list used for automation
+ * list is kept as a binary min-heap on deadline, list[0] is always due first
  */
 typedef struct {
 	CAN_ScheduledMsg list[CAN_MAX_MSG];
 	uint8_t size;
-	uint32_t txMailbox;
 }CAN_ScheduledMsgList;
 
+/**
+ * @brief	Worst-case length of frame on the bus in bits, including stuff bits and interframe space
+ * 			FDCAN frames are counted at nominal bit rate, so bit rate switching makes it an upper bound
+ */
+static inline uint32_t CAN_FrameBits(uint32_t ide, uint32_t dlc)
+{
+	if(dlc > CAN_MAX_DATA)
+		dlc = CAN_MAX_DATA;
+
+	if(ide == CAN_ID_EXT)
+		return 67 + 8 * dlc + (54 + 8 * dlc - 1) / 4;
+
+	return 47 + 8 * dlc + (34 + 8 * dlc - 1) / 4;
+}
+
 /**
  * Setup functions
  */
-void CAN_Init(CAN_HandleTypeDef*);
+void CAN_Init(CAN_Handle*);
+HAL_StatusTypeDef CAN_ConfigFilters(CAN_Handle *hcan, const CAN_RxRouteTable*, uint8_t firstBank, uint8_t bankCount,
+									uint16_t urgentCount);
+#ifdef CAN_BACKEND_FDCAN
+uint8_t CAN_DlcToLength(uint32_t dlc);
+uint32_t CAN_LengthToDlc(uint8_t length);
+#endif
+
+/**
+ * Functions for transmitted messages
+ */
+HAL_StatusTypeDef CAN_Transmit(CAN_Handle *hcan, CAN_TxQueue*, const CAN_TxHeader*, const uint8_t *data);
+void CAN_HandleTxMailboxEmpty(CAN_Handle *hcan, CAN_TxQueue*);
 
 /**
  * Functions for scheduled messages
  */
 HAL_StatusTypeDef CAN_AddScheduledMessage(CAN_ScheduledMsg, CAN_ScheduledMsgList*);
-HAL_StatusTypeDef CAN_RemoveScheduledMessage(uint32_t, CAN_ScheduledMsgList*);
+HAL_StatusTypeDef CAN_RemoveScheduledMessage(uint32_t ide, uint32_t id, CAN_ScheduledMsgList*);
+
+uint32_t CAN_HandleScheduled(CAN_Handle *hcan, CAN_TxQueue*, CAN_ScheduledMsgList*);
 
-void CAN_HandleScheduled(CAN_HandleTypeDef *hcan, CAN_ScheduledMsgList*);
+uint8_t* CAN_PayloadBeginWrite(CAN_Payload*);
+void CAN_PayloadCommit(CAN_Payload*);
 
 /**
  * Functions for received messages
  */
-void CAN_HandleReceived(CAN_HandleTypeDef *hcan, uint8_t fifo);
+void CAN_HandleReceived(CAN_Handle *hcan, CAN_RxRing*, const CAN_RxRouteTable*, uint32_t fifo);
+uint16_t CAN_DispatchReceived(CAN_RxRing*, CAN_RxRouteTable*, uint16_t batch);
+void CAN_HandleSignals(const CAN_RxFrame *frame, void *ctx);
+
+/**
+ * Functions for routing of received messages
+ * ide is CAN_ID_STD or CAN_ID_EXT, id is StdId or ExtId respectively
+ */
+HAL_StatusTypeDef CAN_RegisterHandler(CAN_RxRouteTable*, uint32_t ide, uint32_t id, CAN_RxHandler, void *ctx);
+HAL_StatusTypeDef CAN_RegisterImmediateHandler(CAN_RxRouteTable*, uint32_t ide, uint32_t id, CAN_RxHandler, void *ctx);
+HAL_StatusTypeDef CAN_UnregisterHandler(CAN_RxRouteTable*, uint32_t ide, uint32_t id);
+void CAN_SetFallbackHandler(CAN_RxRouteTable*, CAN_RxHandler, void *ctx);
+const CAN_RxRoute* CAN_FindRoute(const CAN_RxRouteTable*, uint32_t ide, uint32_t id);
 
 
 #endif /* INC_CAN_DRIVER_H_ */
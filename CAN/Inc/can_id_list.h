@@ -1,5 +1,7 @@
 /*
  * can_id_list.h
+ *
+ * IDs are registered with CAN_RegisterHandler together with their IDE
  */
 
 #ifndef INC_CAN_ID_LIST_H_
@@ -0,0 +1,102 @@
+/**
+  * @file can_isotp.h
+  * @brief Segmented transfers over CAN (ISO 15765-2 style) for payloads longer than one frame
+  * @author AGH EKO-ENERGIA
+  *
+  * Frames are sent through CAN_TxQueue, so controller has to keep order of frames with equal ID:
+  * TransmitFifoPriority (MCR TXFP) must be enabled
+  */
+
+#ifndef INC_CAN_ISOTP_H_
+#define INC_CAN_ISOTP_H_
+
+#include "can_driver.h"
+
+#ifdef CAN_BACKEND_FDCAN
+#error "can_isotp relies on classic frames and bxCAN TXFP, it is not available on FDCAN"
+#endif
+
+/**
+ * Defines
+ */
+
+#define CAN_ISOTP_SF_MAX 		7						// longest payload of single frame
+#define CAN_ISOTP_FF12_MAX 		4095					// longest payload with 12-bit length, longer ones use 32-bit escape
+#define CAN_ISOTP_TIMEOUT_MS 	1000					// N_Bs (waiting for flow control) and N_Cr (waiting for consecutive frame)
+#define CAN_ISOTP_PADDING 		0xCC
+#define CAN_ISOTP_QUEUE_SHARE 	(CAN_TX_QUEUE_SIZE / 2)	// frames of one transfer queued at once, rest of queue is left for other traffic
+
+/**
+ * Transfer state of one direction
+ */
+typedef enum {
+	CAN_ISOTP_IDLE = 0,
+	CAN_ISOTP_WAIT_FC,									// TX: first frame or block sent, waiting for flow control
+	CAN_ISOTP_SENDING,									// TX: consecutive frames are queued
+	CAN_ISOTP_RECEIVING									// RX: consecutive frames are expected
+}CAN_IsoTpState;
+
+/**
+ * Result of transfer reported to callbacks
+ */
+typedef enum {
+	CAN_ISOTP_OK = 0,
+	CAN_ISOTP_TIMEOUT,
+	CAN_ISOTP_OVERFLOW,									// receiver buffer is too small
+	CAN_ISOTP_SEQUENCE,									// consecutive frame lost
+	CAN_ISOTP_ABORTED									// new first frame interrupted reception
+}CAN_IsoTpResult;
+
+/**
+ * Point to point link, one TX ID and one RX ID
+ */
+typedef struct CAN_IsoTpLink {
+	CAN_HandleTypeDef 	*hcan;
+	CAN_TxQueue 		*queue;
+	CAN_TxHeaderTypeDef txHeader;						// ID of frames sent by this node
+
+	uint8_t 			blockSize;						// frames received between flow controls, 0 - no limit
+	uint8_t 			stMin;							// ms between received consecutive frames
+
+	// transmission
+	CAN_IsoTpState 		txState;
+	const uint8_t 		*txData;
+	uint32_t 			txLength;
+	uint32_t 			txOffset;
+	uint8_t 			txSequence;
+	uint8_t 			txBlockLeft;					// frames until next flow control, 0 - no limit
+	uint8_t 			txUnlimited;
+	uint8_t 			txStMin;						// ms between sent consecutive frames, from flow control
+	uint32_t 			txTick;							// last frame sent or flow control received
+
+	// reception
+	CAN_IsoTpState 		rxState;
+	uint8_t 			*rxBuffer;						// reassembly buffer owned by caller
+	uint32_t 			rxCapacity;
+	uint32_t 			rxLength;
+	uint32_t 			rxOffset;
+	uint8_t 			rxSequence;
+	uint8_t 			rxBlockLeft;
+	uint32_t 			rxTick;
+	uint8_t 			rxFcPending;					// flow control did not fit into TX queue, CAN_IsoTp_Poll retries it
+	uint8_t 			rxFcStatus;						// its flow status
+
+	void 				(*Received)(struct CAN_IsoTpLink *link, CAN_IsoTpResult result, uint32_t length);
+	void 				(*Sent)(struct CAN_IsoTpLink *link, CAN_IsoTpResult result);
+	void 				*ctx;
+}CAN_IsoTpLink;
+
+/**
+ * Setup functions
+ */
+HAL_StatusTypeDef CAN_IsoTp_Init(CAN_IsoTpLink*, CAN_HandleTypeDef *hcan, CAN_TxQueue*, uint32_t txIde, uint32_t txId,
+								 uint8_t *rxBuffer, uint32_t rxCapacity, uint8_t blockSize, uint8_t stMin);
+
+/**
+ * Transfer functions
+ */
+HAL_StatusTypeDef CAN_IsoTp_Send(CAN_IsoTpLink*, const uint8_t *data, uint32_t length);
+void CAN_IsoTp_Poll(CAN_IsoTpLink*);
+void CAN_IsoTp_HandleFrame(const CAN_RxFrame *frame, void *ctx);
+
+#endif /* INC_CAN_ISOTP_H_ */
@@ -0,0 +1,90 @@
+/**
+  * @file can_signal.h
+  * @brief Packing of CAN frames from constant signal tables (DBC-like)
+  * @author AGH EKO-ENERGIA
+  *
+  * Every signal is described once with CAN_SIGNAL_INTEL or CAN_SIGNAL_MOTOROLA and bound to a variable.
+  * Byte layout is computed by the preprocessor, so packing costs a few shifts per touched byte
+  * instead of a loop over bits, and no GetData has to pack bytes by hand
+  */
+
+#ifndef INC_CAN_SIGNAL_H_
+#define INC_CAN_SIGNAL_H_
+
+#include "main.h"
+
+/**
+ * Type of the variable bound to a signal
+ */
+typedef enum {
+	CAN_SIGNAL_U8 = 0,
+	CAN_SIGNAL_I8,
+	CAN_SIGNAL_U16,
+	CAN_SIGNAL_I16,
+	CAN_SIGNAL_U32,
+	CAN_SIGNAL_I32,
+	CAN_SIGNAL_FLOAT
+}CAN_SignalSource;
+
+/**
+ * One signal of a frame, create it with CAN_SIGNAL_INTEL or CAN_SIGNAL_MOTOROLA
+ */
+typedef struct {
+	void 				*source;						// bound variable, its type is sourceType
+	float 				scale;							// physical = raw * scale + offset
+	float 				invScale;						// raw = (physical - offset) * invScale
+	float 				offset;
+	uint8_t 			sourceType;						// CAN_SignalSource
+	uint8_t 			length;							// raw bits, 1..32
+	uint8_t 			isSigned;						// raw value is two's complement
+	uint8_t 			scaled;							// 0 - integer variables are copied without float math
+	uint8_t 			lsbByte;						// byte holding the least significant bit
+	uint8_t 			shift;							// position of the least significant bit in lsbByte
+	int8_t 				step;							// next more significant byte: +1 Intel, -1 Motorola
+	uint8_t 			bytes;							// bytes touched by the signal
+}CAN_Signal;
+
+/**
+ * Signals of one frame
+ */
+typedef struct {
+	const CAN_Signal 	*signals;
+	uint8_t 			count;
+}CAN_SignalTable;
+
+/**
+ * Signal with its least significant bit at __LSB__ (bit 0 is bit 0 of data[0])
+ */
+#define CAN_SIGNAL_LAYOUT(__LSB__, __LENGTH__, __STEP__, __SIGNED__, __SCALE__, __OFFSET__, __TYPE__, __SOURCE__) \
+	{ .source = (void*)(__SOURCE__), .scale = (__SCALE__), .invScale = 1.0f / (__SCALE__), .offset = (__OFFSET__), \
+	  .sourceType = (__TYPE__), .length = (__LENGTH__), .isSigned = (__SIGNED__), \
+	  .scaled = ((__SCALE__) != 1.0f || (__OFFSET__) != 0.0f), \
+	  .lsbByte = (__LSB__) / 8, .shift = (__LSB__) % 8, .step = (__STEP__), .bytes = ((__LSB__) % 8 + (__LENGTH__) + 7) / 8 }
+
+/**
+ * Little endian signal, start bit is its least significant bit as in DBC @1
+ */
+#define CAN_SIGNAL_INTEL(__START__, __LENGTH__, __SIGNED__, __SCALE__, __OFFSET__, __TYPE__, __SOURCE__) \
+	CAN_SIGNAL_LAYOUT((__START__), (__LENGTH__), 1, (__SIGNED__), (__SCALE__), (__OFFSET__), (__TYPE__), (__SOURCE__))
+
+/**
+ * Big endian signal, start bit is its most significant bit as in DBC @0
+ * Bits counted from the start bit run 7..0 inside a byte and continue in the next byte
+ */
+#define CAN_SIGNAL_MSB_SEQ(__START__) 				((__START__) / 8 * 8 + 7 - (__START__) % 8)
+#define CAN_SIGNAL_LSB_SEQ(__START__, __LENGTH__) 	(CAN_SIGNAL_MSB_SEQ(__START__) + (__LENGTH__) - 1)
+#define CAN_SIGNAL_MOTOROLA(__START__, __LENGTH__, __SIGNED__, __SCALE__, __OFFSET__, __TYPE__, __SOURCE__) \
+	CAN_SIGNAL_LAYOUT(CAN_SIGNAL_LSB_SEQ((__START__), (__LENGTH__)) / 8 * 8 + 7 - CAN_SIGNAL_LSB_SEQ((__START__), (__LENGTH__)) % 8, \
+					  (__LENGTH__), -1, (__SIGNED__), (__SCALE__), (__OFFSET__), (__TYPE__), (__SOURCE__))
+
+#define CAN_SIGNAL_TABLE(__SIGNALS__) 	{ .signals = (__SIGNALS__), .count = sizeof(__SIGNALS__) / sizeof((__SIGNALS__)[0]) }
+
+/**
+ * Functions
+ */
+HAL_StatusTypeDef CAN_Signal_Check(const CAN_SignalTable*, uint8_t length);
+void CAN_Signal_Pack(const CAN_SignalTable*, uint8_t *data, uint8_t length);
+void CAN_Signal_Unpack(const CAN_SignalTable*, const uint8_t *data, uint8_t length);
+
+
+#endif /* INC_CAN_SIGNAL_H_ */
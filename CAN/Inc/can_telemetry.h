@@ -0,0 +1,82 @@
+/**
+  * @file can_telemetry.h
+  * @brief Node load and error state telemetry of CAN driver
+  * @author AGH EKO-ENERGIA
+  *
+  * Node load counts bits of frames sent by this node and frames passing its acceptance filters,
+  * frames of other nodes which are filtered out are not seen, so it is a lower bound of bus load
+  */
+
+#ifndef INC_CAN_TELEMETRY_H_
+#define INC_CAN_TELEMETRY_H_
+
+#include "can_driver.h"
+
+#ifdef CAN_BACKEND_FDCAN
+#error "can_telemetry reads bxCAN ESR and restarts with HAL_CAN_Start, it is not available on FDCAN"
+#endif
+
+/**
+ * Defines
+ */
+
+#define CAN_TELEMETRY_WINDOW_MS 	1000				// node load averaging window
+#define CAN_TELEMETRY_RECOVERY_MS 	100					// bus-off holdoff before restart, protects bus from a faulty node
+#define CAN_TELEMETRY_RECOVERY_MAX_MS 	3200			// holdoff doubles after every failed restart up to this limit
+
+/**
+ * Error state of the controller, order follows severity
+ */
+typedef enum {
+	CAN_STATE_ACTIVE = 0,
+	CAN_STATE_WARNING,									// TEC or REC reached 96
+	CAN_STATE_PASSIVE,									// TEC or REC above 127
+	CAN_STATE_BUSOFF									// TEC above 255, controller left the bus
+}CAN_ErrorState;
+
+/**
+ * Telemetry of one CAN controller
+ */
+typedef struct {
+	CAN_HandleTypeDef 	*hcan;
+	CAN_TxQueue 		*queue;
+	CAN_RxRing 			*ring;
+	uint32_t 			bitrate;						// nominal bit rate in bit/s
+
+	uint32_t 			windowStart;					// tick of the current node load window
+	uint32_t 			txBits;							// counters of queue and ring at the window start
+	uint32_t 			rxBits;
+	uint32_t 			txFrames;
+	uint32_t 			rxFrames;
+
+	uint16_t 			nodeLoad;						// permille of the last window, own and accepted frames only
+	uint32_t 			txRate;							// frames per second in the last window
+	uint32_t 			rxRate;
+
+	volatile uint8_t 	tec;							// transmit error counter
+	volatile uint8_t 	rec;							// receive error counter
+	volatile uint8_t 	lastErrorCode;					// LEC field of ESR
+	volatile CAN_ErrorState state;
+	volatile uint32_t 	busOffTick;						// tick of entering bus-off
+	volatile uint16_t 	passiveCount;					// transitions into error passive
+	volatile uint16_t 	busOffCount;					// transitions into bus-off
+	uint16_t 			recoveries;						// restarts after bus-off
+	uint16_t 			failedRecoveries;				// restarts which timed out, controller was initialized again
+	uint32_t 			recoveryHoldoff;				// ms from bus-off or failed restart to next restart
+
+	CAN_Payload 		payload;						// published telemetry, see CAN_Telemetry_Message
+}CAN_Telemetry;
+
+/**
+ * Setup functions
+ */
+void CAN_Telemetry_Init(CAN_Telemetry*, CAN_HandleTypeDef *hcan, CAN_TxQueue*, CAN_RxRing*, uint32_t bitrate);
+CAN_ScheduledMsg CAN_Telemetry_Message(CAN_Telemetry*, uint32_t ide, uint32_t id, uint32_t period_ms);
+
+/**
+ * Runtime functions
+ */
+void CAN_Telemetry_HandleError(CAN_Telemetry*);
+void CAN_Telemetry_Update(CAN_Telemetry*);
+
+#endif /* INC_CAN_TELEMETRY_H_ */
@@ -9,20 +9,93 @@
 /*
  * TODO
  *
- * Error handling both on bus and generic error messages
- * Filter configuration
- * Received messages handling
+ * Generic error messages (bus errors are handled by can_telemetry)
  *
  */
 
 #include "can_driver.h"
+#include "probe.h"
+
+#ifdef CAN_BACKEND_FDCAN
+
+#if defined(STM32H7_FAMILY)
+#define CAN_FDCAN_TX_BUFFERS 0xFFFFFFFFU					// 32 TX buffers
+#else
+#define CAN_FDCAN_TX_BUFFERS (FDCAN_TX_BUFFER0 | FDCAN_TX_BUFFER1 | FDCAN_TX_BUFFER2)
+#endif
+
+/**
+ * Data bytes of FDCAN DLC codes, codes above 8 are not linear
+ */
+static const uint8_t CAN_DlcLength[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+static const uint32_t CAN_DlcCode[16] = {
+	FDCAN_DLC_BYTES_0, FDCAN_DLC_BYTES_1, FDCAN_DLC_BYTES_2, FDCAN_DLC_BYTES_3,
+	FDCAN_DLC_BYTES_4, FDCAN_DLC_BYTES_5, FDCAN_DLC_BYTES_6, FDCAN_DLC_BYTES_7,
+	FDCAN_DLC_BYTES_8, FDCAN_DLC_BYTES_12, FDCAN_DLC_BYTES_16, FDCAN_DLC_BYTES_20,
+	FDCAN_DLC_BYTES_24, FDCAN_DLC_BYTES_32, FDCAN_DLC_BYTES_48, FDCAN_DLC_BYTES_64
+};
+
+/**
+ * @brief	Data bytes of the frame from DataLength field of FDCAN header
+ */
+uint8_t CAN_DlcToLength(uint32_t dlc)
+{
+	for(uint8_t i = 0; i < 16; i++)
+	{
+		if(CAN_DlcCode[i] == dlc)
+			return CAN_DlcLength[i];
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Smallest DataLength code holding given number of bytes, rest of the frame is padded
+ */
+uint32_t CAN_LengthToDlc(uint8_t length)
+{
+	for(uint8_t i = 0; i < 16; i++)
+	{
+		if(CAN_DlcLength[i] >= length)
+			return CAN_DlcCode[i];
+	}
+
+	return FDCAN_DLC_BYTES_64;
+}
+
+/**
+ * @brief initiate FDCAN, every frame is accepted into FIFO0
+ */
+void CAN_Init(CAN_Handle* hcan)
+{
+	if(HAL_FDCAN_ConfigGlobalFilter(hcan, FDCAN_ACCEPT_IN_RX_FIFO0, FDCAN_ACCEPT_IN_RX_FIFO0,
+									FDCAN_REJECT_REMOTE_STD, FDCAN_REJECT_REMOTE_EXT) != HAL_OK)
+	{
+		/* Filter configuration Error */
+		Error_Handler();
+	}
+
+	// TX complete of every buffer refills TX FIFO from the queue
+	if(HAL_FDCAN_ActivateNotification(hcan, FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_TX_COMPLETE, CAN_FDCAN_TX_BUFFERS) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	if(HAL_FDCAN_Start(hcan) != HAL_OK)
+	{
+		Error_Handler();
+	}
+}
+
+#else
 
 /**
  * @brief initiate CAN with basic filter configuration
  */
-void CAN_Init(CAN_HandleTypeDef* hcan)
+void CAN_Init(CAN_Handle* hcan)
 {
-	if(HAL_CAN_ActivateNotification(hcan, CAN_IT_RX_FIFO0_MSG_PENDING) != HAL_OK)
+	if(HAL_CAN_ActivateNotification(hcan, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY) != HAL_OK)
 	{
 		Error_Handler();
 	}
@@ -52,6 +125,215 @@ void CAN_Init(CAN_HandleTypeDef* hcan)
 	}
 }
 
+#endif
+
+
+/**
+ * @brief Arbitration priority of the frame, lower wins
+ * 		  Base ID is compared first, then standard frame wins over extended one (SRR/IDE recessive)
+ */
+static uint32_t CAN_PriorityKey(uint32_t ide, uint32_t id)
+{
+	if(ide == CAN_ID_STD)
+		return id << 19;
+
+	return ((id >> 18) << 19) | (1U << 18) | (id & 0x3FFFF);
+}
+
+static uint32_t CAN_ArbitrationKey(const CAN_TxHeader *header)
+{
+	return CAN_PriorityKey(__CAN_HEADER_IDE(header), __CAN_HEADER_ID(header));
+}
+
+static uint8_t CAN_FrameBefore(const CAN_TxFrame *a, const CAN_TxFrame *b)
+{
+	uint32_t keyA = CAN_ArbitrationKey(&a->header);
+	uint32_t keyB = CAN_ArbitrationKey(&b->header);
+
+	if(keyA != keyB)
+		return keyA < keyB;
+
+	return (int32_t)(a->order - b->order) < 0;
+}
+
+static void CAN_TxQueuePush(CAN_TxQueue *queue, const CAN_TxHeader *header, const uint8_t *data)
+{
+	uint8_t i = queue->size++;
+	CAN_TxFrame frame;
+
+	frame.header = *header;
+	frame.order = queue->order++;
+	uint8_t length = __CAN_HEADER_LENGTH(header);
+	for(uint8_t j = 0; j < CAN_MAX_DATA; j++)
+		frame.data[j] = (j < length) ? data[j] : 0;
+
+	// sift up
+	while(i > 0)
+	{
+		uint8_t parent = (i - 1) / 2;
+		if(!CAN_FrameBefore(&frame, &queue->frames[parent]))
+			break;
+
+		queue->frames[i] = queue->frames[parent];
+		i = parent;
+	}
+	queue->frames[i] = frame;
+
+	if(queue->size > queue->highWater)
+		queue->highWater = queue->size;
+}
+
+static void CAN_TxQueuePop(CAN_TxQueue *queue)
+{
+	uint8_t size = --queue->size;
+	CAN_TxFrame last = queue->frames[size];
+	uint8_t i = 0;
+
+	// sift down
+	while(2 * i + 1 < size)
+	{
+		uint8_t child = 2 * i + 1;
+		if(child + 1 < size && CAN_FrameBefore(&queue->frames[child + 1], &queue->frames[child]))
+			child++;
+		if(!CAN_FrameBefore(&queue->frames[child], &last))
+			break;
+
+		queue->frames[i] = queue->frames[child];
+		i = child;
+	}
+	queue->frames[i] = last;
+}
+
+/**
+ * @brief Moves queued frames to free mailboxes, highest priority first
+ * 		  Has to be called with interrupts disabled
+ */
+static void CAN_TxQueueDrain(CAN_Handle *hcan, CAN_TxQueue *queue)
+{
+	while(queue->size > 0 && __CAN_TX_FREE_LEVEL(hcan) > 0)
+	{
+		if(__CAN_TX_ADD(hcan, &queue->frames[0].header, queue->frames[0].data, queue) != HAL_OK)
+			return;
+
+		queue->txFrames++;
+		queue->txBits += CAN_FrameBits(__CAN_HEADER_IDE(&queue->frames[0].header), __CAN_HEADER_LENGTH(&queue->frames[0].header));
+
+		CAN_TxQueuePop(queue);
+	}
+}
+
+/**
+ * @brief	Queues frame for transmission, it goes straight to a mailbox when one is free
+ * 			Mailboxes are served by ID priority (TXFP = 0), enable TransmitFifoPriority
+ * 			when frames with the same ID have to leave in order
+ * @retval	HAL_ERROR when the queue is full and the frame is dropped
+ */
+HAL_StatusTypeDef CAN_Transmit(CAN_Handle *hcan, CAN_TxQueue *queue, const CAN_TxHeader *header, const uint8_t *data)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if(queue->size >= CAN_TX_QUEUE_SIZE)
+	{
+		queue->dropped++;
+		__set_PRIMASK(primask);
+		return HAL_ERROR;
+	}
+
+	// nothing is waiting, so frame goes straight from caller's buffer to a mailbox
+	if(queue->size == 0 && __CAN_TX_FREE_LEVEL(hcan) > 0
+		&& __CAN_TX_ADD(hcan, header, data, queue) == HAL_OK)
+	{
+		queue->txFrames++;
+		queue->txBits += CAN_FrameBits(__CAN_HEADER_IDE(header), __CAN_HEADER_LENGTH(header));
+		__set_PRIMASK(primask);
+		return HAL_OK;
+	}
+
+	CAN_TxQueuePush(queue, header, data);
+	CAN_TxQueueDrain(hcan, queue);
+
+	__set_PRIMASK(primask);
+	return HAL_OK;
+}
+
+/**
+ * @brief	Refills mailboxes from the TX queue
+ * 			Put this into HAL_CAN_TxMailbox0CompleteCallback, HAL_CAN_TxMailbox1CompleteCallback
+ * 			and HAL_CAN_TxMailbox2CompleteCallback, on FDCAN into HAL_FDCAN_TxBufferCompleteCallback
+ */
+void CAN_HandleTxMailboxEmpty(CAN_Handle *hcan, CAN_TxQueue *queue)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	CAN_TxQueueDrain(hcan, queue);
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Deadline of the message, wraps together with HAL tick
+ */
+static inline uint32_t CAN_Deadline(const CAN_ScheduledMsg *msg)
+{
+	return msg->last_tick + msg->period_ms;
+}
+
+/**
+ * @brief Wrap safe comparison of ticks, valid while they are less than 2^31 ms apart
+ */
+static inline uint8_t CAN_TickBefore(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+static void CAN_HeapSwap(CAN_ScheduledMsgList* buffer, uint8_t a, uint8_t b)
+{
+	CAN_ScheduledMsg tmp = buffer->list[a];
+	buffer->list[a] = buffer->list[b];
+	buffer->list[b] = tmp;
+}
+
+/**
+ * @brief Moves message towards the root while it is due earlier than its parent
+ */
+static void CAN_HeapSiftUp(CAN_ScheduledMsgList* buffer, uint8_t i)
+{
+	while(i > 0)
+	{
+		uint8_t parent = (i - 1) / 2;
+		if(!CAN_TickBefore(CAN_Deadline(&buffer->list[i]), CAN_Deadline(&buffer->list[parent])))
+			break;
+
+		CAN_HeapSwap(buffer, i, parent);
+		i = parent;
+	}
+}
+
+/**
+ * @brief Moves message towards the leaves while any child is due earlier
+ */
+static void CAN_HeapSiftDown(CAN_ScheduledMsgList* buffer, uint8_t i)
+{
+	while(1)
+	{
+		uint8_t first = i;
+		uint8_t left = 2 * i + 1;
+		uint8_t right = 2 * i + 2;
+
+		if(left < buffer->size && CAN_TickBefore(CAN_Deadline(&buffer->list[left]), CAN_Deadline(&buffer->list[first])))
+			first = left;
+		if(right < buffer->size && CAN_TickBefore(CAN_Deadline(&buffer->list[right]), CAN_Deadline(&buffer->list[first])))
+			first = right;
+
+		if(first == i)
+			break;
+
+		CAN_HeapSwap(buffer, i, first);
+		i = first;
+	}
+}
 
 /**
  * @brief Add new message to the periodic buffer
@@ -59,42 +341,50 @@ void CAN_Init(CAN_HandleTypeDef* hcan)
 HAL_StatusTypeDef CAN_AddScheduledMessage(CAN_ScheduledMsg msg, CAN_ScheduledMsgList* buffer)
 {
 	// basic error checking
-	if(buffer->size >= CAN_MAX_MSG - 1)
+	if(buffer->size >= CAN_MAX_MSG)
 		Error_Handler();
 	if(msg.period_ms == 0)
 		Error_Handler();
+	if(msg.GetData == NULL && msg.payload == NULL && msg.signals == NULL)
+		Error_Handler();
+	if(msg.payload == NULL && msg.signals != NULL && CAN_Signal_Check(msg.signals, __CAN_HEADER_LENGTH(&msg.header)) != HAL_OK)
+		return HAL_ERROR;
 
 	msg.last_tick = HAL_GetTick();
+	msg.sentGeneration = 0;		// with onChange nothing is sent before the first commit
 
 	// check if id already exists in the buffer
 	for(int i = 0; i < buffer->size; i++)
 	{
-		if((buffer->list[i].header.IDE == CAN_ID_STD && buffer->list[i].header.StdId == msg.header.StdId)
-			|| (buffer->list[i].header.IDE == CAN_ID_EXT && buffer->list[i].header.ExtId == msg.header.ExtId))
+		if(__CAN_HEADER_IDE(&buffer->list[i].header) == __CAN_HEADER_IDE(&msg.header)
+			&& __CAN_HEADER_ID(&buffer->list[i].header) == __CAN_HEADER_ID(&msg.header))
 			return HAL_ERROR;
 	}
 
 	buffer->list[buffer->size] = msg;
 	buffer->size++;
+	CAN_HeapSiftUp(buffer, buffer->size - 1);
 	return HAL_OK;
 }
 
 /*
  * @brief Remove message from the periodic buffer
+ * @param ide CAN_ID_STD or CAN_ID_EXT, standard and extended frames with equal ID are different messages
  */
-HAL_StatusTypeDef CAN_RemoveScheduledMessage(uint32_t id, CAN_ScheduledMsgList* buffer)
+HAL_StatusTypeDef CAN_RemoveScheduledMessage(uint32_t ide, uint32_t id, CAN_ScheduledMsgList* buffer)
 {
 	for(uint8_t i = 0; i < buffer->size; i++)
 	{
-		if((buffer->list[i].header.IDE == CAN_ID_STD && buffer->list[i].header.StdId == id)
-			|| (buffer->list[i].header.IDE == CAN_ID_EXT && buffer->list[i].header.ExtId == id))
+		if(__CAN_HEADER_IDE(&buffer->list[i].header) == ide && __CAN_HEADER_ID(&buffer->list[i].header) == id)
 		{
-			while(i + 1 < buffer->size)
+			// last message takes the freed place and is restored to its heap position
+			buffer->size--;
+			if(i < buffer->size)
 			{
-				buffer->list[i] = buffer->list[i+1];
-				i++;
+				buffer->list[i] = buffer->list[buffer->size];
+				CAN_HeapSiftDown(buffer, i);
+				CAN_HeapSiftUp(buffer, i);
 			}
-			buffer->size--;
 			return HAL_OK;
 		}
 	}
@@ -103,66 +393,820 @@ HAL_StatusTypeDef CAN_RemoveScheduledMessage(uint32_t id, CAN_ScheduledMsgList*
 }
 
 /**
- * @brief This function sends regular messages
+ * @brief	This function sends regular messages which are due, only those are touched
+ * 			Message stays in its time slots: last_tick advances by whole periods instead of
+ * 			being reset to current tick, slots missed by more than a period are skipped
+ * @retval	ms until the next deadline (main loop can sleep until then),
+ * 			0 when the TX queue is full and sending should be retried,
+ * 			CAN_NO_DEADLINE when no message is scheduled
  */
-void CAN_HandleScheduled(CAN_HandleTypeDef *hcan, CAN_ScheduledMsgList* buffer)
+uint32_t CAN_HandleScheduled(CAN_Handle *hcan, CAN_TxQueue* queue, CAN_ScheduledMsgList* buffer)
 {
+	PROBE_START(PROBE_CAN_HANDLE_SCHEDULED);
+
 	uint32_t currentTick = HAL_GetTick();
-	for(uint8_t i = 0; i < buffer->size;i++)
+	while(buffer->size > 0 && !CAN_TickBefore(currentTick, CAN_Deadline(&buffer->list[0])))
 	{
-		CAN_ScheduledMsg *msg = &buffer->list[i];
-		if(currentTick > msg->last_tick + msg->period_ms)
+		CAN_ScheduledMsg *msg = &buffer->list[0];
+		if(msg->payload != NULL)
 		{
-			uint8_t data[msg->header.DLC];
-			msg->GetData(data);
-			if(HAL_CAN_AddTxMessage(hcan, &msg->header, data, &buffer->txMailbox) != HAL_OK)
+			CAN_Payload *payload = msg->payload;
+			uint32_t generation = payload->generation;
+
+			// unchanged payload only keeps its time slot
+			if(!msg->onChange || generation != msg->sentGeneration)
 			{
-				return;
+				if(CAN_Transmit(hcan, queue, &msg->header, payload->buffer[payload->active]) != HAL_OK)
+				{
+					PROBE_STOP(PROBE_CAN_HANDLE_SCHEDULED);
+					return 0;
+				}
+				msg->sentGeneration = generation;
 			}
-
-			msg->last_tick = HAL_GetTick();
 		}
+		else
+		{
+			uint8_t data[CAN_MAX_DATA];
+			if(msg->signals != NULL)
+				CAN_Signal_Pack(msg->signals, data, __CAN_HEADER_LENGTH(&msg->header));
+			else
+				msg->GetData(data);
+			if(CAN_Transmit(hcan, queue, &msg->header, data) != HAL_OK)
+			{
+				PROBE_STOP(PROBE_CAN_HANDLE_SCHEDULED);
+				return 0;
+			}
+		}
+
+		uint32_t elapsed = currentTick - msg->last_tick;
+		msg->last_tick += elapsed - (elapsed % msg->period_ms);
+
+		CAN_HeapSiftDown(buffer, 0);
+	}
+
+	uint32_t next = CAN_NO_DEADLINE;
+	if(buffer->size > 0)
+		next = CAN_Deadline(&buffer->list[0]) - currentTick;
+
+	PROBE_STOP(PROBE_CAN_HANDLE_SCHEDULED);
+	return next;
+}
+
+/**
+ * @brief	Buffer which can be filled by producer, driver is not reading it
+ */
+uint8_t* CAN_PayloadBeginWrite(CAN_Payload *payload)
+{
+	return payload->buffer[payload->active ^ 1];
+}
+
+/**
+ * @brief	Publishes buffer filled after CAN_PayloadBeginWrite, it is sent in the next slot of message
+ */
+void CAN_PayloadCommit(CAN_Payload *payload)
+{
+	__DMB(); // payload is written before it is published
+	payload->active ^= 1;
+	payload->generation++;
+}
+
+/**
+ * @brief	Counts received frame and copies it into the ring unless publish is 0, called with interrupts masked
+ * 			RX interrupts of FIFO0 and FIFO1 may preempt each other, so a slot is claimed and published at once
+ */
+static void CAN_RxRingPush(CAN_RxRing *ring, const CAN_RxFrame *frame, uint32_t bits, uint8_t publish)
+{
+	uint16_t head = ring->head;
+	uint16_t waiting = (uint16_t)(head - ring->tail);
+
+	ring->rxFrames++;
+	ring->rxBits += bits;
+
+	if(!publish)
+		return;
+
+	if(waiting >= CAN_RX_RING_SIZE)
+	{
+		ring->dropped++;
+		return;
 	}
+
+	ring->frames[head & (CAN_RX_RING_SIZE - 1)] = *frame;
+	__DMB(); // frame is written before it is published
+	ring->head = head + 1;
+
+	if(waiting + 1 > ring->highWater)
+		ring->highWater = waiting + 1;
 }
 
 /**
- * @brief	Basic functionality only handles safe state and error MSG
- * 			Put this into HAL_CAN_RxFifo0MsgPendingCallback
+ * @brief	Empties the hardware FIFO: handlers of immediate routes are called right here,
+ * 			other frames are only copied into the ring
+ * 			Put this into HAL_CAN_RxFifo0MsgPendingCallback and HAL_CAN_RxFifo1MsgPendingCallback,
+ * 			on FDCAN into HAL_FDCAN_RxFifo0Callback and HAL_FDCAN_RxFifo1Callback
+ * 			Both FIFOs may share one ring, their interrupts may have different priorities
  * @param	hcan pointer to a CAN_HandleTypeDef structure that contains
  *         	the configuration information for the specified CAN.
+ * @param	ring ring drained by CAN_DispatchReceived
+ * @param	table handlers of received IDs, NULL when no immediate handler is registered
  * @param	fifo Fifo number of the received message to be read.
  * 			This parameter can be the value of @arg CAN_receive_FIFO_number
  */
-void CAN_HandleReceived(CAN_HandleTypeDef *hcan, uint8_t fifo)
+void CAN_HandleReceived(CAN_Handle *hcan, CAN_RxRing *ring, const CAN_RxRouteTable *table, uint32_t fifo)
+{
+	PROBE_START(PROBE_CAN_HANDLE_RECEIVED);
+	PROBE_START(PROBE_CAN_IMMEDIATE);
+
+	uint32_t overrunFlag = __CAN_RX_LOST_FLAG(fifo);
+	if(__CAN_GET_FLAG(hcan, overrunFlag))
+	{
+		__CAN_CLEAR_FLAG(hcan, overrunFlag);
+
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		ring->overruns++;
+		__set_PRIMASK(primask);
+	}
+
+	while(__CAN_RX_FILL_LEVEL(hcan, fifo) > 0)
+	{
+		// frame is read aside, the ring is touched only to publish it, so immediate handlers are never
+		// starved by a full ring and never see their frame overwritten by the other FIFO's interrupt
+		CAN_RxFrame frame;
+		uint8_t immediate = 0;
+
+		if(__CAN_RX_GET(hcan, fifo, &frame.header, frame.data) != HAL_OK)
+			break;
+		frame.tick = HAL_GetTick();
+		uint32_t bits = CAN_FrameBits(__CAN_HEADER_IDE(&frame.header), __CAN_HEADER_LENGTH(&frame.header));
+
+		if(table != NULL)
+		{
+			const CAN_RxRoute *route = CAN_FindRoute(table, __CAN_HEADER_IDE(&frame.header), __CAN_HEADER_ID(&frame.header));
+
+			if(route != NULL && route->immediate)
+			{
+				route->handler(&frame, route->ctx);
+				PROBE_STOP(PROBE_CAN_IMMEDIATE);	// interrupt entry to end of handler
+				immediate = 1;
+			}
+		}
+
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		CAN_RxRingPush(ring, &frame, bits, !immediate);
+		__set_PRIMASK(primask);
+	}
+
+	PROBE_STOP(PROBE_CAN_HANDLE_RECEIVED);
+}
+
+/**
+ * @brief	Sort key of route, extended IDs are placed after all standard ones
+ */
+static inline uint32_t CAN_RouteKey(uint32_t ide, uint32_t id)
+{
+	return (ide == CAN_ID_EXT) ? (0x80000000U | id) : id;
+}
+
+/**
+ * @brief	Binary search of route
+ * @retval	index of route with key, or index where it should be inserted
+ */
+static uint16_t CAN_RouteSearch(const CAN_RxRouteTable *table, uint32_t key)
+{
+	uint16_t low = 0;
+	uint16_t high = table->size;
+
+	while(low < high)
+	{
+		uint16_t mid = low + (high - low) / 2;
+		if(table->routes[mid].key < key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static HAL_StatusTypeDef CAN_AddRoute(CAN_RxRouteTable *table, uint32_t ide, uint32_t id, CAN_RxHandler handler, void *ctx,
+									 uint8_t immediate)
+{
+	uint32_t key = CAN_RouteKey(ide, id);
+	uint16_t i = CAN_RouteSearch(table, key);
+
+	if(handler == NULL || table->size >= CAN_MAX_ROUTES)
+		return HAL_ERROR;
+	if(i < table->size && table->routes[i].key == key)
+		return HAL_ERROR;
+
+	for(uint16_t j = table->size; j > i; j--)
+		table->routes[j] = table->routes[j-1];
+
+	table->routes[i].key = key;
+	table->routes[i].handler = handler;
+	table->routes[i].ctx = ctx;
+	table->routes[i].immediate = immediate;
+	table->size++;
+	return HAL_OK;
+}
+
+/**
+ * @brief	Registers handler of received ID, meant to be called during initialization
+ * 			Handler is called from the main loop by CAN_DispatchReceived
+ * @retval	HAL_ERROR when ID is already registered or table is full
+ */
+HAL_StatusTypeDef CAN_RegisterHandler(CAN_RxRouteTable *table, uint32_t ide, uint32_t id, CAN_RxHandler handler, void *ctx)
+{
+	return CAN_AddRoute(table, ide, id, handler, ctx, 0);
+}
+
+/**
+ * @brief	Registers handler of high priority ID (e.g. SAFE_STATE_ID, ERROR_MSG_ID) called directly in RX interrupt
+ * 			CAN_ConfigFilters puts these IDs into FIFO1, so they do not wait behind bulk traffic of FIFO0
+ * 			Handler has to be short and interrupt safe
+ * @retval	HAL_ERROR when ID is already registered or table is full
+ */
+HAL_StatusTypeDef CAN_RegisterImmediateHandler(CAN_RxRouteTable *table, uint32_t ide, uint32_t id, CAN_RxHandler handler, void *ctx)
+{
+	return CAN_AddRoute(table, ide, id, handler, ctx, 1);
+}
+
+/**
+ * @brief	Removes handler of received ID
+ */
+HAL_StatusTypeDef CAN_UnregisterHandler(CAN_RxRouteTable *table, uint32_t ide, uint32_t id)
+{
+	uint32_t key = CAN_RouteKey(ide, id);
+	uint16_t i = CAN_RouteSearch(table, key);
+
+	if(i >= table->size || table->routes[i].key != key)
+		return HAL_ERROR;
+
+	table->size--;
+	for(; i < table->size; i++)
+		table->routes[i] = table->routes[i+1];
+
+	return HAL_OK;
+}
+
+/**
+ * @brief	Sets handler of IDs without route, NULL only counts them
+ */
+void CAN_SetFallbackHandler(CAN_RxRouteTable *table, CAN_RxHandler handler, void *ctx)
+{
+	table->fallback = handler;
+	table->fallbackCtx = ctx;
+}
+
+/**
+ * @brief	Finds route of received ID
+ * @retval	route or NULL when ID is not registered
+ */
+const CAN_RxRoute* CAN_FindRoute(const CAN_RxRouteTable *table, uint32_t ide, uint32_t id)
+{
+	uint32_t key = CAN_RouteKey(ide, id);
+	uint16_t i = CAN_RouteSearch(table, key);
+
+	if(i < table->size && table->routes[i].key == key)
+		return &table->routes[i];
+
+	return NULL;
+}
+
+/**
+ * @brief	IDE and ID of route key
+ */
+static inline uint32_t CAN_RouteIde(uint32_t key)
+{
+	return (key & 0x80000000U) ? CAN_ID_EXT : CAN_ID_STD;
+}
+
+static inline uint32_t CAN_RouteId(uint32_t key)
+{
+	return key & 0x1FFFFFFFU;
+}
+
+/**
+ * @brief	Tells whether ID of route is received through FIFO1: immediate routes and
+ * 			the urgentCount IDs of the highest arbitration priority
+ */
+static uint8_t CAN_RouteIsUrgent(const CAN_RxRouteTable *table, uint16_t i, uint16_t urgentCount)
+{
+	uint32_t priority = CAN_PriorityKey(CAN_RouteIde(table->routes[i].key), CAN_RouteId(table->routes[i].key));
+	uint16_t rank = 0;
+
+	if(table->routes[i].immediate)
+		return 1;
+
+	// position of the ID in arbitration order
+	for(uint16_t j = 0; j < table->size && rank < urgentCount; j++)
+	{
+		if(CAN_PriorityKey(CAN_RouteIde(table->routes[j].key), CAN_RouteId(table->routes[j].key)) < priority)
+			rank++;
+	}
+
+	return rank < urgentCount;
+}
+
+#ifdef CAN_BACKEND_FDCAN
+
+/**
+ * @brief	Disables filter elements [index, end) of one ID kind
+ */
+static HAL_StatusTypeDef CAN_FilterDisable(CAN_Handle *hcan, uint32_t ide, uint32_t index, uint32_t end)
+{
+	for(; index < end; index++)
+	{
+		FDCAN_FilterTypeDef sFilterConfig = {0};
+
+		sFilterConfig.IdType = ide;
+		sFilterConfig.FilterIndex = index;
+		sFilterConfig.FilterType = FDCAN_FILTER_DUAL;
+		sFilterConfig.FilterConfig = FDCAN_FILTER_DISABLE;
+
+		if(HAL_FDCAN_ConfigFilter(hcan, &sFilterConfig) != HAL_OK)
+			return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * @brief	Writes dual ID elements routing urgent IDs of one kind to FIFO1, last element repeats its ID,
+ * 			elements left up to end are disabled
+ */
+static HAL_StatusTypeDef CAN_FilterUrgent(CAN_Handle *hcan, const CAN_RxRouteTable *table, uint16_t urgentCount,
+										  uint32_t ide, uint32_t index, uint32_t end)
+{
+	FDCAN_FilterTypeDef sFilterConfig;
+	uint8_t used = 0;
+
+	sFilterConfig.IdType = ide;
+	sFilterConfig.FilterType = FDCAN_FILTER_DUAL;
+	sFilterConfig.FilterConfig = FDCAN_FILTER_TO_RXFIFO1;
+
+	for(uint16_t i = 0; i <= table->size; i++)
+	{
+		uint8_t last = (i == table->size);
+
+		if(!last)
+		{
+			if(CAN_RouteIde(table->routes[i].key) != ide || !CAN_RouteIsUrgent(table, i, urgentCount))
+				continue;
+
+			sFilterConfig.FilterID2 = CAN_RouteId(table->routes[i].key);
+			if(used++ == 0)
+				sFilterConfig.FilterID1 = sFilterConfig.FilterID2;
+		}
+
+		if(used == 0 || (!last && used < 2))
+			continue;
+
+		if(index >= end)
+			return HAL_ERROR;
+
+		sFilterConfig.FilterIndex = index++;
+		if(HAL_FDCAN_ConfigFilter(hcan, &sFilterConfig) != HAL_OK)
+			return HAL_ERROR;
+
+		used = 0;
+	}
+
+	return CAN_FilterDisable(hcan, ide, index, end);
+}
+
+/**
+ * @brief	Routes immediate and most urgent IDs into FIFO1, so they do not wait behind bulk traffic of FIFO0
+ * 			Other frames keep going into FIFO0 by the global filter of CAN_Init, which cannot be changed
+ * 			after start; two IDs share one dual ID element
+ * 			Call it again after registering new IDs
+ * @param	table registered IDs
+ * @param	firstBank first filter element of standard and extended lists owned by this function
+ * @param	bankCount elements of each list owned, limited by Init.StdFiltersNbr and Init.ExtFiltersNbr
+ * @param	urgentCount number of the most urgent IDs (highest arbitration priority) received through FIFO1
+ * 			together with immediate routes, 0 leaves only immediate routes in FIFO1
+ * @retval	HAL_ERROR when IDs cannot fit in given elements, all of them are then disabled and
+ * 			every frame is received through FIFO0 (immediate handlers are still called from its interrupt)
+ */
+HAL_StatusTypeDef CAN_ConfigFilters(CAN_Handle *hcan, const CAN_RxRouteTable *table, uint8_t firstBank, uint8_t bankCount,
+									uint16_t urgentCount)
 {
+	uint32_t stdEnd = firstBank + bankCount;
+	uint32_t extEnd = firstBank + bankCount;
+	uint16_t urgentIds = 0;
 
-	/* NOTE : This function should not be modified, when it is needed,
-			the CAN_HandleReceived could be implemented in the
-			user file
-	*/
-	CAN_RxHeaderTypeDef rxHeader;
-	uint8_t rxData[CAN_MAX_DLC];
+	if(stdEnd > hcan->Init.StdFiltersNbr)
+		stdEnd = hcan->Init.StdFiltersNbr;
+	if(extEnd > hcan->Init.ExtFiltersNbr)
+		extEnd = hcan->Init.ExtFiltersNbr;
 
-	HAL_CAN_GetRxMessage(hcan, fifo, &rxHeader, rxData);
+	for(uint16_t i = 0; i < table->size; i++)
+		urgentIds += CAN_RouteIsUrgent(table, i, urgentCount);
 
-	// highest to lowest priority (lowest to highest ID)
-	switch (rxHeader.ExtId)
+	// FIFO1 is drained by CAN_HandleReceived put into HAL_FDCAN_RxFifo1Callback
+	if(urgentIds > 0 && HAL_FDCAN_ActivateNotification(hcan, FDCAN_IT_RX_FIFO1_NEW_MESSAGE, 0) != HAL_OK)
+		return HAL_ERROR;
+
+	if(CAN_FilterUrgent(hcan, table, urgentCount, CAN_ID_STD, firstBank, stdEnd) != HAL_OK
+		|| CAN_FilterUrgent(hcan, table, urgentCount, CAN_ID_EXT, firstBank, extEnd) != HAL_OK)
 	{
-	case SAFE_STATE_ID:
-		// tutaj raczej od razu w interrupcie funkcja
-		printf("Safe STATE!\n");
-	break;
-	case ERROR_MSG_ID:
-		// a tutaj raczej flaga i ogarniamy to w while'u
-		printf("Error!\n");
-	break;
-	case 403105268:
+		CAN_FilterDisable(hcan, CAN_ID_STD, firstBank, stdEnd);
+		CAN_FilterDisable(hcan, CAN_ID_EXT, firstBank, extEnd);
+		HAL_FDCAN_DeactivateNotification(hcan, FDCAN_IT_RX_FIFO1_NEW_MESSAGE);
+		return HAL_ERROR;
+	}
+
+	// no filter routes to FIFO1 any more
+	if(urgentIds == 0 && HAL_FDCAN_DeactivateNotification(hcan, FDCAN_IT_RX_FIFO1_NEW_MESSAGE) != HAL_OK)
+		return HAL_ERROR;
+
+	return HAL_OK;
+}
+
+#else
+
+/**
+ * Acceptance filter entry in 32-bit register layout: STID[31:21] EXID[20:3] IDE[2] RTR[1]
+ */
+typedef struct {
+	uint32_t word;
+	uint32_t mask;
+}CAN_FilterEntry;
+
+#define CAN_FILTER_STD_MASK 	0xFFE00004U			// STID and IDE, RTR is not filtered
+#define CAN_FILTER_EXT_MASK 	0xFFFFFFFCU			// STID, EXID and IDE
+#define CAN_FILTER_IS_EXT(e) 	(((e)->word & CAN_ID_EXT) != 0)
+
+/**
+ * Scratch of filter generation, used only during CAN_ConfigFilters
+ */
+static CAN_FilterEntry CAN_FilterScratch[CAN_MAX_ROUTES];
+
+static uint8_t CAN_FilterIsExact(const CAN_FilterEntry *entry)
+{
+	return entry->mask == (CAN_FILTER_IS_EXT(entry) ? CAN_FILTER_EXT_MASK : CAN_FILTER_STD_MASK);
+}
+
+/**
+ * @brief	Banks needed by entries | standard IDs use 16-bit scale (4 in list, 2 in mask mode),
+ * 			extended IDs 32-bit scale (2 in list, 1 in mask mode)
+ */
+static uint16_t CAN_FilterKindBanks(const CAN_FilterEntry *entries, uint16_t n, uint8_t ext)
+{
+	uint16_t exact = 0, mask = 0;
 
-	break;
-	default:
-		printf("Unknown frame ID\n");
-	break;
+	for(uint16_t i = 0; i < n; i++)
+	{
+		if(CAN_FILTER_IS_EXT(&entries[i]) != ext)
+			continue;
+
+		if(CAN_FilterIsExact(&entries[i]))
+			exact++;
+		else
+			mask++;
+	}
+
+	return ext ? (exact + 1) / 2 + mask : (exact + 3) / 4 + (mask + 1) / 2;
+}
+
+static uint16_t CAN_FilterBanks(const CAN_FilterEntry *entries, uint16_t n)
+{
+	return CAN_FilterKindBanks(entries, n, 0) + CAN_FilterKindBanks(entries, n, 1);
+}
+
+/**
+ * @brief	Merges neighbouring entries until they fit in banks, every merge picks the pair which
+ * 			lets through the fewest extra IDs (least don't care bits)
+ * @retval	number of entries left, 0 when they cannot fit
+ */
+static uint16_t CAN_FilterFit(CAN_FilterEntry *entries, uint16_t n, uint16_t banks)
+{
+	while(CAN_FilterBanks(entries, n) > banks)
+	{
+		uint16_t best = n;
+		uint8_t bestCost = 0xFF;
+		uint8_t reducible[2] = {CAN_FilterKindBanks(entries, n, 0) > 1, CAN_FilterKindBanks(entries, n, 1) > 1};
+
+		for(uint16_t i = 0; i + 1 < n; i++)
+		{
+			// kind already in a single bank gains nothing from wider masks
+			if(CAN_FILTER_IS_EXT(&entries[i]) != CAN_FILTER_IS_EXT(&entries[i+1]) || !reducible[CAN_FILTER_IS_EXT(&entries[i])])
+				continue;
+
+			uint32_t mask = entries[i].mask & entries[i+1].mask & ~(entries[i].word ^ entries[i+1].word);
+			uint32_t dontCare = ~mask & (CAN_FILTER_IS_EXT(&entries[i]) ? 0xFFFFFFF8U : 0xFFE00000U);
+			uint8_t cost = 0;
+
+			for(; dontCare != 0; dontCare &= dontCare - 1)
+				cost++;
+
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				best = i;
+			}
+		}
+
+		if(best == n)
+			return 0;
+
+		entries[best].mask &= entries[best+1].mask & ~(entries[best].word ^ entries[best+1].word);
+		entries[best].word &= entries[best].mask;
+
+		n--;
+		for(uint16_t i = best + 1; i < n; i++)
+			entries[i] = entries[i+1];
 	}
+
+	return n;
 }
 
+/**
+ * @brief	Writes entries of one kind into consecutive banks, last bank is padded with repeated entry
+ */
+static HAL_StatusTypeDef CAN_FilterEmit(CAN_Handle *hcan, const CAN_FilterEntry *entries, uint16_t n,
+										uint8_t ext, uint8_t exact, uint32_t fifo, uint8_t *bank)
+{
+	uint8_t capacity = ext ? 2 : 4;						// 32-bit words or 16-bit slots of bank
+	uint8_t step = exact ? 1 : 2;						// words or slots taken by one entry
+	uint16_t slot[4];
+	uint32_t word[2];
+	uint8_t used = 0;
+
+	for(uint16_t i = 0; i <= n; i++)
+	{
+		uint8_t last = (i == n);
+
+		if(!last && (CAN_FILTER_IS_EXT(&entries[i]) != ext || CAN_FilterIsExact(&entries[i]) != exact))
+			continue;
+
+		if(!last)
+		{
+			if(ext)
+			{
+				// list: two IDs, mask: ID and mask
+				word[used++] = entries[i].word;
+				if(!exact)
+					word[used++] = entries[i].mask;
+			}
+			else
+			{
+				// 16-bit layout: STID[15:5] RTR[4] IDE[3] EXID[2:0]
+				slot[used++] = (uint16_t)((entries[i].word >> 16) & 0xFFE0);
+				if(!exact)
+					slot[used++] = (uint16_t)(((entries[i].mask >> 16) & 0xFFE0) | 0x0008);
+			}
+		}
+
+		if(used == 0 || (!last && used < capacity))
+			continue;
+
+		// padding of the last bank
+		for(uint8_t j = used; j < capacity; j++)
+		{
+			if(ext)
+				word[j] = word[j - step];
+			else
+				slot[j] = slot[j - step];
+		}
+
+		CAN_FilterTypeDef sFilterConfig;
+
+		sFilterConfig.FilterBank = *bank;
+		sFilterConfig.FilterMode = exact ? CAN_FILTERMODE_IDLIST : CAN_FILTERMODE_IDMASK;
+		sFilterConfig.FilterScale = ext ? CAN_FILTERSCALE_32BIT : CAN_FILTERSCALE_16BIT;
+		if(ext)
+		{
+			sFilterConfig.FilterIdHigh = word[0] >> 16;
+			sFilterConfig.FilterIdLow = word[0] & 0xFFFF;
+			sFilterConfig.FilterMaskIdHigh = word[1] >> 16;
+			sFilterConfig.FilterMaskIdLow = word[1] & 0xFFFF;
+		}
+		else
+		{
+			// FR1 = MaskIdLow:IdLow, FR2 = MaskIdHigh:IdHigh, in mask mode each register is ID and its mask
+			sFilterConfig.FilterIdLow = slot[0];
+			sFilterConfig.FilterMaskIdLow = slot[1];
+			sFilterConfig.FilterIdHigh = slot[2];
+			sFilterConfig.FilterMaskIdHigh = slot[3];
+		}
+		sFilterConfig.FilterFIFOAssignment = fifo;
+		sFilterConfig.FilterActivation = ENABLE;
+		sFilterConfig.SlaveStartFilterBank = 14;
+
+		if(HAL_CAN_ConfigFilter(hcan, &sFilterConfig) != HAL_OK)
+			return HAL_ERROR;
+
+		(*bank)++;
+		used = 0;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * @brief	Collects exact filter entries of IDs received through one FIFO
+ * @param	urgent 1 - immediate routes and the urgentCount most urgent IDs (FIFO1), 0 - the others (FIFO0)
+ * @retval	number of entries in CAN_FilterScratch
+ */
+static uint16_t CAN_FilterCollect(const CAN_RxRouteTable *table, uint8_t urgent, uint16_t urgentCount)
+{
+	uint16_t n = 0;
+
+	for(uint16_t i = 0; i < table->size; i++)
+	{
+		uint32_t ide = CAN_RouteIde(table->routes[i].key);
+		uint32_t id = CAN_RouteId(table->routes[i].key);
+
+		if(CAN_RouteIsUrgent(table, i, urgentCount) != urgent)
+			continue;
+
+		CAN_FilterScratch[n].word = (ide == CAN_ID_EXT) ? ((id << 3) | CAN_ID_EXT) : (id << 21);
+		CAN_FilterScratch[n].mask = (ide == CAN_ID_EXT) ? CAN_FILTER_EXT_MASK : CAN_FILTER_STD_MASK;
+		n++;
+	}
+
+	return n;
+}
+
+/**
+ * @brief	Fewest banks entries can be merged into, one per kind of ID (standard, extended)
+ */
+static uint8_t CAN_FilterMinBanks(const CAN_FilterEntry *entries, uint16_t n)
+{
+	uint8_t std = 0, ext = 0;
+
+	for(uint16_t i = 0; i < n; i++)
+	{
+		if(CAN_FILTER_IS_EXT(&entries[i]))
+			ext = 1;
+		else
+			std = 1;
+	}
+
+	return std + ext;
+}
+
+/**
+ * @brief	Generates acceptance filters for one FIFO
+ */
+static HAL_StatusTypeDef CAN_FilterFifo(CAN_Handle *hcan, const CAN_RxRouteTable *table, uint8_t urgent,
+										uint16_t urgentCount, uint8_t banks, uint8_t *bank)
+{
+	uint16_t n = CAN_FilterCollect(table, urgent, urgentCount);
+
+	if(n == 0)
+		return HAL_OK;
+
+	n = CAN_FilterFit(CAN_FilterScratch, n, banks);
+	if(n == 0)
+		return HAL_ERROR;
+
+	for(uint8_t kind = 0; kind < 4; kind++)
+	{
+		if(CAN_FilterEmit(hcan, CAN_FilterScratch, n, kind >> 1, !(kind & 1), urgent ? CAN_FILTER_FIFO1 : CAN_FILTER_FIFO0, bank) != HAL_OK)
+			return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * @brief	Disables banks [bank, end), nothing is accepted through them
+ */
+static HAL_StatusTypeDef CAN_FilterDisable(CAN_Handle *hcan, uint8_t bank, uint8_t end)
+{
+	for(; bank < end; bank++)
+	{
+		CAN_FilterTypeDef sFilterConfig = {0};
+
+		sFilterConfig.FilterBank = bank;
+		sFilterConfig.FilterActivation = DISABLE;
+		sFilterConfig.SlaveStartFilterBank = 14;
+
+		if(HAL_CAN_ConfigFilter(hcan, &sFilterConfig) != HAL_OK)
+			return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * @brief	Replaces accept-all filter of CAN_Init with filters passing only IDs registered in table
+ * 			IDs are put in list mode while they fit, otherwise the closest ones are merged into masks
+ * 			(a mask may then let through some IDs of the other FIFO, their handlers are still found by table)
+ * 			Call it again after registering new IDs
+ * @param	table registered IDs
+ * @param	firstBank first bank owned by this CAN (0 for CAN1, SlaveStartFilterBank for CAN2)
+ * @param	bankCount banks owned by this CAN
+ * @param	urgentCount number of the most urgent IDs (highest arbitration priority) received through FIFO1
+ * 			together with immediate routes, 0 leaves only immediate routes in FIFO1
+ * @retval	HAL_ERROR when IDs cannot fit in given banks, all banks of this CAN are then disabled,
+ * 			so the accept-all filter is not left behind and no frame is received until filters are configured
+ */
+HAL_StatusTypeDef CAN_ConfigFilters(CAN_Handle *hcan, const CAN_RxRouteTable *table, uint8_t firstBank, uint8_t bankCount,
+									uint16_t urgentCount)
+{
+	uint8_t bank = firstBank;
+	uint16_t n;
+
+	if(urgentCount > table->size)
+		urgentCount = table->size;
+
+	n = CAN_FilterCollect(table, 1, urgentCount);
+	uint16_t urgentIds = n;
+	uint16_t urgentNeed = CAN_FilterBanks(CAN_FilterScratch, n);
+	uint8_t urgentMin = CAN_FilterMinBanks(CAN_FilterScratch, n);
+
+	n = CAN_FilterCollect(table, 0, urgentCount);
+	uint16_t normalNeed = CAN_FilterBanks(CAN_FilterScratch, n);
+	uint8_t normalMin = CAN_FilterMinBanks(CAN_FilterScratch, n);
+
+	if(urgentMin + normalMin > bankCount)
+	{
+		CAN_FilterDisable(hcan, firstBank, firstBank + bankCount);
+		HAL_CAN_DeactivateNotification(hcan, CAN_IT_RX_FIFO1_MSG_PENDING);
+		return HAL_ERROR;
+	}
+
+	// exact filters when they fit, otherwise banks are shared in proportion to what each FIFO needs
+	uint16_t urgentBanks = urgentNeed;
+	if(urgentNeed + normalNeed > bankCount)
+	{
+		urgentBanks = (uint32_t)bankCount * urgentNeed / (urgentNeed + normalNeed);
+		if(urgentBanks < urgentMin)
+			urgentBanks = urgentMin;
+		if(urgentBanks > bankCount - normalMin)
+			urgentBanks = bankCount - normalMin;
+	}
+
+	// FIFO1 is drained by CAN_HandleReceived put into HAL_CAN_RxFifo1MsgPendingCallback
+	if(urgentIds > 0 && HAL_CAN_ActivateNotification(hcan, CAN_IT_RX_FIFO1_MSG_PENDING) != HAL_OK)
+		return HAL_ERROR;
+
+	if(CAN_FilterFifo(hcan, table, 1, urgentCount, urgentBanks, &bank) != HAL_OK
+		|| CAN_FilterFifo(hcan, table, 0, urgentCount, firstBank + bankCount - bank, &bank) != HAL_OK)
+	{
+		CAN_FilterDisable(hcan, firstBank, firstBank + bankCount);
+		HAL_CAN_DeactivateNotification(hcan, CAN_IT_RX_FIFO1_MSG_PENDING);
+		return HAL_ERROR;
+	}
+
+	// no filter routes to FIFO1 any more
+	if(urgentIds == 0 && HAL_CAN_DeactivateNotification(hcan, CAN_IT_RX_FIFO1_MSG_PENDING) != HAL_OK)
+		return HAL_ERROR;
+
+	// banks left from previous configuration
+	return CAN_FilterDisable(hcan, bank, firstBank + bankCount);
+}
+
+#endif
+
+/**
+ * @brief	Unpacks received frame into variables bound to its signals
+ * 			Register it with CAN_RegisterHandler, ctx is the const CAN_SignalTable of the frame
+ */
+void CAN_HandleSignals(const CAN_RxFrame *frame, void *ctx)
+{
+	CAN_Signal_Unpack((const CAN_SignalTable*)ctx, frame->data, __CAN_HEADER_LENGTH(&frame->header));
+}
+
+/**
+ * @brief	Handles frames received by CAN_HandleReceived, call it from the main loop
+ * @param	ring ring filled in interrupt
+ * @param	table handlers of received IDs
+ * @param	batch maximum number of frames handled in this call, keeps main loop responsive
+ * @retval	number of handled frames
+ */
+uint16_t CAN_DispatchReceived(CAN_RxRing *ring, CAN_RxRouteTable *table, uint16_t batch)
+{
+	uint16_t tail = ring->tail;
+	uint16_t handled = 0;
+
+	while(handled < batch && tail != ring->head)
+	{
+		__DMB(); // head is read before the frame it publishes
+		const CAN_RxFrame *frame = &ring->frames[tail & (CAN_RX_RING_SIZE - 1)];
+		const CAN_RxRoute *route = CAN_FindRoute(table, __CAN_HEADER_IDE(&frame->header), __CAN_HEADER_ID(&frame->header));
+
+		if(route != NULL)
+		{
+			route->handler(frame, route->ctx);
+		}
+		else
+		{
+			table->unhandled++;
+			if(table->fallback != NULL)
+				table->fallback(frame, table->fallbackCtx);
+		}
+
+		tail++;
+		handled++;
+		ring->tail = tail; // slot is given back only after it was handled
+	}
+
+	return handled;
+}
 
@@ -0,0 +1,369 @@
+/**
+  * @file can_isotp.c
+  * @brief Segmented transfers over CAN (ISO 15765-2 style) for payloads longer than one frame
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "can_driver.h"
+
+#ifndef CAN_BACKEND_FDCAN								// IDE projects compile every source, only users of the header are stopped
+
+#include "can_isotp.h"
+#include <string.h>
+
+/**
+ * Protocol control information, high nibble of the first byte
+ */
+#define CAN_ISOTP_PCI_SF 	0x0
+#define CAN_ISOTP_PCI_FF 	0x1
+#define CAN_ISOTP_PCI_CF 	0x2
+#define CAN_ISOTP_PCI_FC 	0x3
+
+#define CAN_ISOTP_FC_CTS 	0x0
+#define CAN_ISOTP_FC_WAIT 	0x1
+#define CAN_ISOTP_FC_OVFLW 	0x2
+
+static HAL_StatusTypeDef CAN_IsoTp_Transmit(CAN_IsoTpLink *link, const uint8_t *frame)
+{
+	return CAN_Transmit(link->hcan, link->queue, &link->txHeader, frame);
+}
+
+static HAL_StatusTypeDef CAN_IsoTp_FlowControl(CAN_IsoTpLink *link, uint8_t status)
+{
+	uint8_t frame[CAN_MAX_DLC];
+
+	memset(frame, CAN_ISOTP_PADDING, sizeof(frame));
+	frame[0] = (CAN_ISOTP_PCI_FC << 4) | status;
+	frame[1] = link->blockSize;
+	frame[2] = link->stMin;
+
+	return CAN_IsoTp_Transmit(link, frame);
+}
+
+/**
+ * @brief Sends flow control of reception, when TX queue is full it is kept pending and retried by CAN_IsoTp_Poll
+ */
+static void CAN_IsoTp_ReplyFlowControl(CAN_IsoTpLink *link, uint8_t status)
+{
+	link->rxFcStatus = status;
+	link->rxFcPending = (CAN_IsoTp_FlowControl(link, status) != HAL_OK);
+}
+
+/**
+ * @brief Separation time of flow control in ms, sub-millisecond values are rounded up to one tick
+ */
+static uint8_t CAN_IsoTp_DecodeStMin(uint8_t stMin)
+{
+	if(stMin <= 0x7F)
+		return stMin;
+	if(stMin >= 0xF1 && stMin <= 0xF9)
+		return 1;
+
+	return 0x7F;	// reserved values are treated as the longest time
+}
+
+static void CAN_IsoTp_FinishRx(CAN_IsoTpLink *link, CAN_IsoTpResult result, uint32_t length)
+{
+	link->rxState = CAN_ISOTP_IDLE;
+	link->rxFcPending = 0;		// sender of finished transfer waits for nothing more
+	if(link->Received != NULL)
+		link->Received(link, result, length);
+}
+
+static void CAN_IsoTp_FinishTx(CAN_IsoTpLink *link, CAN_IsoTpResult result)
+{
+	link->txState = CAN_ISOTP_IDLE;
+	if(link->Sent != NULL)
+		link->Sent(link, result);
+}
+
+/**
+ * @brief	Prepares link, register CAN_IsoTp_HandleFrame for RX ID of the link with link as ctx
+ * @param	rxBuffer reassembly buffer, longer incoming transfers are refused with overflow flow control
+ * @param	blockSize consecutive frames accepted between flow controls, 0 - whole transfer at once
+ * @param	stMin ms requested between consecutive frames (0..127)
+ * @retval	HAL_ERROR when TransmitFifoPriority is disabled or parameters are invalid
+ */
+HAL_StatusTypeDef CAN_IsoTp_Init(CAN_IsoTpLink *link, CAN_HandleTypeDef *hcan, CAN_TxQueue *queue, uint32_t txIde, uint32_t txId,
+								 uint8_t *rxBuffer, uint32_t rxCapacity, uint8_t blockSize, uint8_t stMin)
+{
+	// mailboxes served by ID priority may swap consecutive frames with equal ID
+	if((hcan->Instance->MCR & CAN_MCR_TXFP) == 0)
+		return HAL_ERROR;
+	if(rxBuffer == NULL || stMin > 0x7F)
+		return HAL_ERROR;
+
+	link->hcan = hcan;
+	link->queue = queue;
+
+	link->txHeader.IDE = txIde;
+	link->txHeader.StdId = (txIde == CAN_ID_STD) ? txId : 0;
+	link->txHeader.ExtId = (txIde == CAN_ID_EXT) ? txId : 0;
+	link->txHeader.RTR = CAN_RTR_DATA;
+	link->txHeader.DLC = CAN_MAX_DLC;
+	link->txHeader.TransmitGlobalTime = DISABLE;
+
+	link->blockSize = blockSize;
+	link->stMin = stMin;
+
+	link->txState = CAN_ISOTP_IDLE;
+	link->rxState = CAN_ISOTP_IDLE;
+	link->rxFcPending = 0;
+	link->rxBuffer = rxBuffer;
+	link->rxCapacity = rxCapacity;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief	Starts transfer, data has to stay valid until Sent callback
+ * 			Payloads up to 7 bytes go in a single frame, the rest is streamed by CAN_IsoTp_Poll
+ * @retval	HAL_BUSY when previous transfer is not finished
+ */
+HAL_StatusTypeDef CAN_IsoTp_Send(CAN_IsoTpLink *link, const uint8_t *data, uint32_t length)
+{
+	uint8_t frame[CAN_MAX_DLC];
+
+	if(link->txState != CAN_ISOTP_IDLE)
+		return HAL_BUSY;
+	if(length == 0)
+		return HAL_ERROR;
+
+	memset(frame, CAN_ISOTP_PADDING, sizeof(frame));
+
+	if(length <= CAN_ISOTP_SF_MAX)
+	{
+		frame[0] = (CAN_ISOTP_PCI_SF << 4) | length;
+		memcpy(&frame[1], data, length);
+
+		if(CAN_IsoTp_Transmit(link, frame) != HAL_OK)
+			return HAL_ERROR;
+
+		CAN_IsoTp_FinishTx(link, CAN_ISOTP_OK);
+		return HAL_OK;
+	}
+
+	uint8_t header;
+	if(length <= CAN_ISOTP_FF12_MAX)
+	{
+		frame[0] = (CAN_ISOTP_PCI_FF << 4) | (length >> 8);
+		frame[1] = length & 0xFF;
+		header = 2;
+	}
+	else
+	{
+		// escape sequence: 12-bit length is 0, 32-bit big endian length follows
+		frame[0] = CAN_ISOTP_PCI_FF << 4;
+		frame[1] = 0;
+		frame[2] = length >> 24;
+		frame[3] = length >> 16;
+		frame[4] = length >> 8;
+		frame[5] = length;
+		header = 6;
+	}
+	memcpy(&frame[header], data, CAN_MAX_DLC - header);
+
+	if(CAN_IsoTp_Transmit(link, frame) != HAL_OK)
+		return HAL_ERROR;
+
+	link->txData = data;
+	link->txLength = length;
+	link->txOffset = CAN_MAX_DLC - header;
+	link->txSequence = 1;
+	link->txTick = HAL_GetTick();
+	link->txState = CAN_ISOTP_WAIT_FC;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief	Queues consecutive frames allowed by flow control and checks timeouts, call it from the main loop
+ * 			With STmin 0 a block is queued at once (up to CAN_ISOTP_QUEUE_SHARE frames), so TX interrupts keep
+ * 			the bus busy between calls
+ */
+void CAN_IsoTp_Poll(CAN_IsoTpLink *link)
+{
+	uint32_t currentTick = HAL_GetTick();
+
+	// sender waits for it, N_Cr starts when it is finally queued
+	if(link->rxFcPending && CAN_IsoTp_FlowControl(link, link->rxFcStatus) == HAL_OK)
+	{
+		link->rxFcPending = 0;
+		link->rxTick = currentTick;
+	}
+
+	if(link->rxState == CAN_ISOTP_RECEIVING && currentTick - link->rxTick > CAN_ISOTP_TIMEOUT_MS)
+		CAN_IsoTp_FinishRx(link, CAN_ISOTP_TIMEOUT, link->rxOffset);
+
+	if(link->txState == CAN_ISOTP_WAIT_FC && currentTick - link->txTick > CAN_ISOTP_TIMEOUT_MS)
+		CAN_IsoTp_FinishTx(link, CAN_ISOTP_TIMEOUT);
+
+	while(link->txState == CAN_ISOTP_SENDING)
+	{
+		// previous frame may have gone just before a tick edge, so a full STmin takes one tick more
+		if(link->txStMin > 0 && currentTick - link->txTick <= link->txStMin)
+			return;
+		if(link->queue->size >= CAN_ISOTP_QUEUE_SHARE)
+			return;
+
+		uint8_t frame[CAN_MAX_DLC];
+		uint32_t left = link->txLength - link->txOffset;
+		uint8_t chunk = (left < CAN_MAX_DLC - 1) ? left : CAN_MAX_DLC - 1;
+
+		memset(frame, CAN_ISOTP_PADDING, sizeof(frame));
+		frame[0] = (CAN_ISOTP_PCI_CF << 4) | link->txSequence;
+		memcpy(&frame[1], &link->txData[link->txOffset], chunk);
+
+		if(CAN_IsoTp_Transmit(link, frame) != HAL_OK)
+			return;
+
+		link->txOffset += chunk;
+		link->txSequence = (link->txSequence + 1) & 0x0F;
+		link->txTick = currentTick;
+
+		if(link->txOffset >= link->txLength)
+		{
+			CAN_IsoTp_FinishTx(link, CAN_ISOTP_OK);
+			return;
+		}
+
+		if(!link->txUnlimited && --link->txBlockLeft == 0)
+		{
+			link->txState = CAN_ISOTP_WAIT_FC;
+			return;
+		}
+	}
+}
+
+/**
+ * @brief	Handles frame of RX ID, CAN_RxHandler with link as ctx
+ */
+void CAN_IsoTp_HandleFrame(const CAN_RxFrame *frame, void *ctx)
+{
+	CAN_IsoTpLink *link = (CAN_IsoTpLink*)ctx;
+	const uint8_t *data = frame->data;
+	uint8_t dlc = frame->header.DLC;
+
+	if(dlc == 0)
+		return;
+
+	switch(data[0] >> 4)
+	{
+	case CAN_ISOTP_PCI_SF:
+	{
+		uint8_t length = data[0] & 0x0F;
+		if(length == 0 || length >= dlc)
+			return;
+
+		if(link->rxState == CAN_ISOTP_RECEIVING)
+			CAN_IsoTp_FinishRx(link, CAN_ISOTP_ABORTED, link->rxOffset);
+
+		if(length > link->rxCapacity)
+		{
+			CAN_IsoTp_FinishRx(link, CAN_ISOTP_OVERFLOW, length);
+			return;
+		}
+
+		memcpy(link->rxBuffer, &data[1], length);
+		CAN_IsoTp_FinishRx(link, CAN_ISOTP_OK, length);
+	}
+	break;
+	case CAN_ISOTP_PCI_FF:
+	{
+		uint32_t length = ((uint32_t)(data[0] & 0x0F) << 8) | data[1];
+		uint8_t header = 2;
+
+		if(dlc < CAN_MAX_DLC)
+			return;
+		if(length == 0)
+		{
+			length = ((uint32_t)data[2] << 24) | ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 8) | data[5];
+			header = 6;
+		}
+		if(length <= CAN_ISOTP_SF_MAX)
+			return;
+
+		if(link->rxState == CAN_ISOTP_RECEIVING)
+			CAN_IsoTp_FinishRx(link, CAN_ISOTP_ABORTED, link->rxOffset);
+
+		if(length > link->rxCapacity)
+		{
+			CAN_IsoTp_FinishRx(link, CAN_ISOTP_OVERFLOW, length);
+			CAN_IsoTp_ReplyFlowControl(link, CAN_ISOTP_FC_OVFLW);
+			return;
+		}
+
+		memcpy(link->rxBuffer, &data[header], CAN_MAX_DLC - header);
+		link->rxLength = length;
+		link->rxOffset = CAN_MAX_DLC - header;
+		link->rxSequence = 1;
+		link->rxBlockLeft = link->blockSize;
+		link->rxTick = HAL_GetTick();
+		link->rxState = CAN_ISOTP_RECEIVING;
+
+		CAN_IsoTp_ReplyFlowControl(link, CAN_ISOTP_FC_CTS);
+	}
+	break;
+	case CAN_ISOTP_PCI_CF:
+	{
+		if(link->rxState != CAN_ISOTP_RECEIVING)
+			return;
+
+		if((data[0] & 0x0F) != link->rxSequence)
+		{
+			CAN_IsoTp_FinishRx(link, CAN_ISOTP_SEQUENCE, link->rxOffset);
+			return;
+		}
+
+		uint32_t left = link->rxLength - link->rxOffset;
+		uint8_t room = dlc - 1;
+		uint8_t chunk = (left < room) ? left : room;
+
+		memcpy(&link->rxBuffer[link->rxOffset], &data[1], chunk);
+		link->rxOffset += chunk;
+		link->rxSequence = (link->rxSequence + 1) & 0x0F;
+		link->rxTick = HAL_GetTick();
+
+		if(link->rxOffset >= link->rxLength)
+		{
+			CAN_IsoTp_FinishRx(link, CAN_ISOTP_OK, link->rxLength);
+			return;
+		}
+
+		if(link->blockSize != 0 && --link->rxBlockLeft == 0)
+		{
+			link->rxBlockLeft = link->blockSize;
+			CAN_IsoTp_ReplyFlowControl(link, CAN_ISOTP_FC_CTS);
+		}
+	}
+	break;
+	case CAN_ISOTP_PCI_FC:
+	{
+		if(link->txState != CAN_ISOTP_WAIT_FC || dlc < 3)
+			return;
+
+		switch(data[0] & 0x0F)
+		{
+		case CAN_ISOTP_FC_CTS:
+			link->txBlockLeft = data[1];
+			link->txUnlimited = (data[1] == 0);
+			link->txStMin = CAN_IsoTp_DecodeStMin(data[2]);
+			link->txTick = HAL_GetTick() - link->txStMin - 1;	// first frame of block goes right away
+			link->txState = CAN_ISOTP_SENDING;
+			CAN_IsoTp_Poll(link);
+		break;
+		case CAN_ISOTP_FC_WAIT:
+			link->txTick = HAL_GetTick();
+		break;
+		default:
+			CAN_IsoTp_FinishTx(link, CAN_ISOTP_OVERFLOW);
+		break;
+		}
+	}
+	break;
+	default:
+	break;
+	}
+}
+
+#endif /* CAN_BACKEND_FDCAN */
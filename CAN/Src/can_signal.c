@@ -0,0 +1,175 @@
+/**
+  * @file can_signal.c
+  * @brief Packing of CAN frames from constant signal tables (DBC-like)
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "can_signal.h"
+
+/**
+ * @brief Lowest and highest raw value of the signal
+ */
+static inline int64_t CAN_Signal_Min(const CAN_Signal *signal)
+{
+	return signal->isSigned ? -((int64_t)1 << (signal->length - 1)) : 0;
+}
+
+static inline int64_t CAN_Signal_Max(const CAN_Signal *signal)
+{
+	return signal->isSigned ? ((int64_t)1 << (signal->length - 1)) - 1 : ((int64_t)1 << signal->length) - 1;
+}
+
+static inline int64_t CAN_Signal_Clamp(int64_t value, int64_t min, int64_t max)
+{
+	return (value < min) ? min : (value > max) ? max : value;
+}
+
+/**
+ * @brief Rounds to nearest, halves away from zero, and saturates to [min, max]
+ */
+static inline int64_t CAN_Signal_Round(float value, int64_t min, int64_t max)
+{
+	if(value <= (float)min)
+		return min;
+	if(value >= (float)max)
+		return max;
+
+	return (int64_t)(value + ((value < 0.0f) ? -0.5f : 0.5f));
+}
+
+/**
+ * @brief Value of the bound variable as integer, float variables are rounded
+ */
+static int64_t CAN_Signal_LoadInteger(const CAN_Signal *signal)
+{
+	switch(signal->sourceType)
+	{
+	case CAN_SIGNAL_U8: 	return *(const uint8_t*)signal->source;
+	case CAN_SIGNAL_I8: 	return *(const int8_t*)signal->source;
+	case CAN_SIGNAL_U16: 	return *(const uint16_t*)signal->source;
+	case CAN_SIGNAL_I16: 	return *(const int16_t*)signal->source;
+	case CAN_SIGNAL_U32: 	return *(const uint32_t*)signal->source;
+	case CAN_SIGNAL_I32: 	return *(const int32_t*)signal->source;
+	default: 				return CAN_Signal_Round(*(const float*)signal->source, INT32_MIN, INT32_MAX);
+	}
+}
+
+static float CAN_Signal_LoadFloat(const CAN_Signal *signal)
+{
+	if(signal->sourceType == CAN_SIGNAL_FLOAT)
+		return *(const float*)signal->source;
+
+	return (float)CAN_Signal_LoadInteger(signal);
+}
+
+/**
+ * @brief Writes integer into the bound variable, saturated to its type
+ */
+static void CAN_Signal_StoreInteger(const CAN_Signal *signal, int64_t value)
+{
+	switch(signal->sourceType)
+	{
+	case CAN_SIGNAL_U8: 	*(uint8_t*)signal->source = (uint8_t)CAN_Signal_Clamp(value, 0, UINT8_MAX); break;
+	case CAN_SIGNAL_I8: 	*(int8_t*)signal->source = (int8_t)CAN_Signal_Clamp(value, INT8_MIN, INT8_MAX); break;
+	case CAN_SIGNAL_U16: 	*(uint16_t*)signal->source = (uint16_t)CAN_Signal_Clamp(value, 0, UINT16_MAX); break;
+	case CAN_SIGNAL_I16: 	*(int16_t*)signal->source = (int16_t)CAN_Signal_Clamp(value, INT16_MIN, INT16_MAX); break;
+	case CAN_SIGNAL_U32: 	*(uint32_t*)signal->source = (uint32_t)CAN_Signal_Clamp(value, 0, UINT32_MAX); break;
+	case CAN_SIGNAL_I32: 	*(int32_t*)signal->source = (int32_t)CAN_Signal_Clamp(value, INT32_MIN, INT32_MAX); break;
+	default: 				*(float*)signal->source = (float)value; break;
+	}
+}
+
+static void CAN_Signal_StoreFloat(const CAN_Signal *signal, float value)
+{
+	if(signal->sourceType == CAN_SIGNAL_FLOAT)
+		*(float*)signal->source = value;
+	else
+		CAN_Signal_StoreInteger(signal, CAN_Signal_Round(value, INT32_MIN, UINT32_MAX));
+}
+
+/**
+ * @brief	Checks that every signal fits into the frame
+ * @param	length data bytes of the frame
+ */
+HAL_StatusTypeDef CAN_Signal_Check(const CAN_SignalTable *table, uint8_t length)
+{
+	for(uint8_t i = 0; i < table->count; i++)
+	{
+		const CAN_Signal *signal = &table->signals[i];
+		int16_t last = signal->lsbByte + signal->step * (signal->bytes - 1);
+
+		if(signal->source == NULL || signal->length == 0 || signal->length > 32 || signal->scale == 0.0f)
+			return HAL_ERROR;
+		if(signal->lsbByte >= length || last < 0 || last >= length)
+			return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * @brief	Packs bound variables into frame data, values outside of signal range are saturated
+ * @param	length data bytes of the frame, all of them are written
+ */
+void CAN_Signal_Pack(const CAN_SignalTable *table, uint8_t *data, uint8_t length)
+{
+	for(uint8_t j = 0; j < length; j++)
+		data[j] = 0;
+
+	for(uint8_t i = 0; i < table->count; i++)
+	{
+		const CAN_Signal *signal = &table->signals[i];
+		int64_t min = CAN_Signal_Min(signal);
+		int64_t max = CAN_Signal_Max(signal);
+		int64_t raw;
+
+		if(signal->scaled || signal->sourceType == CAN_SIGNAL_FLOAT)
+			raw = CAN_Signal_Round((CAN_Signal_LoadFloat(signal) - signal->offset) * signal->invScale, min, max);
+		else
+			raw = CAN_Signal_Clamp(CAN_Signal_LoadInteger(signal), min, max);
+
+		// two's complement is truncated to signal length, bits above it are shifted out byte by byte
+		uint64_t bits = ((uint64_t)raw & (((uint64_t)1 << signal->length) - 1)) << signal->shift;
+		uint8_t byte = signal->lsbByte;
+
+		for(uint8_t j = 0; j < signal->bytes; j++)
+		{
+			data[byte] |= (uint8_t)bits;
+			bits >>= 8;
+			byte += signal->step;
+		}
+	}
+}
+
+/**
+ * @brief	Unpacks frame data into bound variables
+ * @param	length data bytes received, signals not contained in them are left unchanged
+ */
+void CAN_Signal_Unpack(const CAN_SignalTable *table, const uint8_t *data, uint8_t length)
+{
+	for(uint8_t i = 0; i < table->count; i++)
+	{
+		const CAN_Signal *signal = &table->signals[i];
+		int16_t byte = signal->lsbByte + signal->step * (signal->bytes - 1);
+
+		if(signal->lsbByte >= length || byte < 0 || byte >= length)
+			continue;
+
+		// most significant byte first
+		uint64_t bits = 0;
+		for(uint8_t j = 0; j < signal->bytes; j++)
+		{
+			bits = (bits << 8) | data[byte];
+			byte -= signal->step;
+		}
+
+		int64_t raw = (int64_t)((bits >> signal->shift) & (((uint64_t)1 << signal->length) - 1));
+		if(signal->isSigned && (raw >> (signal->length - 1)) != 0)
+			raw -= (int64_t)1 << signal->length;
+
+		if(signal->scaled || signal->sourceType == CAN_SIGNAL_FLOAT)
+			CAN_Signal_StoreFloat(signal, (float)raw * signal->scale + signal->offset);
+		else
+			CAN_Signal_StoreInteger(signal, raw);
+	}
+}
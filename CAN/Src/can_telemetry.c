@@ -0,0 +1,191 @@
+/**
+  * @file can_telemetry.c
+  * @brief Node load and error state telemetry of CAN driver
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "can_driver.h"
+
+#ifndef CAN_BACKEND_FDCAN								// IDE projects compile every source, only users of the header are stopped
+
+#include "can_telemetry.h"
+
+/**
+ * @brief Saturating narrowing of counters for the published payload
+ */
+static inline uint8_t CAN_Telemetry_Sat8(uint32_t value)
+{
+	return (value > 0xFF) ? 0xFF : (uint8_t)value;
+}
+
+/**
+ * @brief Reads error counters and state from ESR, counts transitions into worse states
+ */
+static void CAN_Telemetry_ReadState(CAN_Telemetry *telemetry)
+{
+	uint32_t esr = telemetry->hcan->Instance->ESR;
+	CAN_ErrorState state = CAN_STATE_ACTIVE;
+
+	telemetry->tec = (uint8_t)((esr & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos);
+	telemetry->rec = (uint8_t)((esr & CAN_ESR_REC) >> CAN_ESR_REC_Pos);
+	telemetry->lastErrorCode = (uint8_t)((esr & CAN_ESR_LEC) >> CAN_ESR_LEC_Pos);
+
+	if(esr & CAN_ESR_BOFF)
+		state = CAN_STATE_BUSOFF;
+	else if(esr & CAN_ESR_EPVF)
+		state = CAN_STATE_PASSIVE;
+	else if(esr & CAN_ESR_EWGF)
+		state = CAN_STATE_WARNING;
+
+	if(state != telemetry->state)
+	{
+		if(state == CAN_STATE_BUSOFF)
+		{
+			telemetry->busOffCount++;
+			telemetry->busOffTick = HAL_GetTick();
+		}
+		else if(state == CAN_STATE_PASSIVE && telemetry->state < CAN_STATE_PASSIVE)
+		{
+			telemetry->passiveCount++;
+		}
+
+		telemetry->state = state;
+	}
+}
+
+/**
+ * @brief	Starts telemetry and enables error interrupts
+ * @param	bitrate nominal bit rate in bit/s, base of node load
+ */
+void CAN_Telemetry_Init(CAN_Telemetry *telemetry, CAN_HandleTypeDef *hcan, CAN_TxQueue *queue, CAN_RxRing *ring, uint32_t bitrate)
+{
+	telemetry->hcan = hcan;
+	telemetry->queue = queue;
+	telemetry->ring = ring;
+	telemetry->bitrate = bitrate;
+
+	telemetry->windowStart = HAL_GetTick();
+	telemetry->txBits = queue->txBits;
+	telemetry->rxBits = ring->rxBits;
+	telemetry->txFrames = queue->txFrames;
+	telemetry->rxFrames = ring->rxFrames;
+
+	telemetry->recoveryHoldoff = CAN_TELEMETRY_RECOVERY_MS;
+	telemetry->state = CAN_STATE_ACTIVE;
+	CAN_Telemetry_ReadState(telemetry);
+
+	if(HAL_CAN_ActivateNotification(hcan, CAN_IT_ERROR_WARNING | CAN_IT_ERROR_PASSIVE | CAN_IT_BUSOFF
+										| CAN_IT_LAST_ERROR_CODE | CAN_IT_ERROR) != HAL_OK)
+	{
+		Error_Handler();
+	}
+}
+
+/**
+ * @brief	Scheduled message publishing telemetry, add it with CAN_AddScheduledMessage
+ * 			[0..1] node load permille, [2] TEC, [3] REC, [4] state, [5] bus-off count,
+ * 			[6] TX queue high water, [7] RX frames lost (ring drops and FIFO overruns) | little endian, saturated
+ */
+CAN_ScheduledMsg CAN_Telemetry_Message(CAN_Telemetry *telemetry, uint32_t ide, uint32_t id, uint32_t period_ms)
+{
+	CAN_ScheduledMsg msg = {0};
+
+	msg.header.IDE = ide;
+	msg.header.StdId = (ide == CAN_ID_STD) ? id : 0;
+	msg.header.ExtId = (ide == CAN_ID_EXT) ? id : 0;
+	msg.header.RTR = CAN_RTR_DATA;
+	msg.header.DLC = CAN_MAX_DLC;
+	msg.header.TransmitGlobalTime = DISABLE;
+	msg.period_ms = period_ms;
+	msg.payload = &telemetry->payload;
+
+	return msg;
+}
+
+/**
+ * @brief	Refreshes error state
+ * 			Put this into HAL_CAN_ErrorCallback
+ */
+void CAN_Telemetry_HandleError(CAN_Telemetry *telemetry)
+{
+	CAN_Telemetry_ReadState(telemetry);
+}
+
+/**
+ * @brief	Closes node load window, restarts controller after bus-off and publishes telemetry
+ * 			Call it from the main loop
+ */
+void CAN_Telemetry_Update(CAN_Telemetry *telemetry)
+{
+	uint32_t currentTick = HAL_GetTick();
+
+	// error interrupts may be not wired, state is polled as well | without racing HAL_CAN_ErrorCallback
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	CAN_Telemetry_ReadState(telemetry);
+	__set_PRIMASK(primask);
+
+	// bus-off recovery: leaving initialization waits for 128 x 11 recessive bits in hardware
+	if(telemetry->state == CAN_STATE_BUSOFF && currentTick - telemetry->busOffTick >= telemetry->recoveryHoldoff)
+	{
+		HAL_CAN_Stop(telemetry->hcan);
+		if(HAL_CAN_Start(telemetry->hcan) == HAL_OK)
+		{
+			telemetry->recoveries++;
+			telemetry->recoveryHoldoff = CAN_TELEMETRY_RECOVERY_MS;
+		}
+		else
+		{
+			// HAL_CAN_Start busy-waited its timeout (bus still dominant) and left the handle in ERROR state,
+			// which refuses every later start; initialization keeps filters and interrupt enables
+			HAL_CAN_ResetError(telemetry->hcan);
+			HAL_CAN_Init(telemetry->hcan);
+			telemetry->failedRecoveries++;
+
+			// fewer blocking attempts while the bus stays broken
+			telemetry->recoveryHoldoff *= 2;
+			if(telemetry->recoveryHoldoff > CAN_TELEMETRY_RECOVERY_MAX_MS)
+				telemetry->recoveryHoldoff = CAN_TELEMETRY_RECOVERY_MAX_MS;
+		}
+		currentTick = HAL_GetTick();
+		telemetry->busOffTick = currentTick;
+	}
+
+	uint32_t elapsed = currentTick - telemetry->windowStart;
+	if(elapsed < CAN_TELEMETRY_WINDOW_MS)
+		return;
+
+	uint32_t txBits = telemetry->queue->txBits;
+	uint32_t rxBits = telemetry->ring->rxBits;
+	uint32_t txFrames = telemetry->queue->txFrames;
+	uint32_t rxFrames = telemetry->ring->rxFrames;
+
+	// counters wrap, differences do not
+	uint64_t bits = (uint64_t)(txBits - telemetry->txBits) + (rxBits - telemetry->rxBits);
+	uint64_t capacity = (uint64_t)telemetry->bitrate * elapsed;
+
+	telemetry->nodeLoad = (capacity == 0) ? 0 : (uint16_t)((bits * 1000 * 1000 + capacity / 2) / capacity);
+	telemetry->txRate = (uint32_t)((uint64_t)(txFrames - telemetry->txFrames) * 1000 / elapsed);
+	telemetry->rxRate = (uint32_t)((uint64_t)(rxFrames - telemetry->rxFrames) * 1000 / elapsed);
+
+	telemetry->windowStart = currentTick;
+	telemetry->txBits = txBits;
+	telemetry->rxBits = rxBits;
+	telemetry->txFrames = txFrames;
+	telemetry->rxFrames = rxFrames;
+
+	uint8_t *data = CAN_PayloadBeginWrite(&telemetry->payload);
+
+	data[0] = (uint8_t)(telemetry->nodeLoad);
+	data[1] = (uint8_t)(telemetry->nodeLoad >> 8);
+	data[2] = telemetry->tec;
+	data[3] = telemetry->rec;
+	data[4] = (uint8_t)telemetry->state;
+	data[5] = CAN_Telemetry_Sat8(telemetry->busOffCount);
+	data[6] = telemetry->queue->highWater;
+	data[7] = CAN_Telemetry_Sat8(telemetry->ring->dropped + telemetry->ring->overruns);
+
+	CAN_PayloadCommit(&telemetry->payload);
+}
+
+#endif /* CAN_BACKEND_FDCAN */
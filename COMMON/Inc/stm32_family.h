@@ -3,7 +3,7 @@
   ******************************************************************************
   * @file    stm32_family.h
   * @author  Bartosz Rychlicki
-  * @Title   Universal driver for ADC peripheral
+  * @Title   Common defines of STM32 drivers
   * @brief   This file contains common defines of stm32 families. Code defines family whose member is detected.
   * 		 In case developer uses stm32f103rb, then code defines family of stm32f1_family.
   ******************************************************************************
@@ -0,0 +1,133 @@
+/**
+  * @file hal_host.h
+  * @brief Control of the simulated peripherals behind HOST/Inc/main.h
+  * @author AGH EKO-ENERGIA
+  *
+  * Simulation is single threaded: HAL calls of drivers change the model, tests advance the tick, deliver frames,
+  * complete transfers and then call the driver hooks which would run in interrupts on target.
+  */
+
+#ifndef HOST_HAL_HOST_H_
+#define HOST_HAL_HOST_H_
+
+#include "main.h"
+
+/**
+ * Defines
+ */
+
+#define HOST_CAN_MAILBOXES 			3					// bxCAN mailboxes, FDCAN TX buffers
+#define HOST_CAN_FIFO_DEPTH 		3					// elements of one RX FIFO
+#define HOST_CAN_FILTER_BANKS 		14					// bxCAN banks of one controller
+#define HOST_FDCAN_STD_FILTERS 		28
+#define HOST_FDCAN_EXT_FILTERS 		8
+
+#define HOST_I2C_MEMORY 			256
+#define HOST_I2C_BIT_US 			10					// SCL period, standard mode 100 kHz
+#define HOST_I2C_BUF_US 			5					// bus free time between STOP and the next START (tBUF 4.7 us)
+
+/**
+ * Frame on the simulated bus
+ */
+typedef struct {
+	uint32_t 			ide;							// CAN_ID_STD or CAN_ID_EXT (FDCAN_*_ID on FDCAN)
+	uint32_t 			id;
+	uint8_t 			length;							// data bytes
+	uint8_t 			data[64];
+	uint32_t 			tick;
+}HOST_CanFrame;
+
+/**
+ * Result of HOST_I2C_Process, tells which driver hook a test has to call
+ */
+typedef enum {
+	HOST_I2C_NONE = 0,									// nothing pending, or slave holds the bus (hang)
+	HOST_I2C_TX_DONE,									// HAL_I2C_MasterTxCpltCallback
+	HOST_I2C_RX_DONE,									// HAL_I2C_MasterRxCpltCallback or HAL_I2C_MemRxCpltCallback
+	HOST_I2C_NACK,										// HAL_I2C_ErrorCallback
+	HOST_I2C_ABORTED									// HAL_I2C_AbortCpltCallback
+}HOST_I2C_Event;
+
+/**
+ * I2C slave with a register pointer: the first addressBytes written set the pointer, reads continue from it
+ * With eeprom the written bytes are stored and the slave NACKs for writeCycle ms after the STOP (24Cxx)
+ */
+typedef struct {
+	uint8_t 			address;						// 8-bit address, R/W bit ignored
+	uint8_t 			addressBytes;					// 1 or 2
+	uint8_t 			eeprom;
+	uint8_t 			hang;							// transfers never complete, master has to time out
+	uint32_t 			writeCycle;
+	uint8_t 			memory[HOST_I2C_MEMORY];
+	uint16_t 			pointer;
+
+	uint32_t 			busyUntil;						// end of write cycle
+	uint32_t 			stops;							// STOP conditions seen by the slave
+	uint32_t 			transfers;						// addressed transfers, repeated start counts as one
+	uint32_t 			nacks;
+}HOST_I2C_Slave;
+
+/**
+ * Time and core
+ */
+void HOST_Reset(void);
+void HOST_SetTick(uint32_t tick);
+void HOST_Advance(uint32_t ms);
+uint32_t HOST_ErrorHandlerCalls(void);
+uint32_t HOST_AssertCalls(void);
+uint8_t HOST_IrqDisabled(void);
+
+/**
+ * ADC
+ * Setup resets the instance and writes channels into SQR1..SQR3 in rank order, circular sets CIRC of the DMA channel;
+ * dual sets DUALMOD in ADC1
+ */
+void HOST_ADC_Setup(ADC_HandleTypeDef *hadc, ADC_TypeDef *instance, DMA_HandleTypeDef *dma, const uint8_t *channels, uint8_t count,
+					uint8_t circular);
+void HOST_ADC_SetDual(uint8_t dual);
+uint32_t* HOST_ADC_DmaBuffer(const ADC_HandleTypeDef *hadc, uint32_t *transfers);
+uint32_t HOST_ADC_DmaStarts(const ADC_HandleTypeDef *hadc);
+void HOST_ADC_QueueValue(const ADC_HandleTypeDef *hadc, uint32_t value);
+
+/**
+ * CAN
+ * HOST_CAN_Deliver runs acceptance filters and puts the frame into its FIFO (overrun when full),
+ * HOST_CAN_CompleteMailbox sends the pending mailbox which wins arbitration (or the oldest one with TXFP)
+ * HOST_CAN_FailStarts makes the next HAL_CAN_Start calls time out like with a bus stuck dominant
+ * HOST_CAN_SetRxHook runs the hook after every frame read from a FIFO (0 or 1), e.g. a higher priority interrupt
+ * which preempts the drain of the other FIFO
+ */
+#if defined(STM32G474xx)
+typedef FDCAN_HandleTypeDef HOST_CanHandle;
+#else
+typedef CAN_HandleTypeDef HOST_CanHandle;
+#endif
+
+typedef void (*HOST_CanRxHook)(HOST_CanHandle *hcan, uint32_t fifo);
+
+void HOST_CAN_Setup(HOST_CanHandle *hcan, void *instance);
+int HOST_CAN_Deliver(HOST_CanHandle *hcan, uint32_t ide, uint32_t id, const uint8_t *data, uint8_t length);
+uint8_t HOST_CAN_CompleteMailbox(HOST_CanHandle *hcan, HOST_CanFrame *frame);
+uint8_t HOST_CAN_PendingMailboxes(HOST_CanHandle *hcan);
+uint8_t HOST_CAN_Started(HOST_CanHandle *hcan);
+uint32_t HOST_CAN_Notifications(HOST_CanHandle *hcan);
+uint32_t HOST_CAN_ActiveFilters(HOST_CanHandle *hcan);
+uint32_t HOST_CAN_Starts(HOST_CanHandle *hcan);
+void HOST_CAN_FailStarts(HOST_CanHandle *hcan, uint8_t count);
+void HOST_CAN_SetRxHook(HOST_CanHandle *hcan, HOST_CanRxHook hook);
+
+/**
+ * I2C
+ * HOST_I2C_BusyUs is the time the bus was not free: finished transfers cost their bits at HOST_I2C_BIT_US,
+ * a hanging slave holds the bus from the START until abort, peripheral reset or the blocking timeout
+ */
+void HOST_I2C_Attach(I2C_HandleTypeDef *hi2c, HOST_I2C_Slave *slave);
+HOST_I2C_Event HOST_I2C_Process(I2C_HandleTypeDef *hi2c);
+uint8_t HOST_I2C_Pending(I2C_HandleTypeDef *hi2c);
+uint32_t HOST_I2C_Starts(I2C_HandleTypeDef *hi2c);
+uint32_t HOST_I2C_BusyRejects(I2C_HandleTypeDef *hi2c);
+uint32_t HOST_I2C_Resets(I2C_HandleTypeDef *hi2c);
+uint64_t HOST_I2C_BusyUs(I2C_HandleTypeDef *hi2c);
+
+
+#endif /* HOST_HAL_HOST_H_ */
@@ -0,0 +1,40 @@
+/**
+  * @file host_test.h
+  * @brief Minimal test runner of the host build, every case is one CTest test
+  * @author AGH EKO-ENERGIA
+  */
+
+#ifndef HOST_HOST_TEST_H_
+#define HOST_HOST_TEST_H_
+
+#include "hal_host.h"
+
+/**
+ * One test case, the simulated HAL is reset before it runs
+ */
+typedef struct {
+	const char 			*name;
+	void 				(*run)(void);
+}HOST_Test;
+
+#define HOST_TEST(__NAME__) 		{ #__NAME__, __NAME__ }
+#define HOST_TEST_COUNT(__TESTS__) 	(sizeof(__TESTS__) / sizeof((__TESTS__)[0]))
+
+/**
+ * Failed check is reported with its location, the case continues so one run shows every failure
+ */
+#define HOST_CHECK(__COND__) 		HOST_Check((__COND__) != 0, #__COND__, __FILE__, __LINE__)
+
+/**
+ * Functions
+ */
+void HOST_Check(int passed, const char *expression, const char *file, int line);
+
+/**
+ * @brief	Runs the case named by argv[1], or every case without arguments
+ * @retval	0 when all checks passed
+ */
+int HOST_RunTests(const HOST_Test *tests, uint32_t count, int argc, char **argv);
+
+
+#endif /* HOST_HOST_TEST_H_ */
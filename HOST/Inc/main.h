@@ -0,0 +1,465 @@
+/**
+  * @file main.h
+  * @brief Simulated HAL for host builds of the drivers
+  * @author AGH EKO-ENERGIA
+  *
+  * Replaces the main.h of a CubeMX project: it provides the HAL types, registers, macros and calls listed
+  * in README.md, so driver sources compile unchanged. The part define given by the build selects the backend:
+  * STM32F103xB - F1 ADC and bxCAN, STM32G474xx - FDCAN. Peripherals are modelled in hal_host.c,
+  * tests drive them through hal_host.h.
+  */
+
+#ifndef HOST_MAIN_H_
+#define HOST_MAIN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Common
+ */
+
+typedef enum {
+	HAL_OK = 0x00U,
+	HAL_ERROR = 0x01U,
+	HAL_BUSY = 0x02U,
+	HAL_TIMEOUT = 0x03U
+}HAL_StatusTypeDef;
+
+typedef enum {
+	DISABLE = 0U,
+	ENABLE = !DISABLE
+}FunctionalState;
+
+#define __weak 						__attribute__((weak))
+#define READ_BIT(REG, BIT) 			((REG) & (BIT))
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t delay);
+void Error_Handler(void);
+void assert_failed(const char *file, int line);
+
+/**
+ * Core, interrupts are a flag: the simulation is single threaded and ISRs are called by tests
+ */
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __disable_irq(void);
+void __enable_irq(void);
+#define __DMB() 					__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/**
+ * ADC (F1 register layout)
+ */
+
+typedef struct {
+	volatile uint32_t SR;
+	volatile uint32_t CR1;
+	volatile uint32_t CR2;
+	volatile uint32_t SMPR1;
+	volatile uint32_t SMPR2;
+	volatile uint32_t JOFR1;
+	volatile uint32_t JOFR2;
+	volatile uint32_t JOFR3;
+	volatile uint32_t JOFR4;
+	volatile uint32_t HTR;
+	volatile uint32_t LTR;
+	volatile uint32_t SQR1;
+	volatile uint32_t SQR2;
+	volatile uint32_t SQR3;
+	volatile uint32_t JSQR;
+	volatile uint32_t JDR1;
+	volatile uint32_t JDR2;
+	volatile uint32_t JDR3;
+	volatile uint32_t JDR4;
+	volatile uint32_t DR;
+}ADC_TypeDef;
+
+typedef struct {
+	volatile uint32_t CCR;
+	volatile uint32_t CNDTR;
+	volatile uint32_t CPAR;
+	volatile uint32_t CMAR;
+}DMA_Channel_TypeDef;
+
+typedef struct {
+	DMA_Channel_TypeDef *Instance;
+}DMA_HandleTypeDef;
+
+typedef struct {
+	ADC_TypeDef 		*Instance;
+	DMA_HandleTypeDef 	*DMA_Handle;
+}ADC_HandleTypeDef;
+
+extern ADC_TypeDef HOST_ADC1;
+extern ADC_TypeDef HOST_ADC2;
+extern ADC_TypeDef HOST_ADC3;									// F103xE, never a part of dual mode
+#define ADC1 						(&HOST_ADC1)
+#define ADC2 						(&HOST_ADC2)
+#define ADC3 						(&HOST_ADC3)
+
+#define ADC_SR_EOC_Pos 				1U
+#define ADC_SR_STRT_Pos 			4U
+#define ADC_CR1_DUALMOD_Pos 		16U
+#define ADC_CR1_DUALMOD 			(0xFU << ADC_CR1_DUALMOD_Pos)
+#define ADC_CR2_CONT_Pos 			1U
+#define ADC_CR2_DMA_Pos 			8U
+#define ADC_CR2_DMA 				(1U << ADC_CR2_DMA_Pos)
+#define ADC_CR2_JEXTSEL_Pos 		12U
+#define ADC_CR2_JEXTSEL 			(0x7U << ADC_CR2_JEXTSEL_Pos)
+#define ADC_CR2_JEXTTRIG_Pos 		15U
+#define ADC_CR2_JEXTTRIG 			(1U << ADC_CR2_JEXTTRIG_Pos)
+#define ADC_JSQR_JL_Pos 			20U
+#define DMA_CCR_CIRC_Pos 			5U
+#define DMA_CCR_CIRC 				(1U << DMA_CCR_CIRC_Pos)
+
+#define ADC_INJECTED_SOFTWARE_START	ADC_CR2_JEXTSEL					// JSWSTART is selected by JEXTSEL = 111
+#define ADC_EXTERNALTRIGINJECCONV_T1_TRGO 0U						// JEXTSEL = 000
+
+HAL_StatusTypeDef HAL_ADC_Start(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *data, uint32_t length);
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADCEx_MultiModeStart_DMA(ADC_HandleTypeDef *hadc, uint32_t *data, uint32_t length);
+uint32_t HAL_ADCEx_MultiModeGetValue(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADCEx_InjectedStart_IT(ADC_HandleTypeDef *hadc);
+
+/**
+ * TIM input capture
+ */
+
+typedef struct {
+	volatile uint32_t CNT;
+	volatile uint32_t CCER;
+	volatile uint32_t CCR1;
+	volatile uint32_t CCR2;
+	volatile uint32_t CCR3;
+	volatile uint32_t CCR4;
+}TIM_TypeDef;
+
+typedef struct {
+	TIM_TypeDef 		*Instance;
+}TIM_HandleTypeDef;
+
+#define TIM_CHANNEL_1 				0x00000000U
+#define TIM_CHANNEL_2 				0x00000004U
+#define TIM_CHANNEL_3 				0x00000008U
+#define TIM_CHANNEL_4 				0x0000000CU
+#define TIM_INPUTCHANNELPOLARITY_RISING 	0x00000000U
+#define TIM_INPUTCHANNELPOLARITY_FALLING 	0x00000002U
+
+#define __HAL_TIM_SET_COUNTER(__HANDLE__, __COUNTER__) 	((__HANDLE__)->Instance->CNT = (__COUNTER__))
+#define __HAL_TIM_SET_CAPTUREPOLARITY(__HANDLE__, __CHANNEL__, __POLARITY__) 					\
+	((__HANDLE__)->Instance->CCER = ((__HANDLE__)->Instance->CCER & ~(0xAU << (__CHANNEL__))) 	\
+									| ((__POLARITY__) << (__CHANNEL__)))
+
+uint32_t HAL_TIM_ReadCapturedValue(TIM_HandleTypeDef *htim, uint32_t channel);
+
+/**
+ * I2C
+ */
+
+typedef enum {
+	HAL_I2C_STATE_RESET = 0x00U,
+	HAL_I2C_STATE_READY = 0x20U,
+	HAL_I2C_STATE_BUSY_TX = 0x21U,
+	HAL_I2C_STATE_BUSY_RX = 0x22U,
+	HAL_I2C_STATE_ABORT = 0x60U
+}HAL_I2C_StateTypeDef;
+
+typedef enum {
+	HAL_I2C_MODE_NONE = 0x00U,
+	HAL_I2C_MODE_MASTER = 0x10U,
+	HAL_I2C_MODE_SLAVE = 0x20U,
+	HAL_I2C_MODE_MEM = 0x40U
+}HAL_I2C_ModeTypeDef;
+
+typedef struct {
+	volatile HAL_I2C_StateTypeDef State;
+	volatile HAL_I2C_ModeTypeDef Mode;
+	uint8_t 			id;
+}I2C_HandleTypeDef;
+
+#define I2C_MEMADD_SIZE_8BIT 		0x00000001U
+#define I2C_MEMADD_SIZE_16BIT 		0x00000010U
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t address, uint16_t memAddress, uint16_t memSize,
+									  uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t address, uint16_t memAddress, uint16_t memSize,
+									   uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef *hi2c, uint16_t address);
+
+#if defined(STM32G474xx)
+
+/**
+ * FDCAN (G4 message RAM: 28 standard and 8 extended filters, 3 RX elements per FIFO, 3 TX buffers)
+ */
+
+typedef struct {
+	volatile uint32_t IR;
+	volatile uint32_t IE;
+	volatile uint32_t RXGFC;
+}FDCAN_GlobalTypeDef;
+
+typedef struct {
+	uint32_t StdFiltersNbr;
+	uint32_t ExtFiltersNbr;
+}FDCAN_InitTypeDef;
+
+typedef struct {
+	FDCAN_GlobalTypeDef *Instance;
+	FDCAN_InitTypeDef Init;
+}FDCAN_HandleTypeDef;
+
+typedef struct {
+	uint32_t Identifier;
+	uint32_t IdType;
+	uint32_t TxFrameType;
+	uint32_t DataLength;
+	uint32_t ErrorStateIndicator;
+	uint32_t BitRateSwitch;
+	uint32_t FDFormat;
+	uint32_t TxEventFifoControl;
+	uint32_t MessageMarker;
+}FDCAN_TxHeaderTypeDef;
+
+typedef struct {
+	uint32_t Identifier;
+	uint32_t IdType;
+	uint32_t RxFrameType;
+	uint32_t DataLength;
+	uint32_t ErrorStateIndicator;
+	uint32_t BitRateSwitch;
+	uint32_t FDFormat;
+	uint32_t RxTimestamp;
+	uint32_t FilterIndex;
+	uint32_t IsFilterMatchingFrame;
+}FDCAN_RxHeaderTypeDef;
+
+typedef struct {
+	uint32_t IdType;
+	uint32_t FilterIndex;
+	uint32_t FilterType;
+	uint32_t FilterConfig;
+	uint32_t FilterID1;
+	uint32_t FilterID2;
+}FDCAN_FilterTypeDef;
+
+#define FDCAN_STANDARD_ID 			0x00000000U
+#define FDCAN_EXTENDED_ID 			0x40000000U
+#define FDCAN_DATA_FRAME 			0x00000000U
+#define FDCAN_ESI_ACTIVE 			0x00000000U
+#define FDCAN_BRS_OFF 				0x00000000U
+#define FDCAN_BRS_ON 				0x00100000U
+#define FDCAN_CLASSIC_CAN 			0x00000000U
+#define FDCAN_FD_CAN 				0x00200000U
+#define FDCAN_NO_TX_EVENTS 			0x00000000U
+
+#define FDCAN_DLC_BYTES_0 			0x00000000U
+#define FDCAN_DLC_BYTES_1 			0x00000001U
+#define FDCAN_DLC_BYTES_2 			0x00000002U
+#define FDCAN_DLC_BYTES_3 			0x00000003U
+#define FDCAN_DLC_BYTES_4 			0x00000004U
+#define FDCAN_DLC_BYTES_5 			0x00000005U
+#define FDCAN_DLC_BYTES_6 			0x00000006U
+#define FDCAN_DLC_BYTES_7 			0x00000007U
+#define FDCAN_DLC_BYTES_8 			0x00000008U
+#define FDCAN_DLC_BYTES_12 			0x00000009U
+#define FDCAN_DLC_BYTES_16 			0x0000000AU
+#define FDCAN_DLC_BYTES_20 			0x0000000BU
+#define FDCAN_DLC_BYTES_24 			0x0000000CU
+#define FDCAN_DLC_BYTES_32 			0x0000000DU
+#define FDCAN_DLC_BYTES_48 			0x0000000EU
+#define FDCAN_DLC_BYTES_64 			0x0000000FU
+
+#define FDCAN_RX_FIFO0 				0x00000040U
+#define FDCAN_RX_FIFO1 				0x00000041U
+
+#define FDCAN_ACCEPT_IN_RX_FIFO0 	0x00000000U
+#define FDCAN_ACCEPT_IN_RX_FIFO1 	0x00000001U
+#define FDCAN_REJECT 				0x00000002U
+#define FDCAN_FILTER_REMOTE 		0x00000000U
+#define FDCAN_REJECT_REMOTE 		0x00000001U
+#define FDCAN_REJECT_REMOTE_STD 	FDCAN_REJECT_REMOTE
+#define FDCAN_REJECT_REMOTE_EXT 	FDCAN_REJECT_REMOTE
+
+#define FDCAN_FILTER_RANGE 			0x00000000U
+#define FDCAN_FILTER_DUAL 			0x00000001U
+#define FDCAN_FILTER_MASK 			0x00000002U
+#define FDCAN_FILTER_DISABLE 		0x00000000U
+#define FDCAN_FILTER_TO_RXFIFO0 	0x00000001U
+#define FDCAN_FILTER_TO_RXFIFO1 	0x00000002U
+
+#define FDCAN_IT_RX_FIFO0_NEW_MESSAGE 	0x00000001U
+#define FDCAN_IT_RX_FIFO1_NEW_MESSAGE 	0x00000008U
+#define FDCAN_IT_TX_COMPLETE 		0x00000200U
+#define FDCAN_TX_BUFFER0 			0x00000001U
+#define FDCAN_TX_BUFFER1 			0x00000002U
+#define FDCAN_TX_BUFFER2 			0x00000004U
+
+#define FDCAN_FLAG_RX_FIFO0_MESSAGE_LOST 	0x00000004U
+#define FDCAN_FLAG_RX_FIFO1_MESSAGE_LOST 	0x00000020U
+
+#define __HAL_FDCAN_GET_FLAG(__HANDLE__, __FLAG__) 		(((__HANDLE__)->Instance->IR & (__FLAG__)) == (__FLAG__))
+#define __HAL_FDCAN_CLEAR_FLAG(__HANDLE__, __FLAG__) 	((__HANDLE__)->Instance->IR &= ~(__FLAG__))
+
+HAL_StatusTypeDef HAL_FDCAN_ConfigGlobalFilter(FDCAN_HandleTypeDef *hfdcan, uint32_t nonMatchingStd, uint32_t nonMatchingExt,
+											   uint32_t rejectRemoteStd, uint32_t rejectRemoteExt);
+HAL_StatusTypeDef HAL_FDCAN_ConfigFilter(FDCAN_HandleTypeDef *hfdcan, FDCAN_FilterTypeDef *filter);
+HAL_StatusTypeDef HAL_FDCAN_ActivateNotification(FDCAN_HandleTypeDef *hfdcan, uint32_t interrupts, uint32_t bufferIndexes);
+HAL_StatusTypeDef HAL_FDCAN_DeactivateNotification(FDCAN_HandleTypeDef *hfdcan, uint32_t interrupts);
+HAL_StatusTypeDef HAL_FDCAN_Start(FDCAN_HandleTypeDef *hfdcan);
+uint32_t HAL_FDCAN_GetTxFifoFreeLevel(FDCAN_HandleTypeDef *hfdcan);
+HAL_StatusTypeDef HAL_FDCAN_AddMessageToTxFifoQ(FDCAN_HandleTypeDef *hfdcan, FDCAN_TxHeaderTypeDef *header, uint8_t *data);
+uint32_t HAL_FDCAN_GetRxFifoFillLevel(FDCAN_HandleTypeDef *hfdcan, uint32_t fifo);
+HAL_StatusTypeDef HAL_FDCAN_GetRxMessage(FDCAN_HandleTypeDef *hfdcan, uint32_t fifo, FDCAN_RxHeaderTypeDef *header, uint8_t *data);
+
+#else
+
+/**
+ * bxCAN (F1: 14 filter banks per controller, 3 mailboxes, 3 elements per RX FIFO)
+ */
+
+typedef struct {
+	volatile uint32_t MCR;
+	volatile uint32_t MSR;
+	volatile uint32_t TSR;
+	volatile uint32_t RF0R;
+	volatile uint32_t RF1R;
+	volatile uint32_t IER;
+	volatile uint32_t ESR;
+	volatile uint32_t BTR;
+}CAN_TypeDef;
+
+typedef enum {
+	HAL_CAN_STATE_RESET = 0x00U,
+	HAL_CAN_STATE_READY = 0x01U,
+	HAL_CAN_STATE_LISTENING = 0x02U,
+	HAL_CAN_STATE_SLEEP_PENDING = 0x03U,
+	HAL_CAN_STATE_SLEEP_ACTIVE = 0x04U,
+	HAL_CAN_STATE_ERROR = 0x05U
+}HAL_CAN_StateTypeDef;
+
+typedef struct {
+	FunctionalState AutoBusOff;
+	FunctionalState TransmitFifoPriority;
+}CAN_InitTypeDef;
+
+typedef struct {
+	CAN_TypeDef 		*Instance;
+	CAN_InitTypeDef 	Init;
+	volatile HAL_CAN_StateTypeDef State;
+	volatile uint32_t 	ErrorCode;
+}CAN_HandleTypeDef;
+
+typedef struct {
+	uint32_t StdId;
+	uint32_t ExtId;
+	uint32_t IDE;
+	uint32_t RTR;
+	uint32_t DLC;
+	FunctionalState TransmitGlobalTime;
+}CAN_TxHeaderTypeDef;
+
+typedef struct {
+	uint32_t StdId;
+	uint32_t ExtId;
+	uint32_t IDE;
+	uint32_t RTR;
+	uint32_t DLC;
+	uint32_t Timestamp;
+	uint32_t FilterMatchIndex;
+}CAN_RxHeaderTypeDef;
+
+typedef struct {
+	uint32_t FilterIdHigh;
+	uint32_t FilterIdLow;
+	uint32_t FilterMaskIdHigh;
+	uint32_t FilterMaskIdLow;
+	uint32_t FilterFIFOAssignment;
+	uint32_t FilterBank;
+	uint32_t FilterMode;
+	uint32_t FilterScale;
+	uint32_t FilterActivation;
+	uint32_t SlaveStartFilterBank;
+}CAN_FilterTypeDef;
+
+#define CAN_ID_STD 					0x00000000U
+#define CAN_ID_EXT 					0x00000004U
+#define CAN_RTR_DATA 				0x00000000U
+#define CAN_RTR_REMOTE 				0x00000002U
+#define CAN_RX_FIFO0 				0x00000000U
+#define CAN_RX_FIFO1 				0x00000001U
+#define CAN_FILTER_FIFO0 			0x00000000U
+#define CAN_FILTER_FIFO1 			0x00000001U
+#define CAN_FILTERMODE_IDMASK 		0x00000000U
+#define CAN_FILTERMODE_IDLIST 		0x00000001U
+#define CAN_FILTERSCALE_16BIT 		0x00000000U
+#define CAN_FILTERSCALE_32BIT 		0x00000001U
+
+#define CAN_IT_TX_MAILBOX_EMPTY 	0x00000001U
+#define CAN_IT_RX_FIFO0_MSG_PENDING 0x00000002U
+#define CAN_IT_RX_FIFO1_MSG_PENDING 0x00000010U
+#define CAN_IT_ERROR_WARNING 		0x00000100U
+#define CAN_IT_ERROR_PASSIVE 		0x00000200U
+#define CAN_IT_BUSOFF 				0x00000400U
+#define CAN_IT_LAST_ERROR_CODE 		0x00000800U
+#define CAN_IT_ERROR 				0x00008000U
+
+#define CAN_FLAG_FOV0 				0x00000204U					// RF0R FOVR0
+#define CAN_FLAG_FOV1 				0x00000404U					// RF1R FOVR1
+
+#define CAN_MCR_INRQ 				0x00000001U
+#define CAN_MCR_TXFP 				0x00000004U
+#define CAN_MCR_ABOM 				0x00000040U
+#define CAN_ESR_EWGF 				0x00000001U
+#define CAN_ESR_EPVF 				0x00000002U
+#define CAN_ESR_BOFF 				0x00000004U
+#define CAN_ESR_LEC_Pos 			4U
+#define CAN_ESR_LEC 				(0x7U << CAN_ESR_LEC_Pos)
+#define CAN_ESR_TEC_Pos 			16U
+#define CAN_ESR_TEC 				(0xFFU << CAN_ESR_TEC_Pos)
+#define CAN_ESR_REC_Pos 			24U
+#define CAN_ESR_REC 				(0xFFU << CAN_ESR_REC_Pos)
+
+#define HAL_CAN_ERROR_NONE 			0x00000000U
+#define HAL_CAN_ERROR_NOT_STARTED 	0x00100000U
+
+#define __HAL_CAN_GET_FLAG(__HANDLE__, __FLAG__) 		HOST_CAN_GetFlag((__HANDLE__), (__FLAG__))
+#define __HAL_CAN_CLEAR_FLAG(__HANDLE__, __FLAG__) 		HOST_CAN_ClearFlag((__HANDLE__), (__FLAG__))
+
+uint32_t HOST_CAN_GetFlag(CAN_HandleTypeDef *hcan, uint32_t flag);
+void HOST_CAN_ClearFlag(CAN_HandleTypeDef *hcan, uint32_t flag);
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, const CAN_FilterTypeDef *filter);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t interrupts);
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef *hcan, uint32_t interrupts);
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan);
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(const CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, const CAN_TxHeaderTypeDef *header, const uint8_t data[],
+									   uint32_t *mailbox);
+uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef *hcan, uint32_t fifo);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t fifo, CAN_RxHeaderTypeDef *header, uint8_t data[]);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_MAIN_H_ */
@@ -0,0 +1,1258 @@
+/**
+  * @file hal_host.c
+  * @brief Simulated HAL for host builds of the drivers
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "hal_host.h"
+#include <string.h>
+
+#if defined(STM32G474xx)
+#define HOST_ID_STD 		FDCAN_STANDARD_ID				// same values as CAN_ID_STD / CAN_ID_EXT of can_driver.h
+#define HOST_ID_EXT 		FDCAN_EXTENDED_ID
+#else
+#define HOST_ID_STD 		CAN_ID_STD
+#define HOST_ID_EXT 		CAN_ID_EXT
+#endif
+
+/**
+ * Time and core
+ */
+
+static uint32_t HOST_Tick;
+static uint32_t HOST_Primask;
+static uint32_t HOST_ErrorHandlerCount;
+static uint32_t HOST_AssertCount;
+
+uint32_t HAL_GetTick(void)
+{
+	return HOST_Tick;
+}
+
+void HAL_Delay(uint32_t delay)
+{
+	HOST_Tick += delay + 1;								// HAL_Delay waits at least one full tick more
+}
+
+void Error_Handler(void)
+{
+	HOST_ErrorHandlerCount++;
+}
+
+void assert_failed(const char *file, int line)
+{
+	(void)file;
+	(void)line;
+	HOST_AssertCount++;
+}
+
+uint32_t __get_PRIMASK(void)
+{
+	return HOST_Primask;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+	HOST_Primask = primask;
+}
+
+void __disable_irq(void)
+{
+	HOST_Primask = 1;
+}
+
+void __enable_irq(void)
+{
+	HOST_Primask = 0;
+}
+
+void HOST_SetTick(uint32_t tick)
+{
+	HOST_Tick = tick;
+}
+
+void HOST_Advance(uint32_t ms)
+{
+	HOST_Tick += ms;
+}
+
+uint32_t HOST_ErrorHandlerCalls(void)
+{
+	return HOST_ErrorHandlerCount;
+}
+
+uint32_t HOST_AssertCalls(void)
+{
+	return HOST_AssertCount;
+}
+
+uint8_t HOST_IrqDisabled(void)
+{
+	return HOST_Primask != 0;
+}
+
+/**
+ * ADC
+ */
+
+#define HOST_ADC_QUEUE 		32
+
+typedef struct {
+	uint32_t 			*dma;							// buffer given to *_Start_DMA
+	uint32_t 			transfers;
+	uint32_t 			starts;
+	uint32_t 			values[HOST_ADC_QUEUE];			// results of single conversions
+	uint8_t 			valueHead;
+	uint8_t 			valueCount;
+}HOST_AdcState;
+
+ADC_TypeDef HOST_ADC1;
+ADC_TypeDef HOST_ADC2;
+ADC_TypeDef HOST_ADC3;
+static DMA_Channel_TypeDef HOST_AdcDma[3];
+static HOST_AdcState HOST_Adc[3];
+
+static uint8_t HOST_ADC_Index(const ADC_TypeDef *instance)
+{
+	return (instance == ADC1) ? 0 : (instance == ADC2) ? 1 : 2;
+}
+
+static HOST_AdcState* HOST_ADC_State(const ADC_HandleTypeDef *hadc)
+{
+	return &HOST_Adc[HOST_ADC_Index(hadc->Instance)];
+}
+
+void HOST_ADC_Setup(ADC_HandleTypeDef *hadc, ADC_TypeDef *instance, DMA_HandleTypeDef *dma, const uint8_t *channels, uint8_t count,
+					uint8_t circular)
+{
+	uint8_t index = HOST_ADC_Index(instance);
+
+	memset(&HOST_Adc[index], 0, sizeof(HOST_Adc[index]));			// peripheral after reset, DMA stopped
+	instance->SR = 0;
+	instance->CR2 = 0;
+	hadc->Instance = instance;
+	hadc->DMA_Handle = dma;
+	dma->Instance = &HOST_AdcDma[index];
+	dma->Instance->CCR = circular ? DMA_CCR_CIRC : 0;
+
+	instance->SQR1 = (uint32_t)(count - 1) << 20;
+	instance->SQR2 = 0;
+	instance->SQR3 = 0;
+
+	for(uint8_t i = 0; i < count; i++)
+	{
+		if(i < 6)
+			instance->SQR3 |= (uint32_t)channels[i] << (5 * i);
+		else if(i < 12)
+			instance->SQR2 |= (uint32_t)channels[i] << (5 * (i - 6));
+		else
+			instance->SQR1 |= (uint32_t)channels[i] << (5 * (i - 12));
+	}
+}
+
+void HOST_ADC_SetDual(uint8_t dual)
+{
+	ADC1->CR1 = (ADC1->CR1 & ~ADC_CR1_DUALMOD) | (dual ? (0x6U << ADC_CR1_DUALMOD_Pos) : 0);	// regular simultaneous
+}
+
+uint32_t* HOST_ADC_DmaBuffer(const ADC_HandleTypeDef *hadc, uint32_t *transfers)
+{
+	HOST_AdcState *adc = HOST_ADC_State(hadc);
+
+	if(transfers != NULL)
+		*transfers = adc->transfers;
+
+	return adc->dma;
+}
+
+uint32_t HOST_ADC_DmaStarts(const ADC_HandleTypeDef *hadc)
+{
+	return HOST_ADC_State(hadc)->starts;
+}
+
+void HOST_ADC_QueueValue(const ADC_HandleTypeDef *hadc, uint32_t value)
+{
+	HOST_AdcState *adc = HOST_ADC_State(hadc);
+
+	if(adc->valueCount < HOST_ADC_QUEUE)
+	{
+		adc->values[(adc->valueHead + adc->valueCount) % HOST_ADC_QUEUE] = value;
+		adc->valueCount++;
+	}
+}
+
+HAL_StatusTypeDef HAL_ADC_Start(ADC_HandleTypeDef *hadc)
+{
+	hadc->Instance->SR |= 1U << ADC_SR_STRT_Pos;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *data, uint32_t length)
+{
+	HOST_AdcState *adc = HOST_ADC_State(hadc);
+
+	if(adc->dma != NULL)									// DMA is already running
+		return HAL_BUSY;
+
+	adc->dma = data;
+	adc->transfers = length;
+	adc->starts++;
+	hadc->Instance->CR2 |= ADC_CR2_DMA;
+	return HAL_ADC_Start(hadc);
+}
+
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef *hadc)
+{
+	HOST_AdcState *adc = HOST_ADC_State(hadc);
+	uint32_t value = 0;
+
+	if(adc->valueCount > 0)
+	{
+		value = adc->values[adc->valueHead];
+		adc->valueHead = (adc->valueHead + 1) % HOST_ADC_QUEUE;
+		adc->valueCount--;
+	}
+
+	hadc->Instance->DR = value;
+	return value;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_MultiModeStart_DMA(ADC_HandleTypeDef *hadc, uint32_t *data, uint32_t length)
+{
+	// DMA of master transfers both results, slave keeps its DMA bit cleared
+	if(hadc->Instance != ADC1 || (ADC1->CR1 & ADC_CR1_DUALMOD) == 0)
+		return HAL_ERROR;
+
+	return HAL_ADC_Start_DMA(hadc, data, length);
+}
+
+uint32_t HAL_ADCEx_MultiModeGetValue(ADC_HandleTypeDef *hadc)
+{
+	ADC_HandleTypeDef master = {ADC1, NULL};
+
+	(void)hadc;
+	return HAL_ADC_GetValue(&master);
+}
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc)
+{
+	(void)hadc;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_InjectedStart_IT(ADC_HandleTypeDef *hadc)
+{
+	(void)hadc;
+	return HAL_OK;
+}
+
+/**
+ * TIM
+ */
+
+uint32_t HAL_TIM_ReadCapturedValue(TIM_HandleTypeDef *htim, uint32_t channel)
+{
+	switch(channel)
+	{
+	case TIM_CHANNEL_1: 	return htim->Instance->CCR1;
+	case TIM_CHANNEL_2: 	return htim->Instance->CCR2;
+	case TIM_CHANNEL_3: 	return htim->Instance->CCR3;
+	case TIM_CHANNEL_4: 	return htim->Instance->CCR4;
+	default: 				return 0;
+	}
+}
+
+/**
+ * CAN, shared by bxCAN and FDCAN models
+ */
+
+typedef struct {
+	uint8_t 			used;
+	uint32_t 			order;
+	HOST_CanFrame 		frame;
+}HOST_CanMailbox;
+
+typedef struct {
+	HOST_CanHandle 		*hcan;
+	uint8_t 			started;
+	uint32_t 			starts;
+	uint8_t 			failStarts;
+	uint32_t 			notifications;
+
+	HOST_CanMailbox 	mailbox[HOST_CAN_MAILBOXES];
+	uint32_t 			order;
+
+	HOST_CanFrame 		fifo[2][HOST_CAN_FIFO_DEPTH];
+	uint8_t 			fifoHead[2];
+	uint8_t 			fifoFill[2];
+	uint8_t 			overrun[2];
+	HOST_CanRxHook 		rxHook;
+
+#if defined(STM32G474xx)
+	FDCAN_FilterTypeDef stdFilter[HOST_FDCAN_STD_FILTERS];
+	FDCAN_FilterTypeDef extFilter[HOST_FDCAN_EXT_FILTERS];
+	uint32_t 			nonMatchingStd;
+	uint32_t 			nonMatchingExt;
+#else
+	CAN_FilterTypeDef 	filter[HOST_CAN_FILTER_BANKS];
+#endif
+}HOST_CanState;
+
+static HOST_CanState HOST_Can[2];
+
+static HOST_CanState* HOST_CAN_State(const HOST_CanHandle *hcan)
+{
+	for(uint8_t i = 0; i < 2; i++)
+	{
+		if(HOST_Can[i].hcan == hcan)
+			return &HOST_Can[i];
+	}
+
+	return &HOST_Can[0];
+}
+
+static uint32_t HOST_CAN_Priority(const HOST_CanFrame *frame)
+{
+	if(frame->ide == HOST_ID_STD)
+		return frame->id << 19;
+
+	return ((frame->id >> 18) << 19) | (1U << 18) | (frame->id & 0x3FFFF);
+}
+
+/**
+ * @brief	Stores frame in the RX FIFO chosen by acceptance filtering
+ * @retval	FIFO index, -1 when rejected, -2 when lost on overrun
+ */
+static int HOST_CAN_Store(HOST_CanState *can, int fifo, uint32_t ide, uint32_t id, const uint8_t *data, uint8_t length)
+{
+	if(fifo < 0)
+		return -1;
+
+	if(can->fifoFill[fifo] >= HOST_CAN_FIFO_DEPTH)
+	{
+		can->overrun[fifo] = 1;
+		return -2;
+	}
+
+	HOST_CanFrame *frame = &can->fifo[fifo][(can->fifoHead[fifo] + can->fifoFill[fifo]) % HOST_CAN_FIFO_DEPTH];
+	frame->ide = ide;
+	frame->id = id;
+	frame->length = length;
+	frame->tick = HOST_Tick;
+	memset(frame->data, 0, sizeof(frame->data));
+	memcpy(frame->data, data, length);
+	can->fifoFill[fifo]++;
+
+	return fifo;
+}
+
+static HOST_CanFrame* HOST_CAN_Take(HOST_CanState *can, uint32_t fifo)
+{
+	if(fifo > 1 || can->fifoFill[fifo] == 0)
+		return NULL;
+
+	HOST_CanFrame *frame = &can->fifo[fifo][can->fifoHead[fifo]];
+	can->fifoHead[fifo] = (can->fifoHead[fifo] + 1) % HOST_CAN_FIFO_DEPTH;
+	can->fifoFill[fifo]--;
+	return frame;
+}
+
+static HAL_StatusTypeDef HOST_CAN_Queue(HOST_CanState *can, uint32_t ide, uint32_t id, const uint8_t *data, uint8_t length,
+										uint32_t *mailbox)
+{
+	for(uint8_t i = 0; i < HOST_CAN_MAILBOXES; i++)
+	{
+		if(can->mailbox[i].used)
+			continue;
+
+		can->mailbox[i].used = 1;
+		can->mailbox[i].order = can->order++;
+		can->mailbox[i].frame.ide = ide;
+		can->mailbox[i].frame.id = id;
+		can->mailbox[i].frame.length = length;
+		memset(can->mailbox[i].frame.data, 0, sizeof(can->mailbox[i].frame.data));
+		memcpy(can->mailbox[i].frame.data, data, length);
+		if(mailbox != NULL)
+			*mailbox = 1U << i;
+		return HAL_OK;
+	}
+
+	return HAL_ERROR;
+}
+
+static uint8_t HOST_CAN_FreeMailboxes(const HOST_CanState *can)
+{
+	uint8_t free = 0;
+
+	for(uint8_t i = 0; i < HOST_CAN_MAILBOXES; i++)
+		free += !can->mailbox[i].used;
+
+	return free;
+}
+
+/**
+ * @brief	Sends one pending mailbox, fifoOrder - oldest first, otherwise lowest arbitration key first
+ */
+static uint8_t HOST_CAN_Send(HOST_CanState *can, uint8_t fifoOrder, HOST_CanFrame *frame)
+{
+	int best = -1;
+
+	for(uint8_t i = 0; i < HOST_CAN_MAILBOXES; i++)
+	{
+		if(!can->mailbox[i].used)
+			continue;
+
+		if(best < 0)
+			best = i;
+		else if(fifoOrder ? (int32_t)(can->mailbox[i].order - can->mailbox[best].order) < 0
+						  : HOST_CAN_Priority(&can->mailbox[i].frame) < HOST_CAN_Priority(&can->mailbox[best].frame))
+			best = i;
+	}
+
+	if(best < 0)
+		return 0;
+
+	can->mailbox[best].used = 0;
+	can->mailbox[best].frame.tick = HOST_Tick;
+	if(frame != NULL)
+		*frame = can->mailbox[best].frame;
+	return 1;
+}
+
+void HOST_CAN_Setup(HOST_CanHandle *hcan, void *instance)
+{
+	HOST_CanState *can = &HOST_Can[(HOST_Can[0].hcan == NULL || HOST_Can[0].hcan == hcan) ? 0 : 1];
+
+	memset(can, 0, sizeof(*can));
+	memset(instance, 0, sizeof(*hcan->Instance));
+	can->hcan = hcan;
+	hcan->Instance = instance;
+
+#if defined(STM32G474xx)
+	hcan->Init.StdFiltersNbr = HOST_FDCAN_STD_FILTERS;
+	hcan->Init.ExtFiltersNbr = HOST_FDCAN_EXT_FILTERS;
+#else
+	hcan->State = HAL_CAN_STATE_READY;
+	hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+	hcan->Instance->MCR = CAN_MCR_INRQ | (hcan->Init.TransmitFifoPriority ? CAN_MCR_TXFP : 0)
+						  | (hcan->Init.AutoBusOff ? CAN_MCR_ABOM : 0);
+#endif
+}
+
+uint8_t HOST_CAN_PendingMailboxes(HOST_CanHandle *hcan)
+{
+	return HOST_CAN_MAILBOXES - HOST_CAN_FreeMailboxes(HOST_CAN_State(hcan));
+}
+
+uint8_t HOST_CAN_Started(HOST_CanHandle *hcan)
+{
+	return HOST_CAN_State(hcan)->started;
+}
+
+uint32_t HOST_CAN_Notifications(HOST_CanHandle *hcan)
+{
+	return HOST_CAN_State(hcan)->notifications;
+}
+
+uint32_t HOST_CAN_Starts(HOST_CanHandle *hcan)
+{
+	return HOST_CAN_State(hcan)->starts;
+}
+
+void HOST_CAN_FailStarts(HOST_CanHandle *hcan, uint8_t count)
+{
+	HOST_CAN_State(hcan)->failStarts = count;
+}
+
+void HOST_CAN_SetRxHook(HOST_CanHandle *hcan, HOST_CanRxHook hook)
+{
+	HOST_CAN_State(hcan)->rxHook = hook;
+}
+
+/**
+ * @brief	Runs the hook after a frame was copied out of the FIFO, like an interrupt between two reads of a drain
+ */
+static void HOST_CAN_AfterRead(HOST_CanHandle *hcan, uint32_t fifo)
+{
+	HOST_CanRxHook hook = HOST_CAN_State(hcan)->rxHook;
+
+	if(hook != NULL)
+		hook(hcan, fifo);
+}
+
+#if defined(STM32G474xx)
+
+/**
+ * FDCAN model
+ */
+
+static const uint8_t HOST_FdcanLength[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+static uint32_t HOST_FDCAN_Code(uint8_t length)
+{
+	for(uint32_t i = 0; i < 16; i++)
+	{
+		if(HOST_FdcanLength[i] >= length)
+			return i;
+	}
+
+	return 15;
+}
+
+static uint8_t HOST_FDCAN_FilterMatch(const FDCAN_FilterTypeDef *filter, uint32_t id)
+{
+	switch(filter->FilterType)
+	{
+	case FDCAN_FILTER_RANGE: 	return id >= filter->FilterID1 && id <= filter->FilterID2;
+	case FDCAN_FILTER_DUAL: 	return id == filter->FilterID1 || id == filter->FilterID2;
+	case FDCAN_FILTER_MASK: 	return (id & filter->FilterID2) == (filter->FilterID1 & filter->FilterID2);
+	default: 					return 0;
+	}
+}
+
+/**
+ * @brief	Elements are checked in index order, the first matching enabled element decides
+ */
+static int HOST_FDCAN_Accept(const HOST_CanState *can, uint32_t ide, uint32_t id)
+{
+	const FDCAN_FilterTypeDef *filters = (ide == HOST_ID_EXT) ? can->extFilter : can->stdFilter;
+	uint8_t count = (ide == HOST_ID_EXT) ? HOST_FDCAN_EXT_FILTERS : HOST_FDCAN_STD_FILTERS;
+	uint32_t nonMatching = (ide == HOST_ID_EXT) ? can->nonMatchingExt : can->nonMatchingStd;
+
+	for(uint8_t i = 0; i < count; i++)
+	{
+		if(filters[i].FilterConfig == FDCAN_FILTER_DISABLE || !HOST_FDCAN_FilterMatch(&filters[i], id))
+			continue;
+
+		if(filters[i].FilterConfig == FDCAN_FILTER_TO_RXFIFO0)
+			return 0;
+		if(filters[i].FilterConfig == FDCAN_FILTER_TO_RXFIFO1)
+			return 1;
+		return -1;
+	}
+
+	if(nonMatching == FDCAN_ACCEPT_IN_RX_FIFO0)
+		return 0;
+	if(nonMatching == FDCAN_ACCEPT_IN_RX_FIFO1)
+		return 1;
+	return -1;
+}
+
+int HOST_CAN_Deliver(HOST_CanHandle *hcan, uint32_t ide, uint32_t id, const uint8_t *data, uint8_t length)
+{
+	HOST_CanState *can = HOST_CAN_State(hcan);
+
+	if(!can->started)
+		return -1;
+
+	length = HOST_FdcanLength[HOST_FDCAN_Code(length)];
+	int fifo = HOST_CAN_Store(can, HOST_FDCAN_Accept(can, ide, id), ide, id, data, length);
+	if(fifo == -2)
+		hcan->Instance->IR |= can->overrun[0] ? FDCAN_FLAG_RX_FIFO0_MESSAGE_LOST : 0;
+	if(fifo == -2)
+		hcan->Instance->IR |= can->overrun[1] ? FDCAN_FLAG_RX_FIFO1_MESSAGE_LOST : 0;
+	can->overrun[0] = can->overrun[1] = 0;
+
+	return fifo;
+}
+
+uint8_t HOST_CAN_CompleteMailbox(HOST_CanHandle *hcan, HOST_CanFrame *frame)
+{
+	return HOST_CAN_Send(HOST_CAN_State(hcan), 1, frame);			// TX FIFO mode
+}
+
+uint32_t HOST_CAN_ActiveFilters(HOST_CanHandle *hcan)
+{
+	HOST_CanState *can = HOST_CAN_State(hcan);
+	uint32_t active = 0;
+
+	for(uint8_t i = 0; i < HOST_FDCAN_STD_FILTERS; i++)
+		active += can->stdFilter[i].FilterConfig != FDCAN_FILTER_DISABLE;
+	for(uint8_t i = 0; i < HOST_FDCAN_EXT_FILTERS; i++)
+		active += can->extFilter[i].FilterConfig != FDCAN_FILTER_DISABLE;
+
+	return active;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_ConfigGlobalFilter(FDCAN_HandleTypeDef *hfdcan, uint32_t nonMatchingStd, uint32_t nonMatchingExt,
+											   uint32_t rejectRemoteStd, uint32_t rejectRemoteExt)
+{
+	HOST_CanState *can = HOST_CAN_State(hfdcan);
+
+	(void)rejectRemoteStd;
+	(void)rejectRemoteExt;
+	can->nonMatchingStd = nonMatchingStd;
+	can->nonMatchingExt = nonMatchingExt;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_ConfigFilter(FDCAN_HandleTypeDef *hfdcan, FDCAN_FilterTypeDef *filter)
+{
+	HOST_CanState *can = HOST_CAN_State(hfdcan);
+
+	if(filter->IdType == FDCAN_STANDARD_ID && filter->FilterIndex < HOST_FDCAN_STD_FILTERS)
+		can->stdFilter[filter->FilterIndex] = *filter;
+	else if(filter->IdType == FDCAN_EXTENDED_ID && filter->FilterIndex < HOST_FDCAN_EXT_FILTERS)
+		can->extFilter[filter->FilterIndex] = *filter;
+	else
+		return HAL_ERROR;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_ActivateNotification(FDCAN_HandleTypeDef *hfdcan, uint32_t interrupts, uint32_t bufferIndexes)
+{
+	(void)bufferIndexes;
+	HOST_CAN_State(hfdcan)->notifications |= interrupts;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_DeactivateNotification(FDCAN_HandleTypeDef *hfdcan, uint32_t interrupts)
+{
+	HOST_CAN_State(hfdcan)->notifications &= ~interrupts;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_Start(FDCAN_HandleTypeDef *hfdcan)
+{
+	HOST_CanState *can = HOST_CAN_State(hfdcan);
+
+	if(can->started)
+		return HAL_ERROR;
+
+	can->started = 1;
+	can->starts++;
+	return HAL_OK;
+}
+
+uint32_t HAL_FDCAN_GetTxFifoFreeLevel(FDCAN_HandleTypeDef *hfdcan)
+{
+	return HOST_CAN_FreeMailboxes(HOST_CAN_State(hfdcan));
+}
+
+HAL_StatusTypeDef HAL_FDCAN_AddMessageToTxFifoQ(FDCAN_HandleTypeDef *hfdcan, FDCAN_TxHeaderTypeDef *header, uint8_t *data)
+{
+	HOST_CanState *can = HOST_CAN_State(hfdcan);
+	if(!can->started || header->DataLength > FDCAN_DLC_BYTES_64)
+		return HAL_ERROR;
+
+	return HOST_CAN_Queue(can, header->IdType, header->Identifier, data, HOST_FdcanLength[header->DataLength], NULL);
+}
+
+uint32_t HAL_FDCAN_GetRxFifoFillLevel(FDCAN_HandleTypeDef *hfdcan, uint32_t fifo)
+{
+	return HOST_CAN_State(hfdcan)->fifoFill[(fifo == FDCAN_RX_FIFO1) ? 1 : 0];
+}
+
+HAL_StatusTypeDef HAL_FDCAN_GetRxMessage(FDCAN_HandleTypeDef *hfdcan, uint32_t fifo, FDCAN_RxHeaderTypeDef *header, uint8_t *data)
+{
+	HOST_CanFrame *frame = HOST_CAN_Take(HOST_CAN_State(hfdcan), (fifo == FDCAN_RX_FIFO1) ? 1 : (fifo == FDCAN_RX_FIFO0) ? 0 : 2);
+
+	if(frame == NULL)
+		return HAL_ERROR;
+
+	memset(header, 0, sizeof(*header));
+	header->Identifier = frame->id;
+	header->IdType = frame->ide;
+	header->DataLength = HOST_FDCAN_Code(frame->length);
+	header->FDFormat = (frame->length > 8) ? FDCAN_FD_CAN : FDCAN_CLASSIC_CAN;
+	header->RxTimestamp = frame->tick;
+	memcpy(data, frame->data, frame->length);
+	HOST_CAN_AfterRead(hfdcan, (fifo == FDCAN_RX_FIFO1) ? 1 : 0);
+	return HAL_OK;
+}
+
+#else
+
+/**
+ * bxCAN model
+ */
+
+/**
+ * @brief	Checks frame against one bank, 32-bit word: STID[31:21] EXID[20:3] IDE[2] RTR[1],
+ * 			16-bit slot: STID[15:5] RTR[4] IDE[3] EXID[17:15]
+ */
+static uint8_t HOST_CAN_FilterMatch(const CAN_FilterTypeDef *filter, uint32_t ide, uint32_t id)
+{
+	uint32_t word = (ide == HOST_ID_EXT) ? ((id << 3) | HOST_ID_EXT) : (id << 21);
+	uint32_t slot = (ide == HOST_ID_EXT) ? ((((id >> 18) & 0x7FF) << 5) | 0x08 | ((id >> 15) & 0x7)) : ((id & 0x7FF) << 5);
+
+	if(filter->FilterScale == CAN_FILTERSCALE_32BIT)
+	{
+		uint32_t fr1 = (filter->FilterIdHigh << 16) | (filter->FilterIdLow & 0xFFFF);
+		uint32_t fr2 = (filter->FilterMaskIdHigh << 16) | (filter->FilterMaskIdLow & 0xFFFF);
+
+		if(filter->FilterMode == CAN_FILTERMODE_IDMASK)
+			return ((word ^ fr1) & fr2) == 0;
+		return word == fr1 || word == fr2;
+	}
+
+	if(filter->FilterMode == CAN_FILTERMODE_IDMASK)
+		return ((slot ^ filter->FilterIdLow) & filter->FilterMaskIdLow & 0xFFFF) == 0
+			|| ((slot ^ filter->FilterIdHigh) & filter->FilterMaskIdHigh & 0xFFFF) == 0;
+
+	return slot == filter->FilterIdLow || slot == filter->FilterMaskIdLow
+		|| slot == filter->FilterIdHigh || slot == filter->FilterMaskIdHigh;
+}
+
+/**
+ * @brief	Matching bank of the highest priority decides: 32-bit before 16-bit, list before mask, lower bank first
+ */
+static int HOST_CAN_Accept(const HOST_CanState *can, uint32_t ide, uint32_t id)
+{
+	int best = -1;
+	uint8_t bestRank = 0xFF;
+
+	for(uint8_t i = 0; i < HOST_CAN_FILTER_BANKS; i++)
+	{
+		const CAN_FilterTypeDef *filter = &can->filter[i];
+
+		if(filter->FilterActivation != ENABLE || !HOST_CAN_FilterMatch(filter, ide, id))
+			continue;
+
+		uint8_t rank = ((filter->FilterScale == CAN_FILTERSCALE_32BIT) ? 0 : 2) + ((filter->FilterMode == CAN_FILTERMODE_IDLIST) ? 0 : 1);
+		if(rank < bestRank)
+		{
+			bestRank = rank;
+			best = (int)filter->FilterFIFOAssignment;
+		}
+	}
+
+	return best;
+}
+
+int HOST_CAN_Deliver(HOST_CanHandle *hcan, uint32_t ide, uint32_t id, const uint8_t *data, uint8_t length)
+{
+	HOST_CanState *can = HOST_CAN_State(hcan);
+
+	if(!can->started || length > 8)
+		return -1;
+
+	return HOST_CAN_Store(can, HOST_CAN_Accept(can, ide, id), ide, id, data, length);
+}
+
+uint8_t HOST_CAN_CompleteMailbox(HOST_CanHandle *hcan, HOST_CanFrame *frame)
+{
+	return HOST_CAN_Send(HOST_CAN_State(hcan), (hcan->Instance->MCR & CAN_MCR_TXFP) != 0, frame);
+}
+
+uint32_t HOST_CAN_ActiveFilters(HOST_CanHandle *hcan)
+{
+	HOST_CanState *can = HOST_CAN_State(hcan);
+	uint32_t active = 0;
+
+	for(uint8_t i = 0; i < HOST_CAN_FILTER_BANKS; i++)
+		active += can->filter[i].FilterActivation == ENABLE;
+
+	return active;
+}
+
+uint32_t HOST_CAN_GetFlag(CAN_HandleTypeDef *hcan, uint32_t flag)
+{
+	return HOST_CAN_State(hcan)->overrun[(flag == CAN_FLAG_FOV1) ? 1 : 0];
+}
+
+void HOST_CAN_ClearFlag(CAN_HandleTypeDef *hcan, uint32_t flag)
+{
+	HOST_CAN_State(hcan)->overrun[(flag == CAN_FLAG_FOV1) ? 1 : 0] = 0;
+}
+
+HAL_StatusTypeDef HAL_CAN_Init(CAN_HandleTypeDef *hcan)
+{
+	HOST_CanState *can = HOST_CAN_State(hcan);
+
+	can->started = 0;
+	for(uint8_t i = 0; i < HOST_CAN_MAILBOXES; i++)
+		can->mailbox[i].used = 0;
+
+	hcan->Instance->MCR = CAN_MCR_INRQ | (hcan->Init.TransmitFifoPriority ? CAN_MCR_TXFP : 0)
+						  | (hcan->Init.AutoBusOff ? CAN_MCR_ABOM : 0);
+	hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+	hcan->State = HAL_CAN_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, const CAN_FilterTypeDef *filter)
+{
+	if(filter->FilterBank >= HOST_CAN_FILTER_BANKS)
+		return HAL_ERROR;
+
+	HOST_CAN_State(hcan)->filter[filter->FilterBank] = *filter;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t interrupts)
+{
+	HOST_CAN_State(hcan)->notifications |= interrupts;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_DeactivateNotification(CAN_HandleTypeDef *hcan, uint32_t interrupts)
+{
+	HOST_CAN_State(hcan)->notifications &= ~interrupts;
+	return HAL_OK;
+}
+
+/**
+ * @brief	Leaving initialization mode waits for 11 recessive bits, a failed wait leaves HAL in error state
+ */
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan)
+{
+	HOST_CanState *can = HOST_CAN_State(hcan);
+
+	if(hcan->State != HAL_CAN_STATE_READY)
+	{
+		hcan->ErrorCode |= HAL_CAN_ERROR_NOT_STARTED;
+		return HAL_ERROR;
+	}
+
+	if(can->failStarts > 0)
+	{
+		HOST_Tick += 10;								// CAN_TIMEOUT_VALUE of the INAK wait
+		can->failStarts--;
+		hcan->State = HAL_CAN_STATE_ERROR;
+		return HAL_ERROR;
+	}
+
+	hcan->Instance->MCR &= ~CAN_MCR_INRQ;
+	hcan->Instance->ESR &= ~(CAN_ESR_BOFF | CAN_ESR_EPVF | CAN_ESR_EWGF | CAN_ESR_TEC | CAN_ESR_REC);
+	hcan->State = HAL_CAN_STATE_LISTENING;
+	can->started = 1;
+	can->starts++;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Stop(CAN_HandleTypeDef *hcan)
+{
+	HOST_CanState *can = HOST_CAN_State(hcan);
+
+	if(hcan->State != HAL_CAN_STATE_LISTENING)
+	{
+		hcan->ErrorCode |= HAL_CAN_ERROR_NOT_STARTED;
+		return HAL_ERROR;
+	}
+
+	hcan->Instance->MCR |= CAN_MCR_INRQ;
+	hcan->State = HAL_CAN_STATE_READY;
+	can->started = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan)
+{
+	hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+	return HAL_OK;
+}
+
+uint32_t HAL_CAN_GetTxMailboxesFreeLevel(const CAN_HandleTypeDef *hcan)
+{
+	return HOST_CAN_FreeMailboxes(HOST_CAN_State(hcan));
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, const CAN_TxHeaderTypeDef *header, const uint8_t data[],
+									   uint32_t *mailbox)
+{
+	HOST_CanState *can = HOST_CAN_State(hcan);
+	uint32_t id = (header->IDE == HOST_ID_EXT) ? header->ExtId : header->StdId;
+
+	if(!can->started || header->DLC > 8)
+		return HAL_ERROR;
+
+	return HOST_CAN_Queue(can, header->IDE, id, data, (uint8_t)header->DLC, mailbox);
+}
+
+uint32_t HAL_CAN_GetRxFifoFillLevel(const CAN_HandleTypeDef *hcan, uint32_t fifo)
+{
+	return HOST_CAN_State(hcan)->fifoFill[(fifo == CAN_RX_FIFO1) ? 1 : 0];
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t fifo, CAN_RxHeaderTypeDef *header, uint8_t data[])
+{
+	HOST_CanFrame *frame = HOST_CAN_Take(HOST_CAN_State(hcan), fifo);
+
+	if(frame == NULL)
+		return HAL_ERROR;
+
+	header->IDE = frame->ide;
+	header->StdId = (frame->ide == HOST_ID_STD) ? frame->id : 0;
+	header->ExtId = (frame->ide == HOST_ID_EXT) ? frame->id : 0;
+	header->RTR = CAN_RTR_DATA;
+	header->DLC = frame->length;
+	header->Timestamp = frame->tick;
+	header->FilterMatchIndex = 0;
+	memcpy(data, frame->data, frame->length);
+	HOST_CAN_AfterRead(hcan, fifo);
+	return HAL_OK;
+}
+
+#endif
+
+/**
+ * I2C
+ */
+
+#define HOST_I2C_SLAVES 	4
+
+typedef enum {
+	HOST_I2C_IDLE = 0,
+	HOST_I2C_WRITE,
+	HOST_I2C_READ,
+	HOST_I2C_MEM_READ,
+	HOST_I2C_ABORT
+}HOST_I2C_Operation;
+
+typedef struct {
+	I2C_HandleTypeDef 	*hi2c;
+	HOST_I2C_Slave 		*slaves[HOST_I2C_SLAVES];
+	uint8_t 			slaveCount;
+
+	HOST_I2C_Operation 	operation;
+	uint16_t 			address;
+	uint8_t 			*data;
+	uint16_t 			size;
+	uint16_t 			memAddress;
+	uint8_t 			memBytes;
+	uint32_t 			begin;							// tick of the START, a hanging slave holds the bus since then
+
+	uint32_t 			starts;
+	uint32_t 			busyRejects;					// starts refused with HAL_BUSY, e.g. during abort
+	uint32_t 			resets;							// HAL_I2C_DeInit calls
+	uint64_t 			busyUs;							// time the bus was not free, see HOST_I2C_BusyUs
+}HOST_I2CState;
+
+static HOST_I2CState HOST_I2C[2];
+
+static HOST_I2CState* HOST_I2C_State(I2C_HandleTypeDef *hi2c)
+{
+	for(uint8_t i = 0; i < 2; i++)
+	{
+		if(HOST_I2C[i].hi2c == hi2c)
+			return &HOST_I2C[i];
+	}
+
+	for(uint8_t i = 0; i < 2; i++)
+	{
+		if(HOST_I2C[i].hi2c == NULL)
+		{
+			HOST_I2C[i].hi2c = hi2c;
+			hi2c->State = HAL_I2C_STATE_READY;
+			hi2c->Mode = HAL_I2C_MODE_NONE;
+			return &HOST_I2C[i];
+		}
+	}
+
+	return &HOST_I2C[0];
+}
+
+static HOST_I2C_Slave* HOST_I2C_Find(HOST_I2CState *bus, uint16_t address)
+{
+	for(uint8_t i = 0; i < bus->slaveCount; i++)
+	{
+		if((bus->slaves[i]->address & 0xFE) == (address & 0xFE))
+			return bus->slaves[i];
+	}
+
+	return NULL;
+}
+
+static HAL_StatusTypeDef HOST_I2C_Begin(I2C_HandleTypeDef *hi2c, HOST_I2C_Operation operation, uint16_t address, uint8_t *data,
+										uint16_t size, uint16_t memAddress, uint8_t memBytes)
+{
+	HOST_I2CState *bus = HOST_I2C_State(hi2c);
+
+	if(hi2c->State != HAL_I2C_STATE_READY)
+	{
+		bus->busyRejects++;
+		return HAL_BUSY;
+	}
+
+	bus->operation = operation;
+	bus->address = address;
+	bus->data = data;
+	bus->size = size;
+	bus->memAddress = memAddress;
+	bus->memBytes = memBytes;
+	bus->begin = HOST_Tick;
+	bus->starts++;
+	hi2c->State = (operation == HOST_I2C_WRITE) ? HAL_I2C_STATE_BUSY_TX : HAL_I2C_STATE_BUSY_RX;
+	hi2c->Mode = (operation == HOST_I2C_MEM_READ) ? HAL_I2C_MODE_MEM : HAL_I2C_MODE_MASTER;
+	return HAL_OK;
+}
+
+/**
+ * @brief	Bus time of a finished transfer: START, address and data bytes with ACK, STOP and the bus free time after it,
+ * 			Mem_Read adds the register address and the repeated start
+ */
+static void HOST_I2C_Finished(HOST_I2CState *bus, uint8_t nack)
+{
+	uint32_t bits = 2 + 9;
+
+	if(!nack)
+	{
+		bits += 9U * bus->size;
+		if(bus->operation == HOST_I2C_MEM_READ)
+			bits += 1 + 9U * (1 + bus->memBytes);
+	}
+
+	bus->busyUs += bits * HOST_I2C_BIT_US + HOST_I2C_BUF_US;
+}
+
+/**
+ * @brief	Slave which holds SCL keeps the bus busy from the START until the master gives up
+ */
+static void HOST_I2C_Held(HOST_I2CState *bus)
+{
+	bus->busyUs += (uint64_t)(HOST_Tick - bus->begin) * 1000U;
+}
+
+static void HOST_I2C_Read(HOST_I2C_Slave *slave, uint8_t *data, uint16_t size)
+{
+	for(uint16_t i = 0; i < size; i++)
+	{
+		data[i] = slave->memory[slave->pointer % HOST_I2C_MEMORY];
+		slave->pointer = (slave->pointer + 1) % HOST_I2C_MEMORY;
+	}
+}
+
+void HOST_I2C_Attach(I2C_HandleTypeDef *hi2c, HOST_I2C_Slave *slave)
+{
+	HOST_I2CState *bus = HOST_I2C_State(hi2c);
+
+	if(bus->slaveCount < HOST_I2C_SLAVES)
+		bus->slaves[bus->slaveCount++] = slave;
+}
+
+/**
+ * @brief	Runs the pending transfer against the addressed slave, every transfer ends with STOP
+ */
+HOST_I2C_Event HOST_I2C_Process(I2C_HandleTypeDef *hi2c)
+{
+	HOST_I2CState *bus = HOST_I2C_State(hi2c);
+	HOST_I2C_Slave *slave = HOST_I2C_Find(bus, bus->address);
+	HOST_I2C_Operation operation = bus->operation;
+
+	if(operation == HOST_I2C_IDLE)
+		return HOST_I2C_NONE;
+
+	if(operation == HOST_I2C_ABORT)
+	{
+		HOST_I2C_Held(bus);
+		bus->operation = HOST_I2C_IDLE;
+		hi2c->State = HAL_I2C_STATE_READY;
+		hi2c->Mode = HAL_I2C_MODE_NONE;
+		return HOST_I2C_ABORTED;
+	}
+
+	if(slave != NULL && slave->hang)
+		return HOST_I2C_NONE;
+
+	HOST_I2C_Finished(bus, slave == NULL || (int32_t)(HOST_Tick - slave->busyUntil) < 0);
+	bus->operation = HOST_I2C_IDLE;
+	hi2c->State = HAL_I2C_STATE_READY;
+	hi2c->Mode = HAL_I2C_MODE_NONE;
+
+	if(slave == NULL || (int32_t)(HOST_Tick - slave->busyUntil) < 0)
+	{
+		if(slave != NULL)
+			slave->nacks++;
+		return HOST_I2C_NACK;
+	}
+
+	slave->transfers++;
+	slave->stops++;
+
+	switch(operation)
+	{
+	case HOST_I2C_WRITE:
+	{
+		uint16_t i = 0;
+
+		if(bus->size >= slave->addressBytes)
+		{
+			slave->pointer = 0;
+			for(; i < slave->addressBytes; i++)
+				slave->pointer = (uint16_t)((slave->pointer << 8) | bus->data[i]);
+			slave->pointer %= HOST_I2C_MEMORY;
+		}
+
+		for(; i < bus->size; i++)
+		{
+			slave->memory[slave->pointer] = bus->data[i];
+			slave->pointer = (slave->pointer + 1) % HOST_I2C_MEMORY;
+		}
+
+		if(slave->eeprom && bus->size > slave->addressBytes)	// internal write cycle starts at STOP
+			slave->busyUntil = HOST_Tick + slave->writeCycle;
+
+		return HOST_I2C_TX_DONE;
+	}
+	case HOST_I2C_MEM_READ:
+		slave->pointer = bus->memAddress % HOST_I2C_MEMORY;		// repeated start, no STOP after the address
+		HOST_I2C_Read(slave, bus->data, bus->size);
+		return HOST_I2C_RX_DONE;
+	default:
+		HOST_I2C_Read(slave, bus->data, bus->size);
+		return HOST_I2C_RX_DONE;
+	}
+}
+
+uint8_t HOST_I2C_Pending(I2C_HandleTypeDef *hi2c)
+{
+	return HOST_I2C_State(hi2c)->operation != HOST_I2C_IDLE;
+}
+
+uint32_t HOST_I2C_Starts(I2C_HandleTypeDef *hi2c)
+{
+	return HOST_I2C_State(hi2c)->starts;
+}
+
+uint32_t HOST_I2C_BusyRejects(I2C_HandleTypeDef *hi2c)
+{
+	return HOST_I2C_State(hi2c)->busyRejects;
+}
+
+uint32_t HOST_I2C_Resets(I2C_HandleTypeDef *hi2c)
+{
+	return HOST_I2C_State(hi2c)->resets;
+}
+
+uint64_t HOST_I2C_BusyUs(I2C_HandleTypeDef *hi2c)
+{
+	return HOST_I2C_State(hi2c)->busyUs;
+}
+
+/**
+ * @brief	Blocking transfers run the model at once, a hanging slave costs the whole timeout
+ */
+static HAL_StatusTypeDef HOST_I2C_Blocking(I2C_HandleTypeDef *hi2c, HOST_I2C_Operation operation, uint16_t address, uint8_t *data,
+										   uint16_t size, uint32_t timeout)
+{
+	HAL_StatusTypeDef status = HOST_I2C_Begin(hi2c, operation, address, data, size, 0, 0);
+
+	if(status != HAL_OK)
+		return status;
+
+	switch(HOST_I2C_Process(hi2c))
+	{
+	case HOST_I2C_TX_DONE:
+	case HOST_I2C_RX_DONE:
+		return HAL_OK;
+	case HOST_I2C_NONE:
+		HOST_Tick += timeout;
+		HOST_I2C_Held(HOST_I2C_State(hi2c));
+		HOST_I2C_State(hi2c)->operation = HOST_I2C_IDLE;
+		hi2c->State = HAL_I2C_STATE_READY;
+		hi2c->Mode = HAL_I2C_MODE_NONE;
+		return HAL_TIMEOUT;
+	default:
+		return HAL_ERROR;
+	}
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size, uint32_t timeout)
+{
+	return HOST_I2C_Blocking(hi2c, HOST_I2C_WRITE, address, data, size, timeout);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size, uint32_t timeout)
+{
+	return HOST_I2C_Blocking(hi2c, HOST_I2C_READ, address, data, size, timeout);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size)
+{
+	return HOST_I2C_Begin(hi2c, HOST_I2C_WRITE, address, data, size, 0, 0);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size)
+{
+	return HOST_I2C_Begin(hi2c, HOST_I2C_READ, address, data, size, 0, 0);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size)
+{
+	if(size == 0)
+		return HAL_ERROR;
+
+	return HOST_I2C_Begin(hi2c, HOST_I2C_WRITE, address, data, size, 0, 0);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t address, uint8_t *data, uint16_t size)
+{
+	if(size == 0)
+		return HAL_ERROR;
+
+	return HOST_I2C_Begin(hi2c, HOST_I2C_READ, address, data, size, 0, 0);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t address, uint16_t memAddress, uint16_t memSize,
+									  uint8_t *data, uint16_t size)
+{
+	return HOST_I2C_Begin(hi2c, HOST_I2C_MEM_READ, address, data, size, memAddress, (memSize == I2C_MEMADD_SIZE_16BIT) ? 2 : 1);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t address, uint16_t memAddress, uint16_t memSize,
+									   uint8_t *data, uint16_t size)
+{
+	return HAL_I2C_Mem_Read_IT(hi2c, address, memAddress, memSize, data, size);
+}
+
+/**
+ * @brief	Abort is asynchronous: handle stays busy until HAL_I2C_AbortCpltCallback (HOST_I2C_ABORTED)
+ * 			Like F1/F4 HAL only master transfers are aborted, Mem_Read (HAL_I2C_MODE_MEM) is refused
+ */
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef *hi2c, uint16_t address)
+{
+	HOST_I2CState *bus = HOST_I2C_State(hi2c);
+
+	(void)address;
+	if(hi2c->Mode != HAL_I2C_MODE_MASTER || bus->operation == HOST_I2C_IDLE || bus->operation == HOST_I2C_ABORT)
+		return HAL_ERROR;
+
+	bus->operation = HOST_I2C_ABORT;
+	hi2c->State = HAL_I2C_STATE_ABORT;
+	return HAL_OK;
+}
+
+/**
+ * @brief	Peripheral reset drops the pending transfer, slave which holds the bus is not released
+ */
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c)
+{
+	HOST_I2CState *bus = HOST_I2C_State(hi2c);
+
+	if(bus->operation != HOST_I2C_IDLE)
+		HOST_I2C_Held(bus);
+	bus->operation = HOST_I2C_IDLE;
+	bus->resets++;
+	hi2c->State = HAL_I2C_STATE_RESET;
+	hi2c->Mode = HAL_I2C_MODE_NONE;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+	HOST_I2C_State(hi2c);
+	hi2c->State = HAL_I2C_STATE_READY;
+	hi2c->Mode = HAL_I2C_MODE_NONE;
+	return HAL_OK;
+}
+
+/**
+ * @brief	Clears every model, tick starts at 0
+ */
+void HOST_Reset(void)
+{
+	HOST_Tick = 0;
+	HOST_Primask = 0;
+	HOST_ErrorHandlerCount = 0;
+	HOST_AssertCount = 0;
+
+	memset(&HOST_ADC1, 0, sizeof(HOST_ADC1));
+	memset(&HOST_ADC2, 0, sizeof(HOST_ADC2));
+	memset(&HOST_ADC3, 0, sizeof(HOST_ADC3));
+	memset(HOST_AdcDma, 0, sizeof(HOST_AdcDma));
+	memset(HOST_Adc, 0, sizeof(HOST_Adc));
+	memset(HOST_Can, 0, sizeof(HOST_Can));
+	memset(HOST_I2C, 0, sizeof(HOST_I2C));
+}
@@ -0,0 +1,45 @@
+/**
+  * @file host_test.c
+  * @brief Minimal test runner of the host build
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "host_test.h"
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t HOST_Failures;
+
+void HOST_Check(int passed, const char *expression, const char *file, int line)
+{
+	if(passed)
+		return;
+
+	HOST_Failures++;
+	printf("%s:%d: check failed: %s\n", file, line, expression);
+}
+
+int HOST_RunTests(const HOST_Test *tests, uint32_t count, int argc, char **argv)
+{
+	uint32_t run = 0;
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(argc > 1 && strcmp(argv[1], tests[i].name) != 0)
+			continue;
+
+		uint32_t failures = HOST_Failures;
+		HOST_Reset();
+		tests[i].run();
+		run++;
+		printf("%s %s\n", (HOST_Failures == failures) ? "PASS" : "FAIL", tests[i].name);
+	}
+
+	if(run == 0)
+	{
+		printf("no test named %s\n", (argc > 1) ? argv[1] : "");
+		return 1;
+	}
+
+	return HOST_Failures != 0;
+}
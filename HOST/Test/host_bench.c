@@ -0,0 +1,518 @@
+/**
+  * @file host_bench.c
+  * @brief Throughput of driver hot paths on the host, printed as JSON
+  * @author AGH EKO-ENERGIA
+  *
+  * Figures are host CPU time and only compare revisions of the drivers built on the same machine,
+  * cycles on target are measured with PROBE (DRIVERS_PROBE_ENABLE).
+  */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "hal_host.h"
+#include "adc_driver.h"
+#include "can_driver.h"
+#include "can_signal.h"
+#include "can_isotp.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 	100000U
+#define BENCH_CAN_FRAMES_MS 4U							// 8 byte frames at 500 kbit/s with bit stuffing
+
+static uint8_t BENCH_Failed;						// reference and driver disagree, bench exits with 1
+
+static uint64_t BENCH_Now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void BENCH_Report(const char *name, uint32_t operations, uint64_t ns, uint8_t last)
+{
+	printf("    \"%s\": { \"operations\": %u, \"ns\": %llu, \"ops_per_s\": %.0f }%s\n", name, operations,
+		   (unsigned long long)ns, (ns > 0) ? (double)operations * 1e9 / (double)ns : 0.0, last ? "" : ",");
+}
+
+/**
+ * @brief ADC_ReadAll over 8 ranks with averaging depth 16
+ */
+static void BENCH_Averaging(void)
+{
+	static const uint8_t channels[] = {0, 1, 2, 3, 4, 5, 6, 7};
+	static uint8_t memory[ADC_DMA_BUFF_BYTES(8, 16, 0)];
+	static ADC_DriverContextTypeDef dadc;
+	ADC_HandleTypeDef hadc;
+	DMA_HandleTypeDef dma;
+	ADC_ArenaTypeDef arena;
+	ADC_ValuesTypeDef values;
+	uint32_t transfers;
+	volatile uint32_t sink = 0;
+
+	HOST_ADC_Setup(&hadc, ADC1, &dma, channels, sizeof(channels), 1);
+	ADC_Arena_Init(&arena, memory, sizeof(memory));
+	ADC_Init(&dadc, &hadc, &arena, 16);
+
+	uint16_t *buffer = (uint16_t*)HOST_ADC_DmaBuffer(&hadc, &transfers);
+	for(uint32_t i = 0; i < transfers; i++)
+		buffer[i] = (uint16_t)(i * 37 % 4096);
+	HAL_ADC_ConvCpltCallback(&hadc);
+
+	uint64_t start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		ADC_ReadAll(&dadc, NULL, &values);
+		sink += values.raw[i & 7];
+	}
+	BENCH_Report("adc_read_all", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+}
+
+/**
+ * @brief ADC_GetValueFixed against float ADC_GetValue on 8 ranks with averaging depth 16,
+ * 		  host has an FPU, so the difference is smaller than on Cortex-M0/M3 with software float
+ */
+static void BENCH_Values(void)
+{
+	static const uint8_t channels[] = {0, 1, 2, 3, 4, 5, 6, 7};
+	static uint8_t memory[ADC_DMA_BUFF_BYTES(8, 16, 0)];
+	static ADC_DriverContextTypeDef dadc;
+	ADC_HandleTypeDef hadc;
+	DMA_HandleTypeDef dma;
+	ADC_ArenaTypeDef arena;
+	uint32_t transfers;
+	float value = 0.0f;
+	int32_t fixed = 0;
+	volatile float floatSink = 0.0f;
+	volatile int32_t fixedSink = 0;
+
+	HOST_ADC_Setup(&hadc, ADC1, &dma, channels, sizeof(channels), 1);
+	ADC_Arena_Init(&arena, memory, sizeof(memory));
+	ADC_Init(&dadc, &hadc, &arena, 16);
+	for(uint8_t channel = 0; channel < 8; channel++)
+		ADC_ConfigScale(&dadc, channel, 3300, 1.0f, 0);
+
+	uint16_t *buffer = (uint16_t*)HOST_ADC_DmaBuffer(&hadc, &transfers);
+	for(uint32_t i = 0; i < transfers; i++)
+		buffer[i] = (uint16_t)(i * 37 % 4096);
+	HAL_ADC_ConvCpltCallback(&hadc);
+
+	for(uint8_t channel = 0; channel < 8; channel++)
+	{
+		if(ADC_GetValue(&dadc, 3.3f, channel, &value) != ADC_OK || ADC_GetValueFixed(&dadc, channel, &fixed) != ADC_OK
+		   || fixed - (int32_t)(value * 1000.0f) > 1 || (int32_t)(value * 1000.0f) - fixed > 1)
+		{
+			fprintf(stderr, "adc_get_value: fixed and float values disagree\n");
+			BENCH_Failed = 1;
+		}
+	}
+
+	uint64_t start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		ADC_GetValue(&dadc, 3.3f, (uint8_t)(i & 7), &value);
+		floatSink += value;
+	}
+	BENCH_Report("adc_get_value_float", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+
+	start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		ADC_GetValueFixed(&dadc, (uint8_t)(i & 7), &fixed);
+		fixedSink += fixed;
+	}
+	BENCH_Report("adc_get_value_fixed", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+}
+
+/**
+ * @brief Rank search of the drivers before the inverse table, kept as the reference of ADC_GetRank
+ */
+static ADC_StatusTypeDef BENCH_LinearRank(const ADC_ChannelsTypeDef *cadc, uint8_t conversions, uint8_t channel, uint8_t *rank)
+{
+	for(uint8_t i = 0; i < conversions; i++)
+	{
+		if(cadc->channels[i] == channel)
+		{
+			*rank = i;
+			return ADC_OK;
+		}
+	}
+
+	return ADC_Error;
+}
+
+/**
+ * @brief ADC_GetRank of every channel of a 16 rank sequence, against a linear scan of the sequence
+ */
+static void BENCH_Ranks(void)
+{
+	static const uint8_t channels[] = {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+	static uint8_t memory[ADC_DMA_BUFF_BYTES(16, 1, 0)];
+	static ADC_DriverContextTypeDef dadc;
+	ADC_HandleTypeDef hadc;
+	DMA_HandleTypeDef dma;
+	ADC_ArenaTypeDef arena;
+	uint8_t rank = 0;
+	volatile uint32_t sink = 0;
+
+	HOST_ADC_Setup(&hadc, ADC1, &dma, channels, sizeof(channels), 1);
+	ADC_Arena_Init(&arena, memory, sizeof(memory));
+	ADC_Init(&dadc, &hadc, &arena, 1);
+
+	for(uint8_t channel = 0; channel < 16; channel++)
+	{
+		uint8_t linear = 0;
+
+		if(ADC_GetRank(&dadc.cadc, channel, &rank) != ADC_OK || BENCH_LinearRank(&dadc.cadc, dadc.conversions, channel, &linear) != ADC_OK
+		   || rank != linear)
+		{
+			fprintf(stderr, "adc_get_rank: ranks disagree\n");
+			BENCH_Failed = 1;
+		}
+	}
+
+	uint64_t start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		ADC_GetRank(&dadc.cadc, (uint8_t)(i & 15), &rank);
+		sink += rank;
+	}
+	BENCH_Report("adc_get_rank", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+
+	start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		BENCH_LinearRank(&dadc.cadc, dadc.conversions, (uint8_t)(i & 15), &rank);
+		sink += rank;
+	}
+	BENCH_Report("adc_get_rank_linear", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+}
+
+static void BENCH_GetData(uint8_t *data)
+{
+	data[0]++;
+}
+
+/**
+ * @brief CAN_HandleScheduled with CAN_MAX_MSG messages of 1..32 ms periods, mailboxes are emptied every tick
+ */
+static void BENCH_Scheduling(void)
+{
+	static CAN_ScheduledMsgList list;
+	static CAN_TxQueue queue;
+	CAN_TypeDef instance;
+	CAN_Handle hcan = {0};
+	uint32_t sent = 0;
+
+	HOST_CAN_Setup(&hcan, &instance);
+	CAN_Init(&hcan);
+
+	for(uint32_t i = 0; i < CAN_MAX_MSG; i++)
+	{
+		CAN_ScheduledMsg msg = {0};
+
+		msg.header.StdId = 0x100 + i;
+		msg.header.IDE = CAN_ID_STD;
+		msg.header.DLC = 8;
+		msg.period_ms = 1 + i;
+		msg.GetData = BENCH_GetData;
+		CAN_AddScheduledMessage(msg, &list);
+	}
+
+	uint64_t start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		HOST_Advance(1);
+		CAN_HandleScheduled(&hcan, &queue, &list);
+		while(HOST_CAN_CompleteMailbox(&hcan, NULL))
+		{
+			CAN_HandleTxMailboxEmpty(&hcan, &queue);
+			sent++;
+		}
+	}
+	BENCH_Report("can_scheduled_ticks", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+	(void)sent;
+}
+
+/**
+ * Signal as generic DBC packers see it, every raw bit is placed on its own
+ */
+typedef struct {
+	int32_t 			*source;
+	uint8_t 			start;							// DBC start bit
+	uint8_t 			length;
+	uint8_t 			motorola;
+	uint8_t 			isSigned;
+}BENCH_BitSignal;
+
+static int16_t BENCH_BitNext(const BENCH_BitSignal *signal, int16_t position)
+{
+	if(signal->motorola)
+		return (position % 8 == 0) ? position + 15 : position - 1;
+	return position + 1;
+}
+
+static void BENCH_BitPack(const BENCH_BitSignal *signals, uint8_t count, uint8_t *data)
+{
+	memset(data, 0, 8);
+	for(uint8_t i = 0; i < count; i++)
+	{
+		uint32_t raw = (uint32_t)*signals[i].source;
+		int16_t position = signals[i].start;
+
+		for(uint8_t k = 0; k < signals[i].length; k++)
+		{
+			uint8_t bit = signals[i].motorola ? (uint8_t)(signals[i].length - 1 - k) : k;
+
+			if((raw >> bit) & 1)
+				data[position / 8] |= (uint8_t)(1 << (position % 8));
+			position = BENCH_BitNext(&signals[i], position);
+		}
+	}
+}
+
+static void BENCH_BitUnpack(const BENCH_BitSignal *signals, uint8_t count, const uint8_t *data)
+{
+	for(uint8_t i = 0; i < count; i++)
+	{
+		uint32_t raw = 0;
+		int16_t position = signals[i].start;
+
+		for(uint8_t k = 0; k < signals[i].length; k++)
+		{
+			uint8_t bit = signals[i].motorola ? (uint8_t)(signals[i].length - 1 - k) : k;
+
+			if((data[position / 8] >> (position % 8)) & 1)
+				raw |= 1U << bit;
+			position = BENCH_BitNext(&signals[i], position);
+		}
+
+		if(signals[i].isSigned && signals[i].length < 32 && (raw >> (signals[i].length - 1)) != 0)
+			raw |= ~0U << signals[i].length;
+		*signals[i].source = (int32_t)raw;
+	}
+}
+
+/**
+ * @brief CAN_Signal_Pack and CAN_Signal_Unpack of an 8 byte frame with 5 Intel and Motorola integer signals,
+ * 		  against a generic packer which moves one bit at a time
+ */
+static void BENCH_Signals(void)
+{
+	static int32_t values[5] = {0xABC, -1000, 0xBEEF, 0x5A, -300};
+	static const CAN_Signal signals[] = {
+		CAN_SIGNAL_INTEL(0, 12, 0, 1.0f, 0.0f, CAN_SIGNAL_U32, &values[0]),
+		CAN_SIGNAL_INTEL(12, 12, 1, 1.0f, 0.0f, CAN_SIGNAL_I32, &values[1]),
+		CAN_SIGNAL_MOTOROLA(31, 16, 0, 1.0f, 0.0f, CAN_SIGNAL_U32, &values[2]),
+		CAN_SIGNAL_INTEL(40, 8, 0, 1.0f, 0.0f, CAN_SIGNAL_U32, &values[3]),
+		CAN_SIGNAL_MOTOROLA(55, 10, 1, 1.0f, 0.0f, CAN_SIGNAL_I32, &values[4])
+	};
+	static const CAN_SignalTable table = CAN_SIGNAL_TABLE(signals);
+	static const BENCH_BitSignal bitSignals[] = {
+		{&values[0], 0, 12, 0, 0},
+		{&values[1], 12, 12, 0, 1},
+		{&values[2], 31, 16, 1, 0},
+		{&values[3], 40, 8, 0, 0},
+		{&values[4], 55, 10, 1, 1}
+	};
+	uint8_t data[8];
+	uint8_t bitData[8];
+	volatile uint32_t sink = 0;
+
+	CAN_Signal_Pack(&table, data, sizeof(data));
+	BENCH_BitPack(bitSignals, 5, bitData);
+	if(memcmp(data, bitData, sizeof(data)) != 0)
+	{
+		fprintf(stderr, "can_signal: packers disagree\n");
+		BENCH_Failed = 1;
+	}
+
+	uint64_t start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		values[3] = (int32_t)(i & 0xFF);
+		CAN_Signal_Pack(&table, data, sizeof(data));
+		sink += data[5];
+	}
+	BENCH_Report("can_signal_pack", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+
+	start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		values[3] = (int32_t)(i & 0xFF);
+		BENCH_BitPack(bitSignals, 5, data);
+		sink += data[5];
+	}
+	BENCH_Report("can_signal_pack_bitwise", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+
+	start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		data[5] = (uint8_t)i;
+		CAN_Signal_Unpack(&table, data, sizeof(data));
+		sink += (uint32_t)values[3];
+	}
+	BENCH_Report("can_signal_unpack", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+
+	start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		data[5] = (uint8_t)i;
+		BENCH_BitUnpack(bitSignals, 5, data);
+		sink += (uint32_t)values[3];
+	}
+	BENCH_Report("can_signal_unpack_bitwise", BENCH_ITERATIONS, BENCH_Now() - start, 0);
+}
+
+static void BENCH_IsoTpReceived(CAN_IsoTpLink *link, CAN_IsoTpResult result, uint32_t length)
+{
+	*(uint32_t*)link->ctx = (result == CAN_ISOTP_OK) ? length : 0;
+}
+
+/**
+ * @brief Delivers at most BENCH_CAN_FRAMES_MS pending mailboxes to the other link, returns frames sent by the sender
+ */
+static uint32_t BENCH_IsoTpBus(CAN_Handle *hcan, CAN_TxQueue *queue, CAN_IsoTpLink *sender, CAN_IsoTpLink *receiver)
+{
+	HOST_CanFrame sent;
+	uint32_t frames = 0;
+
+	for(uint32_t i = 0; i < BENCH_CAN_FRAMES_MS && HOST_CAN_CompleteMailbox(hcan, &sent); i++)
+	{
+		CAN_RxFrame frame = {0};
+
+		frame.header.IDE = CAN_ID_STD;
+		frame.header.StdId = sent.id;
+		frame.header.DLC = sent.length;
+		memcpy(frame.data, sent.data, sent.length);
+		frame.tick = HAL_GetTick();
+
+		CAN_HandleTxMailboxEmpty(hcan, queue);
+		if(sent.id == sender->txHeader.StdId)
+		{
+			CAN_IsoTp_HandleFrame(&frame, receiver);
+			frames++;
+		}
+		else
+		{
+			CAN_IsoTp_HandleFrame(&frame, sender);
+		}
+	}
+
+	return frames;
+}
+
+/**
+ * @brief ISO-TP transfer of 4095 bytes through the TX queue over a loopback limited to BENCH_CAN_FRAMES_MS,
+ * 		  throughput is in simulated ticks (ms), host time is only printed for completeness
+ */
+static void BENCH_IsoTp(const char *name, uint8_t blockSize, uint8_t stMin)
+{
+	static uint8_t payload[CAN_ISOTP_FF12_MAX];
+	static uint8_t buffer[CAN_ISOTP_FF12_MAX];
+	static CAN_TxQueue queue;
+	static CAN_IsoTpLink sender;
+	static CAN_IsoTpLink receiver;
+	CAN_TypeDef instance;
+	CAN_Handle hcan = {0};
+	uint8_t senderBuffer[8];
+	uint32_t received = 0;
+	uint32_t frames = 0;
+	uint32_t tick = 0;
+
+	memset(&queue, 0, sizeof(queue));
+	memset(&sender, 0, sizeof(sender));
+	memset(&receiver, 0, sizeof(receiver));
+	HOST_CAN_Setup(&hcan, &instance);
+	CAN_Init(&hcan);
+	instance.MCR |= CAN_MCR_TXFP;
+
+	CAN_IsoTp_Init(&sender, &hcan, &queue, CAN_ID_STD, 0x7E0, senderBuffer, sizeof(senderBuffer), 0, 0);
+	CAN_IsoTp_Init(&receiver, &hcan, &queue, CAN_ID_STD, 0x7E8, buffer, sizeof(buffer), blockSize, stMin);
+	receiver.Received = BENCH_IsoTpReceived;
+	receiver.ctx = &received;
+	for(uint32_t i = 0; i < sizeof(payload); i++)
+		payload[i] = (uint8_t)(i * 7 + 3);
+
+	uint64_t start = BENCH_Now();
+	CAN_IsoTp_Send(&sender, payload, sizeof(payload));
+	for(; tick < 10000 && received == 0; tick++)
+	{
+		HOST_SetTick(tick);
+		CAN_IsoTp_Poll(&sender);
+		CAN_IsoTp_Poll(&receiver);
+		frames += BENCH_IsoTpBus(&hcan, &queue, &sender, &receiver);
+	}
+	uint64_t ns = BENCH_Now() - start;
+
+	if(received != sizeof(payload) || memcmp(buffer, payload, sizeof(payload)) != 0)
+	{
+		fprintf(stderr, "%s: transfer failed\n", name);
+		BENCH_Failed = 1;
+	}
+
+	printf("    \"%s\": { \"bytes\": %u, \"frames\": %u, \"ticks\": %u, \"bytes_per_tick\": %.1f, \"ns\": %llu },\n", name,
+		   received, frames, tick, (tick > 0) ? (double)received / tick : 0.0, (unsigned long long)ns);
+}
+
+static void BENCH_Handler(const CAN_RxFrame *frame, void *ctx)
+{
+	*(uint32_t*)ctx += frame->data[0];
+}
+
+/**
+ * @brief CAN_HandleReceived and CAN_DispatchReceived of frames spread over 64 routes
+ */
+static void BENCH_Dispatch(void)
+{
+	static CAN_RxRouteTable table;
+	static CAN_RxRing ring;
+	CAN_TypeDef instance;
+	CAN_Handle hcan = {0};
+	uint32_t sum = 0;
+	uint8_t data[8] = {1};
+
+	HOST_CAN_Setup(&hcan, &instance);
+	CAN_Init(&hcan);
+
+	for(uint32_t i = 0; i < 64; i++)
+		CAN_RegisterHandler(&table, CAN_ID_STD, 0x200 + 3 * i, BENCH_Handler, &sum);
+
+	uint64_t start = BENCH_Now();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+	{
+		HOST_CAN_Deliver(&hcan, CAN_ID_STD, 0x200 + 3 * (i & 63), data, sizeof(data));
+		CAN_HandleReceived(&hcan, &ring, &table, CAN_RX_FIFO0);
+		CAN_DispatchReceived(&ring, &table, 8);
+	}
+	BENCH_Report("can_rx_dispatch", BENCH_ITERATIONS, BENCH_Now() - start, 1);
+}
+
+int main(void)
+{
+	printf("{\n  \"iterations\": %u,\n  \"results\": {\n", BENCH_ITERATIONS);
+
+	HOST_Reset();
+	BENCH_Averaging();
+	HOST_Reset();
+	BENCH_Ranks();
+	HOST_Reset();
+	BENCH_Values();
+	HOST_Reset();
+	BENCH_Scheduling();
+	HOST_Reset();
+	BENCH_Signals();
+	HOST_Reset();
+	BENCH_IsoTp("can_isotp_bs0_st0", 0, 0);
+	HOST_Reset();
+	BENCH_IsoTp("can_isotp_bs8_st0", 8, 0);
+	HOST_Reset();
+	BENCH_IsoTp("can_isotp_bs8_st1", 8, 1);
+	HOST_Reset();
+	BENCH_Dispatch();
+
+	printf("  }\n}\n");
+	return BENCH_Failed;
+}
@@ -0,0 +1,405 @@
+/**
+  * @file test_adc.c
+  * @brief Host tests of ADC driver, DMA halves are written by tests and published with the DMA callbacks
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "host_test.h"
+#include "adc_driver.h"
+#include <string.h>
+
+#define TEST_DEPTH 		4
+
+static ADC_DriverContextTypeDef TEST_Adc;
+static ADC_HandleTypeDef TEST_Hadc;
+static DMA_HandleTypeDef TEST_Dma;
+static ADC_DriverContextTypeDef TEST_Slave;
+static ADC_HandleTypeDef TEST_HadcSlave;
+static DMA_HandleTypeDef TEST_DmaSlave;
+static uint8_t TEST_Memory[ADC_DMA_BUFF_BYTES(ADC_MAX_CHANNELS, 16, 1) * 2];
+static ADC_ArenaTypeDef TEST_Arena;
+
+/**
+ * @brief Initializes ADC1 with circular DMA over given channels
+ */
+static HAL_StatusTypeDef TEST_Init(const uint8_t *channels, uint8_t count, uint16_t depth)
+{
+	memset(&TEST_Adc, 0, sizeof(TEST_Adc));
+	HOST_ADC_Setup(&TEST_Hadc, ADC1, &TEST_Dma, channels, count, 1);
+	ADC_Arena_Init(&TEST_Arena, TEST_Memory, sizeof(TEST_Memory));
+	return ADC_Init(&TEST_Adc, &TEST_Hadc, &TEST_Arena, depth);
+}
+
+/**
+ * @brief Fills one half of independent mode buffer, sample = base + 10 * rank + sequence
+ */
+static void TEST_FillHalf(uint8_t half, uint16_t base)
+{
+	uint32_t transfers;
+	uint16_t *buffer = (uint16_t*)HOST_ADC_DmaBuffer(&TEST_Hadc, &transfers);
+	uint32_t halfLength = transfers / 2;
+
+	for(uint32_t i = 0; i < halfLength; i++)
+		buffer[half * halfLength + i] = (uint16_t)(base + 10 * (i % TEST_Adc.conversions) + i / TEST_Adc.conversions);
+}
+
+/**
+ * @brief Initializes ADC1 (master) and ADC2 (slave) in dual mode, only master has circular DMA
+ */
+static HAL_StatusTypeDef TEST_InitDual(const uint8_t *master, const uint8_t *slave, uint8_t count, uint16_t depth)
+{
+	memset(&TEST_Slave, 0, sizeof(TEST_Slave));
+	HOST_ADC_SetDual(1);
+	HOST_ADC_Setup(&TEST_HadcSlave, ADC2, &TEST_DmaSlave, slave, count, 0);
+
+	if(TEST_Init(master, count, depth) != HAL_OK)
+		return HAL_ERROR;
+
+	return ADC_Init(&TEST_Slave, &TEST_HadcSlave, NULL, 0);
+}
+
+/**
+ * @brief Fills one half of dual mode buffer, master sample = base + 10 * rank + sequence, slave sample is 1000 higher
+ */
+static void TEST_FillDualHalf(uint8_t half, uint16_t base)
+{
+	uint32_t transfers;
+	uint32_t *buffer = HOST_ADC_DmaBuffer(&TEST_Hadc, &transfers);
+	uint32_t halfLength = transfers / 2;
+
+	for(uint32_t i = 0; i < halfLength; i++)
+	{
+		uint16_t sample = (uint16_t)(base + 10 * (i % TEST_Adc.conversions) + i / TEST_Adc.conversions);
+		buffer[half * halfLength + i] = ((uint32_t)(sample + 1000) << 16) | sample;
+	}
+}
+
+static void adc_pingpong(void)
+{
+	static const uint8_t channels[] = {3, 5};
+	uint16_t value = 0;
+	uint32_t transfers;
+	uint32_t sequence;
+	uint16_t offset;
+
+	HOST_CHECK(TEST_Init(channels, sizeof(channels), TEST_DEPTH) == HAL_OK);
+	HOST_CHECK(HOST_ADC_DmaStarts(&TEST_Hadc) == 1);
+	HOST_ADC_DmaBuffer(&TEST_Hadc, &transfers);
+	HOST_CHECK(transfers == 2 * sizeof(channels) * TEST_DEPTH);
+
+	// nothing published yet
+	HOST_CHECK(ADC_ReadChannel(&TEST_Adc, 5, &value) == ADC_NotStarted);
+
+	// lower half: channel 5 is rank 1, samples 110..113
+	TEST_FillHalf(0, 100);
+	HAL_ADC_ConvHalfCpltCallback(&TEST_Hadc);
+	HOST_CHECK(ADC_ReadChannel(&TEST_Adc, 5, &value) == ADC_OK);
+	HOST_CHECK(value == (110 + 111 + 112 + 113) / 4);
+
+	// DMA writes the upper half meanwhile, readers still see the lower one
+	TEST_FillHalf(1, 200);
+	HOST_CHECK(ADC_ReadChannel(&TEST_Adc, 3, &value) == ADC_OK);
+	HOST_CHECK(value == (100 + 101 + 102 + 103) / 4);
+
+	HAL_ADC_ConvCpltCallback(&TEST_Hadc);
+	HOST_CHECK(ADC_ReadChannel(&TEST_Adc, 3, &value) == ADC_OK);
+	HOST_CHECK(value == (200 + 201 + 202 + 203) / 4);
+
+	// half published during reading is reported as torn
+	HOST_CHECK(ADC_AcquireHalf(&TEST_Adc.badc, &sequence, &offset) == ADC_OK);
+	HOST_CHECK(offset == sizeof(channels) * TEST_DEPTH);
+	HAL_ADC_ConvHalfCpltCallback(&TEST_Hadc);
+	HOST_CHECK(ADC_ReleaseHalf(&TEST_Adc.badc, sequence) == ADC_Busy);
+
+	// DMA is started once, readers never restart it
+	HOST_CHECK(HOST_ADC_DmaStarts(&TEST_Hadc) == 1);
+}
+
+static void adc_rank_table(void)
+{
+	// ranks 1..6 in SQR3, 7..12 in SQR2, 13..14 in SQR1; channel 2 is converted twice
+	static const uint8_t channels[] = {9, 2, 17, 0, 4, 11, 6, 2, 13, 1, 15, 8, 18, 10};
+	uint8_t rank = 0xAA;
+
+	HOST_CHECK(TEST_Init(channels, sizeof(channels), TEST_DEPTH) == HAL_OK);
+	HOST_CHECK(TEST_Adc.conversions == sizeof(channels));
+
+	for(uint8_t i = 0; i < sizeof(channels); i++)
+	{
+		HOST_CHECK(TEST_Adc.cadc.channels[i] == channels[i]);
+		HOST_CHECK(ADC_GetRank(&TEST_Adc.cadc, channels[i], &rank) == ADC_OK);
+		HOST_CHECK(rank == ((channels[i] == 2) ? 1 : i));			// first rank of repeated channel is kept
+	}
+
+	rank = 0xAA;
+	HOST_CHECK(ADC_GetRank(&TEST_Adc.cadc, 3, &rank) == ADC_Error);	// not converted
+	HOST_CHECK(ADC_GetRank(&TEST_Adc.cadc, ADC_CHANNEL_COUNT, &rank) == ADC_Error);
+	HOST_CHECK(rank == 0xAA);
+
+	// table is rebuilt from registers
+	ADC1->SQR3 = (ADC1->SQR3 & ~0x1FU) | 3U;
+	HOST_CHECK(ADC_Config_GetRanksOfChannels(&TEST_Adc) == ADC_OK);
+	HOST_CHECK(ADC_GetRank(&TEST_Adc.cadc, 3, &rank) == ADC_OK && rank == 0);
+	HOST_CHECK(ADC_GetRank(&TEST_Adc.cadc, 9, &rank) == ADC_Error);
+}
+
+static void adc_fixed_point(void)
+{
+	static const uint8_t channels[] = {3, 5};
+	int32_t value = 0;
+
+	HOST_CHECK(TEST_Init(channels, sizeof(channels), TEST_DEPTH) == HAL_OK);
+	TEST_FillHalf(0, 2000);
+	HAL_ADC_ConvHalfCpltCallback(&TEST_Hadc);
+
+	// conversion has to be configured first
+	HOST_CHECK(ADC_GetValueFixed(&TEST_Adc, 3, &value) == ADC_Error);
+
+	// 3300 mV at full scale, channel 3 averages to 2001
+	HOST_CHECK(ADC_ConfigScale(&TEST_Adc, 3, 3300, 1.0f, 0) == ADC_OK);
+	HOST_CHECK(ADC_GetValueFixed(&TEST_Adc, 3, &value) == ADC_OK);
+	HOST_CHECK(value == 2001 * 3300 / 4095);
+
+	// offset below zero gives negative values
+	HOST_CHECK(ADC_ConfigScale(&TEST_Adc, 5, 3300, 1.0f, 2100) == ADC_OK);
+	HOST_CHECK(ADC_GetValueFixed(&TEST_Adc, 5, &value) == ADC_OK);
+	HOST_CHECK(value < 0 && value >= -(2100 - 2011) * 3300 / 4095 - 1);
+
+	// product of raw value and coefficient must fit in 32 bits
+	HOST_CHECK(ADC_ConfigScale(&TEST_Adc, 3, 32767, 1.0f, 0) == ADC_OK);
+	HOST_CHECK(ADC_ConfigScale(&TEST_Adc, 3, 32768, 1.0f, 0) == ADC_Error);
+	HOST_CHECK(ADC_ConfigScale(&TEST_Adc, 3, 30000, 1.0f, -4095) == ADC_Error);
+
+	// coefficient rounded to 0 is rejected
+	HOST_CHECK(ADC_ConfigScale(&TEST_Adc, 3, 0, 1.0f, 0) == ADC_Error);
+	HOST_CHECK(ADC_ConfigScale(&TEST_Adc, 4, 3300, 1.0f, 0) == ADC_Error);
+}
+
+static void adc_dual_deinterleave(void)
+{
+	static const uint8_t master[] = {1, 2, 3};
+	static const uint8_t slave[] = {7, 8, 9};
+	ADC_ValuesTypeDef values;
+	uint16_t value = 0;
+
+	HOST_CHECK(__ADC_DUALMODE_MASTER(0x0ABC0123U) == 0x0123);
+	HOST_CHECK(__ADC_DUALMODE_SLAVE(0x0ABC0123U) == 0x0ABC);
+
+	HOST_CHECK(TEST_InitDual(master, slave, sizeof(master), TEST_DEPTH) == HAL_OK);
+	HOST_CHECK(HOST_ADC_DmaStarts(&TEST_Hadc) == 1);
+
+	// one 32-bit transfer per conversion of both ADCs
+	uint32_t transfers;
+	HOST_ADC_DmaBuffer(&TEST_Hadc, &transfers);
+	HOST_CHECK(transfers == 2 * sizeof(master) * TEST_DEPTH);
+
+	TEST_FillDualHalf(1, 300);
+	HAL_ADC_ConvCpltCallback(&TEST_Hadc);
+
+	HOST_CHECK(ADC_ReadChannel(&TEST_Adc, 3, &value) == ADC_OK);
+	HOST_CHECK(value == 320 + 3 / 2);
+	HOST_CHECK(ADC_ReadChannel(&TEST_Slave, 9, &value) == ADC_OK);
+	HOST_CHECK(value == 1320 + 3 / 2);
+
+	HOST_CHECK(ADC_ReadAll(&TEST_Adc, NULL, &values) == ADC_OK);
+	HOST_CHECK(values.raw[0] == 301 && values.raw[1] == 311 && values.raw[2] == 321);
+	HOST_CHECK(ADC_ReadAll(&TEST_Slave, NULL, &values) == ADC_OK);
+	HOST_CHECK(values.raw[0] == 1301 && values.raw[1] == 1311 && values.raw[2] == 1321);
+
+	// without DMA the slave takes its halfword of the common data register
+	HOST_ADC_QueueValue(&TEST_Hadc, (1234U << 16) | 567U);
+	TEST_Hadc.Instance->CR2 &= ~ADC_CR2_DMA;
+	HOST_CHECK(ADC_ReadChannel(&TEST_Slave, 7, &value) == ADC_OK);
+	HOST_CHECK(value == 1234);
+}
+
+static void adc_dual_slave_dma(void)
+{
+	static const uint8_t master[] = {1, 2};
+	static const uint8_t slave[] = {7, 8};
+	ADC_ValuesTypeDef values;
+	uint16_t value = 0;
+	float scaled = 0.0f;
+
+	HOST_CHECK(TEST_InitDual(master, slave, sizeof(master), 16) == HAL_OK);
+	HOST_CHECK(TEST_Slave.source == &TEST_Adc);
+	HOST_CHECK(__ADC_IS_DMA_ENABLED(&TEST_HadcSlave) == 0);		// slave's results come with master's DMA
+	HOST_CHECK(HOST_ADC_DmaStarts(&TEST_HadcSlave) == 0);
+
+	TEST_FillDualHalf(0, 100);
+	HAL_ADC_ConvHalfCpltCallback(&TEST_Hadc);
+
+	// slave averages its halfwords of master's buffer, no single conversions are read
+	HOST_ADC_QueueValue(&TEST_Hadc, 0xFFFF);
+	HOST_CHECK(ADC_ReadChannel(&TEST_Slave, 8, &value) == ADC_OK);
+	HOST_CHECK(value == 1110 + 15 / 2);
+
+	HOST_CHECK(ADC_ReadAll(&TEST_Slave, NULL, &values) == ADC_OK);
+	HOST_CHECK(values.size == 2 && values.raw[0] == 1100 + 15 / 2 && values.raw[1] == 1110 + 15 / 2);
+
+	// oversampled path is taken for slave as well: 16 samples, 2 extra bits
+	HOST_CHECK(ADC_ConfigOversampling(&TEST_Slave, 2) == ADC_OK);
+	HOST_CHECK(ADC_GetValue(&TEST_Slave, 16383.0f, 7, &scaled) == ADC_OK);
+	HOST_CHECK(scaled > 4 * 1100 + 29.5f && scaled < 4 * 1100 + 30.5f);
+}
+
+static void adc_dual_third_instance(void)
+{
+	static const uint8_t master[] = {1, 2};
+	static const uint8_t slave[] = {7, 8};
+	static const uint8_t third[] = {4, 5, 6};
+	static ADC_DriverContextTypeDef adc3;
+	ADC_HandleTypeDef hadc3;
+	DMA_HandleTypeDef dma3;
+	uint16_t value = 0;
+	uint32_t transfers;
+
+	// ADC3 is not paired even though dual mode of ADC1 and ADC2 is on: it starts and reads its own DMA buffer
+	HOST_CHECK(TEST_InitDual(master, slave, sizeof(master), 4) == HAL_OK);
+	memset(&adc3, 0, sizeof(adc3));
+	HOST_ADC_Setup(&hadc3, ADC3, &dma3, third, sizeof(third), 1);
+	HOST_CHECK(ADC_Init(&adc3, &hadc3, &TEST_Arena, 2) == HAL_OK);
+	HOST_CHECK(adc3.source == &adc3 && HOST_ADC_DmaStarts(&hadc3) == 1);
+
+	uint16_t *buffer = (uint16_t*)HOST_ADC_DmaBuffer(&hadc3, &transfers);
+	HOST_CHECK(buffer != (uint16_t*)HOST_ADC_DmaBuffer(&TEST_Hadc, NULL) && transfers == 2 * sizeof(third) * 2);
+	for(uint32_t i = 0; i < transfers / 2; i++)
+		buffer[i] = (uint16_t)(300 + 10 * (i % sizeof(third)) + i / sizeof(third));
+	TEST_FillDualHalf(0, 100);
+
+	HAL_ADC_ConvHalfCpltCallback(&hadc3);
+	HOST_CHECK(ADC_ReadChannel(&adc3, 6, &value) == ADC_OK && value == (320 + 321) / 2);
+	HOST_CHECK(ADC_ReadChannel(&TEST_Slave, 8, &value) == ADC_NotStarted);	// master's half is not published yet
+
+	HAL_ADC_ConvHalfCpltCallback(&TEST_Hadc);
+	HOST_CHECK(ADC_ReadChannel(&TEST_Slave, 8, &value) == ADC_OK && value == 1110 + 3 / 2);
+	HOST_CHECK(ADC_ReadChannel(&adc3, 4, &value) == ADC_OK && value == (300 + 301) / 2);
+}
+
+static void adc_arena(void)
+{
+	static const uint8_t first[] = {0, 1, 2};
+	static const uint8_t second[] = {4, 5};
+	static ADC_DriverContextTypeDef other;
+	static uint8_t memory[ADC_DMA_BUFF_BYTES(3, 5, 0) + ADC_DMA_BUFF_BYTES(2, 8, 0)];
+	ADC_HandleTypeDef hadc;
+	DMA_HandleTypeDef dma;
+	ADC_ArenaTypeDef arena;
+	uint32_t transfers;
+
+	// ADC1: 3 ranks, default depth; ADC2: 2 ranks, depth 8, both from one arena sized with ADC_DMA_BUFF_BYTES
+	HOST_ADC_Setup(&TEST_Hadc, ADC1, &TEST_Dma, first, sizeof(first), 1);
+	HOST_ADC_Setup(&hadc, ADC2, &dma, second, sizeof(second), 1);
+	ADC_Arena_Init(&arena, memory + 1, sizeof(memory) - 1);			// misaligned start costs padding
+	HOST_CHECK(ADC_Init(&TEST_Adc, &TEST_Hadc, &arena, 0) == HAL_OK);
+	HOST_CHECK(TEST_Adc.badc.depth == ADC_AVERAGED_MEASURES);
+	HOST_CHECK(((uintptr_t)TEST_Adc.badc.idma.BufferADC % ADC_DMA_ALIGNMENT) == 0);
+	HOST_CHECK(HOST_ADC_DmaBuffer(&TEST_Hadc, &transfers) == (uint32_t*)TEST_Adc.badc.idma.BufferADC);
+	HOST_CHECK(transfers == 2 * 3 * ADC_AVERAGED_MEASURES);
+
+	HOST_CHECK(ADC_Init(&other, &hadc, &arena, 8) == HAL_ERROR);	// padding left too little
+
+	ADC_Arena_Init(&arena, memory, sizeof(memory));
+	HOST_ADC_Setup(&TEST_Hadc, ADC1, &TEST_Dma, first, sizeof(first), 1);
+	HOST_CHECK(ADC_Init(&TEST_Adc, &TEST_Hadc, &arena, 0) == HAL_OK);
+	HOST_ADC_Setup(&hadc, ADC2, &dma, second, sizeof(second), 1);
+	HOST_CHECK(ADC_Init(&other, &hadc, &arena, 8) == HAL_OK);
+	HOST_CHECK(arena.used == sizeof(memory));
+
+	// buffers do not overlap
+	uint8_t *a = (uint8_t*)TEST_Adc.badc.idma.BufferADC;
+	uint8_t *b = (uint8_t*)other.badc.idma.BufferADC;
+	HOST_CHECK(b >= a + 2 * 3 * ADC_AVERAGED_MEASURES * 2);
+
+	// depth beyond DMA counter is refused
+	ADC_Arena_Init(&arena, memory, sizeof(memory));
+	HOST_ADC_Setup(&hadc, ADC2, &dma, second, sizeof(second), 1);
+	HOST_CHECK(ADC_Init(&other, &hadc, &arena, 40000) == HAL_ERROR);
+}
+
+static void adc_injected(void)
+{
+	static const uint8_t channels[] = {0};
+	uint16_t values[ADC_INJECTED_MAX_RANKS] = {0};
+	uint32_t count = 0;
+
+	HOST_CHECK(TEST_Init(channels, sizeof(channels), TEST_DEPTH) == HAL_OK);
+	ADC1->JSQR = 1U << ADC_JSQR_JL_Pos;								// 2 injected ranks
+
+	// JSWSTART selected: HAL sets JEXTTRIG for it as well, trigger is still software
+	ADC1->CR2 |= ADC_INJECTED_SOFTWARE_START | ADC_CR2_JEXTTRIG;
+	HOST_CHECK(ADC_InjectedStart(&TEST_Adc) == ADC_Error);
+
+	ADC1->CR2 = (ADC1->CR2 & ~ADC_CR2_JEXTSEL) | ADC_EXTERNALTRIGINJECCONV_T1_TRGO;
+	HOST_CHECK(ADC_InjectedStart(&TEST_Adc) == ADC_OK);
+	HOST_CHECK(TEST_Adc.jadc.size == 2);
+	HOST_CHECK(ADC_ReadInjected(&TEST_Adc, values, &count) == ADC_NotStarted);
+
+	ADC1->JDR1 = 111;
+	ADC1->JDR2 = 222;
+	HAL_ADCEx_InjectedConvCpltCallback(&TEST_Hadc);
+	HOST_CHECK(ADC_ReadInjected(&TEST_Adc, values, &count) == ADC_OK);
+	HOST_CHECK(values[0] == 111 && values[1] == 222 && count == 1);
+
+	// slot being written is not returned
+	TEST_Adc.jadc.sequence++;
+	HOST_CHECK(ADC_ReadInjected(&TEST_Adc, values, &count) == ADC_Busy);
+}
+
+static void adc_reused_context(void)
+{
+	static const uint8_t channels[] = {3, 5};
+	uint16_t values[ADC_INJECTED_MAX_RANKS] = {0};
+	uint16_t value = 0;
+	uint32_t count = 0;
+
+	// context with garbage of a previous user: nothing of it may reach DMA callbacks or readers
+	memset(&TEST_Adc, 0xA5, sizeof(TEST_Adc));
+	HOST_ADC_Setup(&TEST_Hadc, ADC1, &TEST_Dma, channels, sizeof(channels), 1);
+	ADC_Arena_Init(&TEST_Arena, TEST_Memory, sizeof(TEST_Memory));
+	HOST_CHECK(ADC_Init(&TEST_Adc, &TEST_Hadc, &TEST_Arena, TEST_DEPTH) == HAL_OK);
+
+	for(uint8_t i = 0; i < ADC_MAX_CHANNELS; i++)
+		HOST_CHECK(TEST_Adc.fadc[i].mode == ADC_FILTER_NONE && TEST_Adc.fadc[i].updates == 0);
+
+	TEST_FillHalf(0, 100);
+	HAL_ADC_ConvHalfCpltCallback(&TEST_Hadc);
+	HAL_ADCEx_InjectedConvCpltCallback(&TEST_Hadc);
+	HOST_CHECK(ADC_ReadFiltered(&TEST_Adc, 5, &value) == ADC_NotStarted);
+	HOST_CHECK(ADC_ReadInjected(&TEST_Adc, values, &count) == ADC_NotStarted);
+	HOST_CHECK(ADC_ReadChannel(&TEST_Adc, 5, &value) == ADC_OK && value == (110 + 111 + 112 + 113) / 4);
+	HOST_CHECK(ADC_GetFullScale(&TEST_Adc) == 4095);
+}
+
+static void adc_oversampling_no_dma(void)
+{
+	static const uint8_t channels[] = {3, 5};
+
+	// single conversions without DMA: depth is 0, oversampling can not be enabled but can always be disabled
+	memset(&TEST_Adc, 0, sizeof(TEST_Adc));
+	HOST_ADC_Setup(&TEST_Hadc, ADC1, &TEST_Dma, channels, sizeof(channels), 0);
+	HOST_CHECK(ADC_Init(&TEST_Adc, &TEST_Hadc, NULL, 0) == HAL_OK);
+	HOST_CHECK(TEST_Adc.badc.depth == 0 && HOST_ADC_DmaStarts(&TEST_Hadc) == 0);
+
+	HOST_CHECK(ADC_ConfigOversampling(&TEST_Adc, 1) == ADC_Error);
+	HOST_CHECK(ADC_ConfigOversampling(&TEST_Adc, 0) == ADC_OK);
+	HOST_CHECK(TEST_Adc.oversamplingBits == 0 && ADC_GetFullScale(&TEST_Adc) == 4095);
+}
+
+int main(int argc, char **argv)
+{
+	static const HOST_Test tests[] = {
+		HOST_TEST(adc_pingpong),
+		HOST_TEST(adc_rank_table),
+		HOST_TEST(adc_fixed_point),
+		HOST_TEST(adc_dual_deinterleave),
+		HOST_TEST(adc_dual_slave_dma),
+		HOST_TEST(adc_dual_third_instance),
+		HOST_TEST(adc_arena),
+		HOST_TEST(adc_injected),
+		HOST_TEST(adc_reused_context),
+		HOST_TEST(adc_oversampling_no_dma),
+	};
+
+	return HOST_RunTests(tests, HOST_TEST_COUNT(tests), argc, argv);
+}
@@ -0,0 +1,553 @@
+/**
+  * @file test_can.c
+  * @brief Host tests of CAN driver on bxCAN, frames travel through the simulated mailboxes and FIFOs
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "host_test.h"
+#include "can_driver.h"
+#include "can_telemetry.h"
+#include "can_isotp.h"
+#include <string.h>
+
+static CAN_TypeDef TEST_Instance;
+static CAN_Handle TEST_Hcan;
+static CAN_TxQueue TEST_Queue;
+static CAN_ScheduledMsgList TEST_List;
+
+static void TEST_Init(void)
+{
+	memset(&TEST_Hcan, 0, sizeof(TEST_Hcan));
+	memset(&TEST_Queue, 0, sizeof(TEST_Queue));
+	memset(&TEST_List, 0, sizeof(TEST_List));
+	HOST_CAN_Setup(&TEST_Hcan, &TEST_Instance);
+	CAN_Init(&TEST_Hcan);
+}
+
+/**
+ * @brief Completes every pending mailbox like TX interrupts would, returns number of sent frames
+ */
+static uint32_t TEST_Drain(HOST_CanFrame *frames, uint32_t capacity)
+{
+	HOST_CanFrame frame;
+	uint32_t sent = 0;
+
+	while(HOST_CAN_CompleteMailbox(&TEST_Hcan, &frame))
+	{
+		if(sent < capacity)
+			frames[sent] = frame;
+		sent++;
+		CAN_HandleTxMailboxEmpty(&TEST_Hcan, &TEST_Queue);
+	}
+
+	return sent;
+}
+
+static void TEST_GetData(uint8_t *data)
+{
+	memset(data, 0xA5, CAN_MAX_DLC);
+}
+
+static CAN_ScheduledMsg TEST_Message(uint32_t ide, uint32_t id, uint32_t period)
+{
+	CAN_ScheduledMsg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.header.IDE = ide;
+	if(ide == CAN_ID_EXT)
+		msg.header.ExtId = id;
+	else
+		msg.header.StdId = id;
+	msg.header.DLC = CAN_MAX_DLC;
+	msg.period_ms = period;
+	msg.GetData = TEST_GetData;
+	return msg;
+}
+
+static void can_scheduler(void)
+{
+	HOST_CanFrame frames[8];
+
+	TEST_Init();
+	HOST_CHECK(CAN_HandleScheduled(&TEST_Hcan, &TEST_Queue, &TEST_List) == CAN_NO_DEADLINE);
+
+	HOST_CHECK(CAN_AddScheduledMessage(TEST_Message(CAN_ID_STD, 0x300, 30), &TEST_List) == HAL_OK);
+	HOST_CHECK(CAN_AddScheduledMessage(TEST_Message(CAN_ID_STD, 0x100, 10), &TEST_List) == HAL_OK);
+	HOST_CHECK(CAN_AddScheduledMessage(TEST_Message(CAN_ID_STD, 0x200, 20), &TEST_List) == HAL_OK);
+	HOST_CHECK(CAN_AddScheduledMessage(TEST_Message(CAN_ID_STD, 0x200, 50), &TEST_List) == HAL_ERROR);
+
+	HOST_SetTick(9);
+	HOST_CHECK(CAN_HandleScheduled(&TEST_Hcan, &TEST_Queue, &TEST_List) == 1);
+	HOST_CHECK(TEST_Drain(frames, 8) == 0);
+
+	HOST_SetTick(10);
+	HOST_CHECK(CAN_HandleScheduled(&TEST_Hcan, &TEST_Queue, &TEST_List) == 10);
+	HOST_CHECK(TEST_Drain(frames, 8) == 1 && frames[0].id == 0x100 && frames[0].data[0] == 0xA5);
+
+	// late call keeps time slots: 0x100 missed the slot at 20 and is next due at 40
+	HOST_SetTick(33);
+	HOST_CHECK(CAN_HandleScheduled(&TEST_Hcan, &TEST_Queue, &TEST_List) == 7);
+	HOST_CHECK(TEST_Drain(frames, 8) == 3);
+	HOST_CHECK(frames[0].id == 0x100 && frames[1].id == 0x200 && frames[2].id == 0x300);
+}
+
+static void can_remove_scheduled(void)
+{
+	HOST_CanFrame frames[8];
+
+	TEST_Init();
+
+	// standard and extended frames with equal ID are different messages
+	HOST_CHECK(CAN_AddScheduledMessage(TEST_Message(CAN_ID_STD, 0x123, 10), &TEST_List) == HAL_OK);
+	HOST_CHECK(CAN_AddScheduledMessage(TEST_Message(CAN_ID_EXT, 0x123, 15), &TEST_List) == HAL_OK);
+	HOST_CHECK(CAN_AddScheduledMessage(TEST_Message(CAN_ID_STD, 0x050, 20), &TEST_List) == HAL_OK);
+
+	HOST_CHECK(CAN_RemoveScheduledMessage(CAN_ID_EXT, 0x050, &TEST_List) == HAL_ERROR);
+	HOST_CHECK(CAN_RemoveScheduledMessage(CAN_ID_STD, 0x123, &TEST_List) == HAL_OK);
+	HOST_CHECK(TEST_List.size == 2);
+	HOST_CHECK(CAN_RemoveScheduledMessage(CAN_ID_STD, 0x123, &TEST_List) == HAL_ERROR);
+
+	// heap order survives removal
+	HOST_SetTick(15);
+	HOST_CHECK(CAN_HandleScheduled(&TEST_Hcan, &TEST_Queue, &TEST_List) == 5);
+	HOST_CHECK(TEST_Drain(frames, 8) == 1 && frames[0].ide == CAN_ID_EXT && frames[0].id == 0x123);
+}
+
+static void TEST_Count(const CAN_RxFrame *frame, void *ctx)
+{
+	((uint32_t*)ctx)[0]++;
+	((uint32_t*)ctx)[1] = __CAN_HEADER_ID(&frame->header);
+}
+
+static void can_routes(void)
+{
+	static CAN_RxRouteTable table;
+	static CAN_RxRing ring;
+	uint32_t routed[2] = {0};
+	uint32_t fallback[2] = {0};
+	uint8_t data[CAN_MAX_DLC] = {0};
+
+	TEST_Init();
+
+	// registered in reverse order, kept sorted; extended IDs sort after standard ones
+	for(uint32_t i = 0; i < CAN_MAX_ROUTES; i++)
+	{
+		uint32_t ide = (i % 2) ? CAN_ID_EXT : CAN_ID_STD;
+		HOST_CHECK(CAN_RegisterHandler(&table, ide, 0x700 - 16 * i, TEST_Count, routed) == HAL_OK);
+	}
+	HOST_CHECK(CAN_RegisterHandler(&table, CAN_ID_STD, 0x001, TEST_Count, routed) == HAL_ERROR);	// table full
+	for(uint16_t i = 1; i < table.size; i++)
+		HOST_CHECK(table.routes[i - 1].key < table.routes[i].key);
+
+	HOST_CHECK(CAN_UnregisterHandler(&table, CAN_ID_STD, 0x700) == HAL_OK);
+	HOST_CHECK(CAN_RegisterHandler(&table, CAN_ID_EXT, 0x6F0, TEST_Count, routed) == HAL_ERROR);	// already registered
+	HOST_CHECK(CAN_FindRoute(&table, CAN_ID_EXT, 0x6F0) != NULL);
+	HOST_CHECK(CAN_FindRoute(&table, CAN_ID_STD, 0x6F0) == NULL);
+	CAN_SetFallbackHandler(&table, TEST_Count, fallback);
+
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_EXT, 0x6F0, data, 8) == 0);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x700, data, 8) == 0);
+	CAN_HandleReceived(&TEST_Hcan, &ring, &table, CAN_RX_FIFO0);
+	HOST_CHECK(CAN_DispatchReceived(&ring, &table, 8) == 2);
+	HOST_CHECK(routed[0] == 1 && routed[1] == 0x6F0);
+	HOST_CHECK(fallback[0] == 1 && fallback[1] == 0x700 && table.unhandled == 1);
+}
+
+static void TEST_Ignore(const CAN_RxFrame *frame, void *ctx)
+{
+	(void)frame;
+	(void)ctx;
+}
+
+static void can_filters(void)
+{
+	static CAN_RxRouteTable table;
+	static const uint32_t normal[] = {0x100, 0x101, 0x234, 0x3F0, 0x555};
+	uint8_t data[CAN_MAX_DLC] = {0};
+
+	TEST_Init();
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 1);						// accept-all of CAN_Init
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x7FF, data, 8) == 0);
+	HAL_CAN_GetRxMessage(&TEST_Hcan, CAN_RX_FIFO0, &(CAN_RxHeader){0}, data);
+
+	for(uint8_t i = 0; i < sizeof(normal) / sizeof(normal[0]); i++)
+		CAN_RegisterHandler(&table, CAN_ID_STD, normal[i], TEST_Ignore, NULL);
+	CAN_RegisterHandler(&table, CAN_ID_EXT, 0x18FF0001, TEST_Ignore, NULL);
+	CAN_RegisterImmediateHandler(&table, CAN_ID_STD, 0x010, TEST_Ignore, NULL);
+
+	// exact filters: 1 bank for FIFO1, 2 standard and 1 extended bank for FIFO0
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &table, 0, 14, 0) == HAL_OK);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 4);
+	HOST_CHECK(HOST_CAN_Notifications(&TEST_Hcan) & CAN_IT_RX_FIFO1_MSG_PENDING);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x010, data, 8) == 1);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x234, data, 8) == 0);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_EXT, 0x18FF0001, data, 8) == 0);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x235, data, 8) == -1);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_EXT, 0x234, data, 8) == -1);
+	while(HAL_CAN_GetRxMessage(&TEST_Hcan, CAN_RX_FIFO0, &(CAN_RxHeader){0}, data) == HAL_OK);
+
+	// without immediate routes FIFO1 interrupt is switched off and its bank freed
+	CAN_UnregisterHandler(&table, CAN_ID_STD, 0x010);
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &table, 0, 14, 0) == HAL_OK);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 3);
+	HOST_CHECK(!(HOST_CAN_Notifications(&TEST_Hcan) & CAN_IT_RX_FIFO1_MSG_PENDING));
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x010, data, 8) == -1);
+
+	// two most urgent IDs go to FIFO1 on request
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &table, 0, 14, 2) == HAL_OK);
+	HOST_CHECK(HOST_CAN_Notifications(&TEST_Hcan) & CAN_IT_RX_FIFO1_MSG_PENDING);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x101, data, 8) == 1);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x234, data, 8) == 0);
+	while(HAL_CAN_GetRxMessage(&TEST_Hcan, CAN_RX_FIFO0, &(CAN_RxHeader){0}, data) == HAL_OK);
+	while(HAL_CAN_GetRxMessage(&TEST_Hcan, CAN_RX_FIFO1, &(CAN_RxHeader){0}, data) == HAL_OK);
+
+	// merged into masks when banks are short, every registered ID still passes
+	TEST_Init();
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &table, 0, 2, 0) == HAL_OK);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 2);
+	for(uint8_t i = 0; i < sizeof(normal) / sizeof(normal[0]); i++)
+	{
+		HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, normal[i], data, 8) == 0);
+		HAL_CAN_GetRxMessage(&TEST_Hcan, CAN_RX_FIFO0, &(CAN_RxHeader){0}, data);
+	}
+}
+
+static void can_filters_out_of_banks(void)
+{
+	static CAN_RxRouteTable table;
+	uint8_t data[CAN_MAX_DLC] = {0};
+
+	TEST_Init();
+	CAN_RegisterHandler(&table, CAN_ID_STD, 0x100, TEST_Ignore, NULL);
+	CAN_RegisterHandler(&table, CAN_ID_EXT, 0x100, TEST_Ignore, NULL);
+	CAN_RegisterImmediateHandler(&table, CAN_ID_STD, 0x010, TEST_Ignore, NULL);
+
+	// 3 banks needed at least, accept-all of CAN_Init is not left behind
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &table, 0, 2, 0) == HAL_ERROR);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 0);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x7FF, data, 8) == -1);
+
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &table, 0, 3, 0) == HAL_OK);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_EXT, 0x100, data, 8) == 0);
+	HOST_CHECK(HOST_CAN_Notifications(&TEST_Hcan) & CAN_IT_RX_FIFO1_MSG_PENDING);
+
+	// failed reconfiguration closes its banks and FIFO1 interrupt, bank 2 is outside of given range and stays
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &table, 0, 2, 0) == HAL_ERROR);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 1);
+	HOST_CHECK(!(HOST_CAN_Notifications(&TEST_Hcan) & CAN_IT_RX_FIFO1_MSG_PENDING));
+
+	// banks beyond hardware, fails after FIFO1 interrupt was activated
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &table, 12, 4, 0) == HAL_ERROR);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 1);
+	HOST_CHECK(!(HOST_CAN_Notifications(&TEST_Hcan) & CAN_IT_RX_FIFO1_MSG_PENDING));
+}
+
+static CAN_RxRing TEST_Ring;
+static CAN_RxRouteTable TEST_Table;
+
+/**
+ * @brief Immediate handler of FIFO1 preempted by FIFO0 interrupt, which pushes into the same ring
+ */
+static void TEST_Preempted(const CAN_RxFrame *frame, void *ctx)
+{
+	uint32_t id = __CAN_HEADER_ID(&frame->header);
+
+	CAN_HandleReceived(&TEST_Hcan, &TEST_Ring, &TEST_Table, CAN_RX_FIFO0);
+	((uint32_t*)ctx)[0]++;
+	((uint32_t*)ctx)[1] = (__CAN_HEADER_ID(&frame->header) == id && frame->data[0] == 0x10) ? id : 0;
+}
+
+static void TEST_Record(const CAN_RxFrame *frame, void *ctx)
+{
+	uint32_t *ids = (uint32_t*)ctx;
+	ids[1 + ids[0]++ % 7] = __CAN_HEADER_ID(&frame->header);
+}
+
+static void can_rx_fifo_preemption(void)
+{
+	uint32_t immediate[2] = {0};
+	uint32_t ids[8] = {0};
+	uint8_t data[CAN_MAX_DLC] = {0};
+
+	TEST_Init();
+	memset(&TEST_Ring, 0, sizeof(TEST_Ring));
+	memset(&TEST_Table, 0, sizeof(TEST_Table));
+	CAN_RegisterImmediateHandler(&TEST_Table, CAN_ID_STD, 0x010, TEST_Preempted, immediate);
+	CAN_RegisterHandler(&TEST_Table, CAN_ID_STD, 0x020, TEST_Record, ids);
+	CAN_RegisterHandler(&TEST_Table, CAN_ID_STD, 0x300, TEST_Record, ids);
+	CAN_RegisterHandler(&TEST_Table, CAN_ID_STD, 0x301, TEST_Record, ids);
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &TEST_Table, 0, 14, 2) == HAL_OK);
+
+	// FIFO1: immediate 0x010 and urgent 0x020, FIFO0: bulk frames arriving while FIFO1 is handled
+	data[0] = 0x10;
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x010, data, 8) == 1);
+	data[0] = 0x20;
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x020, data, 8) == 1);
+	data[0] = 0x30;
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x300, data, 8) == 0);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x301, data, 8) == 0);
+
+	CAN_HandleReceived(&TEST_Hcan, &TEST_Ring, &TEST_Table, CAN_RX_FIFO1);
+	HOST_CHECK(!HOST_IrqDisabled());
+
+	// handler's frame survived the pushes of the preempting interrupt
+	HOST_CHECK(immediate[0] == 1 && immediate[1] == 0x010);
+	HOST_CHECK(TEST_Ring.rxFrames == 4 && TEST_Ring.head == 3 && TEST_Ring.dropped == 0);
+
+	// every pushed frame is published once, in order of pushing
+	HOST_CHECK(CAN_DispatchReceived(&TEST_Ring, &TEST_Table, 8) == 3);
+	HOST_CHECK(ids[0] == 3 && ids[1] == 0x300 && ids[2] == 0x301 && ids[3] == 0x020);
+	HOST_CHECK(TEST_Ring.frames[2].data[0] == 0x20);
+}
+
+static void can_telemetry_recovery(void)
+{
+	static CAN_Telemetry telemetry;
+	static CAN_RxRing ring;
+
+	TEST_Init();
+	memset(&telemetry, 0, sizeof(telemetry));
+	CAN_Telemetry_Init(&telemetry, &TEST_Hcan, &TEST_Queue, &ring, 500000);
+	HOST_CHECK(HOST_CAN_Starts(&TEST_Hcan) == 1);
+
+	HOST_SetTick(1000);
+	TEST_Instance.ESR |= CAN_ESR_BOFF;
+	CAN_Telemetry_Update(&telemetry);
+	HOST_CHECK(telemetry.state == CAN_STATE_BUSOFF && telemetry.busOffCount == 1);
+
+	// bus stays dominant: failed start (10 ms timeout) leaves the handle ready for the next attempt
+	HOST_CAN_FailStarts(&TEST_Hcan, 2);
+	HOST_SetTick(1100);
+	CAN_Telemetry_Update(&telemetry);
+	HOST_CHECK(telemetry.failedRecoveries == 1 && telemetry.recoveries == 0);
+	HOST_CHECK(TEST_Hcan.State == HAL_CAN_STATE_READY && !HOST_CAN_Started(&TEST_Hcan));
+	HOST_CHECK(telemetry.recoveryHoldoff == 2 * CAN_TELEMETRY_RECOVERY_MS);
+	HOST_CHECK(telemetry.busOffTick == 1110);
+
+	// holdoff doubled, no blocking attempt before it elapses
+	HOST_SetTick(1309);
+	CAN_Telemetry_Update(&telemetry);
+	HOST_CHECK(telemetry.failedRecoveries == 1);
+	HOST_SetTick(1310);
+	CAN_Telemetry_Update(&telemetry);
+	HOST_CHECK(telemetry.failedRecoveries == 2 && telemetry.recoveryHoldoff == 4 * CAN_TELEMETRY_RECOVERY_MS);
+
+	// bus released
+	HOST_SetTick(1720);
+	CAN_Telemetry_Update(&telemetry);
+	HOST_CHECK(telemetry.recoveries == 1 && HOST_CAN_Started(&TEST_Hcan) && HOST_CAN_Starts(&TEST_Hcan) == 2);
+	HOST_CHECK(telemetry.recoveryHoldoff == CAN_TELEMETRY_RECOVERY_MS);
+	CAN_Telemetry_Update(&telemetry);
+	HOST_CHECK(telemetry.state == CAN_STATE_ACTIVE);
+
+	// holdoff is restored for the next bus-off
+	HOST_SetTick(2000);
+	TEST_Instance.ESR |= CAN_ESR_BOFF;
+	CAN_Telemetry_Update(&telemetry);
+	HOST_SetTick(2100);
+	CAN_Telemetry_Update(&telemetry);
+	HOST_CHECK(telemetry.recoveries == 2 && telemetry.busOffCount == 2);
+}
+
+#define TEST_ISOTP_A 	0x7E0						// TX ID of link A, RX ID of link B
+#define TEST_ISOTP_B 	0x7E8
+
+static CAN_IsoTpLink TEST_LinkA;
+static CAN_IsoTpLink TEST_LinkB;
+static uint32_t TEST_IsoTpFrames[256];				// ticks of frames sent by A
+static uint32_t TEST_IsoTpCount;
+
+static void TEST_IsoTpReceived(CAN_IsoTpLink *link, CAN_IsoTpResult result, uint32_t length)
+{
+	((uint32_t*)link->ctx)[0] = result;
+	((uint32_t*)link->ctx)[1] = length;
+	((uint32_t*)link->ctx)[2]++;
+}
+
+static void TEST_IsoTpSent(CAN_IsoTpLink *link, CAN_IsoTpResult result)
+{
+	((uint32_t*)link->ctx)[3] = result;
+	((uint32_t*)link->ctx)[4]++;
+}
+
+static void TEST_IsoTpInit(uint8_t *bufferA, uint32_t capacityA, uint32_t *resultA, uint8_t *bufferB, uint32_t capacityB,
+						   uint32_t *resultB, uint8_t blockSize, uint8_t stMin)
+{
+	TEST_Init();
+	TEST_Instance.MCR |= CAN_MCR_TXFP;
+	TEST_IsoTpCount = 0;
+
+	memset(&TEST_LinkA, 0, sizeof(TEST_LinkA));
+	memset(&TEST_LinkB, 0, sizeof(TEST_LinkB));
+	HOST_CHECK(CAN_IsoTp_Init(&TEST_LinkA, &TEST_Hcan, &TEST_Queue, CAN_ID_STD, TEST_ISOTP_A, bufferA, capacityA, 0, 0) == HAL_OK);
+	HOST_CHECK(CAN_IsoTp_Init(&TEST_LinkB, &TEST_Hcan, &TEST_Queue, CAN_ID_STD, TEST_ISOTP_B, bufferB, capacityB, blockSize, stMin) == HAL_OK);
+	TEST_LinkA.Received = TEST_LinkB.Received = TEST_IsoTpReceived;
+	TEST_LinkA.Sent = TEST_LinkB.Sent = TEST_IsoTpSent;
+	TEST_LinkA.ctx = resultA;
+	TEST_LinkB.ctx = resultB;
+}
+
+/**
+ * @brief Sends every pending mailbox to the other link of the loopback, returns number of frames on the bus
+ */
+static uint32_t TEST_IsoTpBus(void)
+{
+	HOST_CanFrame sent;
+	uint32_t frames = 0;
+
+	while(HOST_CAN_CompleteMailbox(&TEST_Hcan, &sent))
+	{
+		CAN_RxFrame frame;
+
+		memset(&frame, 0, sizeof(frame));
+		frame.header.IDE = CAN_ID_STD;
+		frame.header.StdId = sent.id;
+		frame.header.DLC = sent.length;
+		memcpy(frame.data, sent.data, sent.length);
+		frame.tick = HAL_GetTick();
+
+		CAN_HandleTxMailboxEmpty(&TEST_Hcan, &TEST_Queue);
+		if(sent.id == TEST_ISOTP_A)
+		{
+			if(TEST_IsoTpCount < 256)
+				TEST_IsoTpFrames[TEST_IsoTpCount] = frame.tick;
+			TEST_IsoTpCount++;
+			CAN_IsoTp_HandleFrame(&frame, &TEST_LinkB);
+		}
+		else
+		{
+			CAN_IsoTp_HandleFrame(&frame, &TEST_LinkA);
+		}
+		frames++;
+	}
+
+	return frames;
+}
+
+static void can_isotp_loopback(void)
+{
+	static uint8_t payload[5000];
+	static uint8_t bufferB[5000];
+	uint8_t bufferA[16];
+	uint32_t resultA[5] = {0}, resultB[5] = {0};
+
+	for(uint32_t i = 0; i < sizeof(payload); i++)
+		payload[i] = (uint8_t)(i * 7 + 3);
+
+	// block size 4, 12-bit and 32-bit escaped lengths
+	TEST_IsoTpInit(bufferA, sizeof(bufferA), resultA, bufferB, sizeof(bufferB), resultB, 4, 0);
+	static const uint32_t lengths[] = {5, 8, 100, 4095, 5000};
+	for(uint8_t t = 0; t < sizeof(lengths) / sizeof(lengths[0]); t++)
+	{
+		memset(bufferB, 0, sizeof(bufferB));
+		HOST_CHECK(CAN_IsoTp_Send(&TEST_LinkA, payload, lengths[t]) == HAL_OK);
+		for(uint32_t i = 0; i < 2000 && TEST_LinkA.txState != CAN_ISOTP_IDLE; i++)
+		{
+			TEST_IsoTpBus();
+			CAN_IsoTp_Poll(&TEST_LinkA);
+		}
+		TEST_IsoTpBus();
+
+		HOST_CHECK(resultA[4] == t + 1u && resultA[3] == CAN_ISOTP_OK);
+		HOST_CHECK(resultB[2] == t + 1u && resultB[0] == CAN_ISOTP_OK && resultB[1] == lengths[t]);
+		HOST_CHECK(memcmp(bufferB, payload, lengths[t]) == 0);
+	}
+
+	// receiver buffer too small: overflow flow control ends the transfer on both sides
+	HOST_CHECK(CAN_IsoTp_Send(&TEST_LinkB, payload, 100) == HAL_OK);
+	TEST_IsoTpBus();
+	HOST_CHECK(resultA[2] == 1 && resultA[0] == CAN_ISOTP_OVERFLOW && resultA[1] == 100);
+	HOST_CHECK(resultB[4] == 1 && resultB[3] == CAN_ISOTP_OVERFLOW && TEST_LinkB.txState == CAN_ISOTP_IDLE);
+}
+
+static void can_isotp_stmin(void)
+{
+	static uint8_t payload[64];
+	uint8_t bufferA[8], bufferB[64];
+	uint32_t resultA[5] = {0}, resultB[5] = {0};
+
+	// STmin 2 ms: frames of A sent at ticks 0 (FF), then every 3 ticks since the HAL tick may be partly elapsed
+	TEST_IsoTpInit(bufferA, sizeof(bufferA), resultA, bufferB, sizeof(bufferB), resultB, 0, 2);
+	HOST_CHECK(CAN_IsoTp_Send(&TEST_LinkA, payload, sizeof(payload)) == HAL_OK);
+	for(uint32_t tick = 0; tick < 100 && TEST_LinkA.txState != CAN_ISOTP_IDLE; tick++)
+	{
+		HOST_SetTick(tick);
+		CAN_IsoTp_Poll(&TEST_LinkA);
+		TEST_IsoTpBus();
+	}
+
+	HOST_CHECK(resultB[2] == 1 && resultB[0] == CAN_ISOTP_OK && memcmp(bufferB, payload, sizeof(payload)) == 0);
+	HOST_CHECK(TEST_IsoTpCount == 1 + 9);
+	HOST_CHECK(TEST_IsoTpFrames[1] == 0);					// first CF right after flow control
+	for(uint32_t i = 2; i < TEST_IsoTpCount; i++)
+		HOST_CHECK(TEST_IsoTpFrames[i] - TEST_IsoTpFrames[i - 1] == 3);
+}
+
+static void can_isotp_pending_fc(void)
+{
+	static uint8_t payload[40];
+	uint8_t bufferA[8], bufferB[40];
+	uint32_t resultA[5] = {0}, resultB[5] = {0};
+	uint8_t filler[CAN_MAX_DLC] = {0};
+	CAN_TxHeader header = {.StdId = 0x100, .IDE = CAN_ID_STD, .DLC = CAN_MAX_DLC};
+
+	TEST_IsoTpInit(bufferA, sizeof(bufferA), resultA, bufferB, sizeof(bufferB), resultB, 2, 0);
+	HOST_CHECK(CAN_IsoTp_Send(&TEST_LinkA, payload, sizeof(payload)) == HAL_OK);
+
+	// first frame reaches B while its TX queue is full, flow control stays pending
+	HOST_CAN_CompleteMailbox(&TEST_Hcan, &(HOST_CanFrame){0});
+	while(CAN_Transmit(&TEST_Hcan, &TEST_Queue, &header, filler) == HAL_OK);
+	CAN_RxFrame ff = {.header = {.StdId = TEST_ISOTP_A, .IDE = CAN_ID_STD, .DLC = CAN_MAX_DLC}};
+	ff.data[0] = 0x10;
+	ff.data[1] = sizeof(payload);
+	CAN_IsoTp_HandleFrame(&ff, &TEST_LinkB);
+	HOST_CHECK(TEST_LinkB.rxState == CAN_ISOTP_RECEIVING && TEST_LinkB.rxFcPending);
+
+	CAN_IsoTp_Poll(&TEST_LinkB);
+	HOST_CHECK(TEST_LinkB.rxFcPending);
+
+	// queue drained, retried flow control lets A finish in blocks of 2
+	while(HOST_CAN_CompleteMailbox(&TEST_Hcan, &(HOST_CanFrame){0}))
+		CAN_HandleTxMailboxEmpty(&TEST_Hcan, &TEST_Queue);
+	HOST_SetTick(500);
+	CAN_IsoTp_Poll(&TEST_LinkB);
+	HOST_CHECK(!TEST_LinkB.rxFcPending && TEST_LinkB.rxTick == 500);
+	for(uint32_t i = 0; i < 50 && TEST_LinkA.txState != CAN_ISOTP_IDLE; i++)
+	{
+		TEST_IsoTpBus();
+		CAN_IsoTp_Poll(&TEST_LinkA);
+	}
+	HOST_CHECK(resultA[4] == 1 && resultA[3] == CAN_ISOTP_OK);
+	HOST_CHECK(resultB[2] == 1 && resultB[0] == CAN_ISOTP_OK && resultB[1] == sizeof(payload));
+
+	// pending flow control of a timed out reception is dropped
+	CAN_RxFrame cf = {.header = {.StdId = TEST_ISOTP_A, .IDE = CAN_ID_STD, .DLC = CAN_MAX_DLC}};
+	while(CAN_Transmit(&TEST_Hcan, &TEST_Queue, &header, filler) == HAL_OK);
+	CAN_IsoTp_HandleFrame(&ff, &TEST_LinkB);
+	cf.data[0] = 0x21;
+	CAN_IsoTp_HandleFrame(&cf, &TEST_LinkB);
+	cf.data[0] = 0x22;
+	CAN_IsoTp_HandleFrame(&cf, &TEST_LinkB);
+	HOST_CHECK(TEST_LinkB.rxFcPending && TEST_LinkB.rxFcStatus == 0);
+	HOST_SetTick(500 + CAN_ISOTP_TIMEOUT_MS + 1);
+	CAN_IsoTp_Poll(&TEST_LinkB);
+	HOST_CHECK(resultB[2] == 2 && resultB[0] == CAN_ISOTP_TIMEOUT && !TEST_LinkB.rxFcPending);
+}
+
+int main(int argc, char **argv)
+{
+	static const HOST_Test tests[] = {
+		HOST_TEST(can_scheduler),
+		HOST_TEST(can_remove_scheduled),
+		HOST_TEST(can_routes),
+		HOST_TEST(can_filters),
+		HOST_TEST(can_filters_out_of_banks),
+		HOST_TEST(can_rx_fifo_preemption),
+		HOST_TEST(can_telemetry_recovery),
+		HOST_TEST(can_isotp_loopback),
+		HOST_TEST(can_isotp_stmin),
+		HOST_TEST(can_isotp_pending_fc),
+	};
+
+	return HOST_RunTests(tests, HOST_TEST_COUNT(tests), argc, argv);
+}
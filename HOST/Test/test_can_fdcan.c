@@ -0,0 +1,125 @@
+/**
+  * @file test_can_fdcan.c
+  * @brief Host tests of CAN driver on FDCAN (G4), frames of up to 64 data bytes and FIFO1 routing by filter elements
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "host_test.h"
+#include "can_driver.h"
+#include <string.h>
+
+static FDCAN_GlobalTypeDef TEST_Instance;
+static CAN_Handle TEST_Hcan;
+static CAN_TxQueue TEST_Queue;
+static CAN_RxRing TEST_Ring;
+static CAN_RxRouteTable TEST_Table;
+
+static void TEST_Init(void)
+{
+	memset(&TEST_Hcan, 0, sizeof(TEST_Hcan));
+	memset(&TEST_Queue, 0, sizeof(TEST_Queue));
+	memset(&TEST_Ring, 0, sizeof(TEST_Ring));
+	memset(&TEST_Table, 0, sizeof(TEST_Table));
+	HOST_CAN_Setup(&TEST_Hcan, &TEST_Instance);
+	CAN_Init(&TEST_Hcan);
+}
+
+static void TEST_Count(const CAN_RxFrame *frame, void *ctx)
+{
+	((uint32_t*)ctx)[0]++;
+	((uint32_t*)ctx)[1] = __CAN_HEADER_ID(&frame->header);
+	((uint32_t*)ctx)[2] = __CAN_HEADER_LENGTH(&frame->header);
+}
+
+static void can_fdcan_frames(void)
+{
+	CAN_TxHeader header = {.Identifier = 0x123, .IdType = CAN_ID_STD, .FDFormat = FDCAN_FD_CAN};
+	uint8_t data[CAN_MAX_DATA];
+	uint32_t routed[3] = {0};
+	HOST_CanFrame sent;
+
+	TEST_Init();
+	HOST_CHECK(CAN_LengthToDlc(13) == FDCAN_DLC_BYTES_16 && CAN_DlcToLength(FDCAN_DLC_BYTES_48) == 48);
+
+	for(uint8_t i = 0; i < CAN_MAX_DATA; i++)
+		data[i] = i;
+	header.DataLength = CAN_LengthToDlc(64);
+	HOST_CHECK(CAN_Transmit(&TEST_Hcan, &TEST_Queue, &header, data) == HAL_OK);
+	HOST_CHECK(HOST_CAN_CompleteMailbox(&TEST_Hcan, &sent) && sent.length == 64 && memcmp(sent.data, data, 64) == 0);
+	HOST_CHECK(TEST_Queue.txBits == CAN_FrameBits(CAN_ID_STD, 64));
+
+	// 20 bytes fit DLC 11 exactly, every frame is accepted into FIFO0 by CAN_Init
+	CAN_RegisterHandler(&TEST_Table, CAN_ID_EXT, 0x1ABCDE, TEST_Count, routed);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_EXT, 0x1ABCDE, data, 20) == 0);
+	CAN_HandleReceived(&TEST_Hcan, &TEST_Ring, &TEST_Table, CAN_RX_FIFO0);
+	HOST_CHECK(CAN_DispatchReceived(&TEST_Ring, &TEST_Table, 4) == 1);
+	HOST_CHECK(routed[0] == 1 && routed[1] == 0x1ABCDE && routed[2] == 20);
+	HOST_CHECK(TEST_Ring.rxBits == CAN_FrameBits(CAN_ID_EXT, 20));
+}
+
+static void can_fdcan_filters(void)
+{
+	uint32_t immediate[3] = {0};
+	uint32_t routed[3] = {0};
+	uint8_t data[8] = {0};
+
+	TEST_Init();
+	HOST_CHECK(!(HOST_CAN_Notifications(&TEST_Hcan) & FDCAN_IT_RX_FIFO1_NEW_MESSAGE));
+
+	CAN_RegisterImmediateHandler(&TEST_Table, CAN_ID_STD, 0x010, TEST_Count, immediate);
+	CAN_RegisterImmediateHandler(&TEST_Table, CAN_ID_EXT, 0x18FF0001, TEST_Count, immediate);
+	CAN_RegisterHandler(&TEST_Table, CAN_ID_STD, 0x100, TEST_Count, routed);
+	CAN_RegisterHandler(&TEST_Table, CAN_ID_STD, 0x200, TEST_Count, routed);
+
+	// 0x010 and 0x100 share a dual ID element, the extended ID takes one of the extended list
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &TEST_Table, 0, 4, 2) == HAL_OK);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 2);
+	HOST_CHECK(HOST_CAN_Notifications(&TEST_Hcan) & FDCAN_IT_RX_FIFO1_NEW_MESSAGE);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x010, data, 8) == 1);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_EXT, 0x18FF0001, data, 8) == 1);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x100, data, 8) == 1);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x200, data, 8) == 0);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x7FF, data, 8) == 0);	// global filter of CAN_Init
+
+	// immediate handlers run in FIFO1 interrupt, urgent frame waits in the ring
+	CAN_HandleReceived(&TEST_Hcan, &TEST_Ring, &TEST_Table, CAN_RX_FIFO1);
+	HOST_CHECK(immediate[0] == 2 && routed[0] == 0);
+	HOST_CHECK(CAN_DispatchReceived(&TEST_Ring, &TEST_Table, 4) == 1 && routed[1] == 0x100);
+	CAN_HandleReceived(&TEST_Hcan, &TEST_Ring, &TEST_Table, CAN_RX_FIFO0);
+	HOST_CHECK(CAN_DispatchReceived(&TEST_Ring, &TEST_Table, 4) == 2 && TEST_Table.unhandled == 1);
+
+	// without urgent IDs FIFO1 elements and interrupt are switched off
+	CAN_UnregisterHandler(&TEST_Table, CAN_ID_STD, 0x010);
+	CAN_UnregisterHandler(&TEST_Table, CAN_ID_EXT, 0x18FF0001);
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &TEST_Table, 0, 4, 0) == HAL_OK);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 0);
+	HOST_CHECK(!(HOST_CAN_Notifications(&TEST_Hcan) & FDCAN_IT_RX_FIFO1_NEW_MESSAGE));
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x100, data, 8) == 0);
+
+	// out of elements: nothing is routed to FIFO1, immediate IDs still arrive through FIFO0
+	CAN_RegisterImmediateHandler(&TEST_Table, CAN_ID_STD, 0x010, TEST_Count, immediate);
+	CAN_RegisterImmediateHandler(&TEST_Table, CAN_ID_STD, 0x011, TEST_Count, immediate);
+	CAN_RegisterImmediateHandler(&TEST_Table, CAN_ID_STD, 0x012, TEST_Count, immediate);
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &TEST_Table, 0, 1, 0) == HAL_ERROR);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 0);
+	HOST_CHECK(!(HOST_CAN_Notifications(&TEST_Hcan) & FDCAN_IT_RX_FIFO1_NEW_MESSAGE));
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x012, data, 8) == 0);
+	CAN_HandleReceived(&TEST_Hcan, &TEST_Ring, &TEST_Table, CAN_RX_FIFO0);
+	HOST_CHECK(immediate[0] == 3 && immediate[1] == 0x012);
+
+	// elements beyond Init.StdFiltersNbr are not used
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &TEST_Table, HOST_FDCAN_STD_FILTERS - 1, 4, 0) == HAL_ERROR);
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &TEST_Table, HOST_FDCAN_STD_FILTERS - 2, 4, 0) == HAL_OK);
+	HOST_CHECK(HOST_CAN_ActiveFilters(&TEST_Hcan) == 2);
+	HOST_CHECK(HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, 0x011, data, 8) == 1);
+}
+
+int main(int argc, char **argv)
+{
+	static const HOST_Test tests[] = {
+		HOST_TEST(can_fdcan_frames),
+		HOST_TEST(can_fdcan_filters),
+	};
+
+	return HOST_RunTests(tests, HOST_TEST_COUNT(tests), argc, argv);
+}
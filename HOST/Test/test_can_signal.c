@@ -0,0 +1,185 @@
+/**
+  * @file test_can_signal.c
+  * @brief Host tests of signal packing, every layout is compared with a bit by bit reference of DBC semantics
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "host_test.h"
+#include "can_signal.h"
+#include <string.h>
+
+static uint32_t TEST_Seed = 1;
+
+static uint32_t TEST_Random(void)
+{
+	TEST_Seed = TEST_Seed * 1664525U + 1013904223U;
+	return TEST_Seed;
+}
+
+/**
+ * @brief Absolute bit positions (bit 0 is bit 0 of data[0]) of raw bits 0..length-1, 0 when signal leaves the frame
+ * 		  Intel: start is the least significant bit, next bits go up
+ * 		  Motorola: start is the most significant bit, next bits go down inside a byte and continue at bit 7 of the next byte
+ */
+static uint8_t TEST_Positions(uint8_t motorola, uint8_t start, uint8_t length, uint8_t bytes, uint8_t *positions)
+{
+	int16_t position = start;
+
+	for(uint8_t k = 0; k < length; k++)
+	{
+		uint8_t bit = motorola ? (uint8_t)(length - 1 - k) : k;
+
+		if(position < 0 || position >= 8 * bytes)
+			return 0;
+		positions[bit] = (uint8_t)position;
+
+		if(motorola)
+			position = (position % 8 == 0) ? position + 15 : position - 1;
+		else
+			position++;
+	}
+
+	return 1;
+}
+
+static void TEST_ReferencePack(const uint8_t *positions, uint8_t length, uint32_t raw, uint8_t *data)
+{
+	for(uint8_t k = 0; k < length; k++)
+	{
+		if((raw >> k) & 1)
+			data[positions[k] / 8] |= (uint8_t)(1 << (positions[k] % 8));
+	}
+}
+
+static void can_signal_reference(void)
+{
+	uint8_t positions[32];
+	uint32_t layouts = 0;
+
+	for(uint8_t motorola = 0; motorola < 2; motorola++)
+	{
+		for(uint8_t length = 1; length <= 32; length++)
+		{
+			for(uint8_t start = 0; start < 64; start++)
+			{
+				uint32_t source = 0;
+				int32_t signedSource = 0;
+				CAN_Signal layout[2] = {
+					motorola ? (CAN_Signal)CAN_SIGNAL_MOTOROLA(start, length, 0, 1.0f, 0.0f, CAN_SIGNAL_U32, &source)
+							 : (CAN_Signal)CAN_SIGNAL_INTEL(start, length, 0, 1.0f, 0.0f, CAN_SIGNAL_U32, &source),
+					motorola ? (CAN_Signal)CAN_SIGNAL_MOTOROLA(start, length, 1, 1.0f, 0.0f, CAN_SIGNAL_I32, &signedSource)
+							 : (CAN_Signal)CAN_SIGNAL_INTEL(start, length, 1, 1.0f, 0.0f, CAN_SIGNAL_I32, &signedSource)
+				};
+				CAN_SignalTable unsignedTable = {.signals = &layout[0], .count = 1};
+				CAN_SignalTable signedTable = {.signals = &layout[1], .count = 1};
+				uint8_t fits = TEST_Positions(motorola, start, length, 8, positions);
+
+				HOST_CHECK((CAN_Signal_Check(&unsignedTable, 8) == HAL_OK) == fits);
+				if(!fits)
+					continue;
+				layouts++;
+
+				for(uint8_t round = 0; round < 8; round++)
+				{
+					uint32_t mask = (length == 32) ? 0xFFFFFFFFU : ((1U << length) - 1);
+					uint32_t raw = TEST_Random() & mask;
+					uint8_t expected[8] = {0};
+					uint8_t packed[8];
+
+					TEST_ReferencePack(positions, length, raw, expected);
+
+					source = raw;
+					memset(packed, 0x5A, sizeof(packed));
+					CAN_Signal_Pack(&unsignedTable, packed, 8);
+					HOST_CHECK(memcmp(packed, expected, 8) == 0);
+
+					source = ~raw;
+					CAN_Signal_Unpack(&unsignedTable, expected, 8);
+					HOST_CHECK(source == raw);
+
+					// same bits read as two's complement of signal length
+					int64_t value = (int64_t)raw - (((raw >> (length - 1)) & 1) ? ((int64_t)1 << length) : 0);
+					signedSource = (int32_t)value;
+					CAN_Signal_Pack(&signedTable, packed, 8);
+					HOST_CHECK(memcmp(packed, expected, 8) == 0);
+
+					signedSource = 0;
+					CAN_Signal_Unpack(&signedTable, expected, 8);
+					HOST_CHECK(signedSource == (int32_t)value);
+				}
+			}
+		}
+	}
+
+	// every fitting (start, length) pair of both byte orders was covered
+	HOST_CHECK(layouts == 2 * (32 * 64 - 32 * 31 / 2));
+}
+
+static void can_signal_frame(void)
+{
+	uint8_t positions[32];
+	uint16_t speed = 0;
+	int8_t torque = 0;
+	uint8_t mode = 0;
+	float voltage = 0.0f;
+	float temperature = 0.0f;
+	static const uint8_t starts[] = {0, 23, 28, 32, 55};
+	static const uint8_t lengths[] = {16, 8, 4, 12, 10};
+	static const uint8_t motorola[] = {0, 1, 0, 0, 1};
+	const CAN_Signal signals[] = {
+		CAN_SIGNAL_INTEL(0, 16, 0, 1.0f, 0.0f, CAN_SIGNAL_U16, &speed),
+		CAN_SIGNAL_MOTOROLA(23, 8, 1, 1.0f, 0.0f, CAN_SIGNAL_I8, &torque),
+		CAN_SIGNAL_INTEL(28, 4, 0, 1.0f, 0.0f, CAN_SIGNAL_U8, &mode),
+		CAN_SIGNAL_INTEL(32, 12, 0, 0.1f, 0.0f, CAN_SIGNAL_FLOAT, &voltage),
+		CAN_SIGNAL_MOTOROLA(55, 10, 1, 0.5f, -40.0f, CAN_SIGNAL_FLOAT, &temperature),
+	};
+	const CAN_SignalTable table = CAN_SIGNAL_TABLE(signals);
+	uint8_t expected[8] = {0};
+	uint8_t packed[8];
+
+	HOST_CHECK(CAN_Signal_Check(&table, 8) == HAL_OK);
+	HOST_CHECK(CAN_Signal_Check(&table, 7) == HAL_ERROR);
+
+	// raw values: 54321, -77, 9, 2345 (234.5 V), -330 (-205 degC)
+	speed = 54321;
+	torque = -77;
+	mode = 9;
+	voltage = 234.5f;
+	temperature = -205.0f;
+	const uint32_t raws[] = {54321, (uint8_t)-77, 9, 2345, (uint32_t)-330 & 0x3FF};
+	for(uint8_t i = 0; i < 5; i++)
+	{
+		HOST_CHECK(TEST_Positions(motorola[i], starts[i], lengths[i], 8, positions));
+		TEST_ReferencePack(positions, lengths[i], raws[i], expected);
+	}
+
+	CAN_Signal_Pack(&table, packed, 8);
+	HOST_CHECK(memcmp(packed, expected, 8) == 0);
+
+	speed = 0;
+	torque = 0;
+	mode = 0;
+	voltage = 0.0f;
+	temperature = 0.0f;
+	CAN_Signal_Unpack(&table, expected, 8);
+	HOST_CHECK(speed == 54321 && torque == -77 && mode == 9);
+	HOST_CHECK(voltage > 234.49f && voltage < 234.51f && temperature == -205.0f);
+
+	// out of range values saturate to the signal range
+	mode = 200;
+	torque = -128;
+	temperature = 1000.0f;
+	CAN_Signal_Pack(&table, packed, 8);
+	CAN_Signal_Unpack(&table, packed, 8);
+	HOST_CHECK(mode == 15 && torque == -128 && temperature == 511 * 0.5f - 40.0f);
+}
+
+int main(int argc, char **argv)
+{
+	static const HOST_Test tests[] = {
+		HOST_TEST(can_signal_reference),
+		HOST_TEST(can_signal_frame),
+	};
+
+	return HOST_RunTests(tests, HOST_TEST_COUNT(tests), argc, argv);
+}
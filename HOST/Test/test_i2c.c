@@ -0,0 +1,349 @@
+/**
+  * @file test_i2c.c
+  * @brief Host tests of asynchronous I2C transfers and the bus queue against simulated slaves
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "host_test.h"
+#include "I2C_driver.h"
+#include <string.h>
+
+static I2C_HandleTypeDef TEST_Hi2c;
+static HOST_I2C_Slave TEST_Slave;
+static I2C_bus TEST_Bus;
+
+static void TEST_Init(uint8_t address, uint8_t hang)
+{
+	memset(&TEST_Hi2c, 0, sizeof(TEST_Hi2c));
+	memset(&TEST_Slave, 0, sizeof(TEST_Slave));
+	TEST_Slave.address = address;
+	TEST_Slave.addressBytes = 1;
+	TEST_Slave.hang = hang;
+	HOST_I2C_Attach(&TEST_Hi2c, &TEST_Slave);
+	I2C_bus_init(&TEST_Bus, &TEST_Hi2c);
+}
+
+static void TEST_Frame(I2C_frame *frame, uint8_t address, uint8_t size, uint32_t timeout)
+{
+	memset(frame, 0, sizeof(*frame));
+	frame->hi2c = &TEST_Hi2c;
+	frame->addres = address;
+	frame->size_data = size;
+	frame->timeout = timeout;
+}
+
+static void i2c_abort_hang(void)
+{
+	I2C_async transfer = {0};
+	I2C_frame frame;
+
+	TEST_Init(0xA0, 1);
+	TEST_Frame(&frame, 0xA0, 2, 5);
+
+	HOST_CHECK(I2C_Transmit_message_async(&transfer, &frame, NULL) == HAL_OK);
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_NONE);
+
+	// timeout only requests the abort, transfer waits for HAL_I2C_AbortCpltCallback
+	HOST_Advance(6);
+	I2C_async_poll(&transfer);
+	HOST_CHECK(TEST_Hi2c.State == HAL_I2C_STATE_ABORT);
+	HOST_CHECK(transfer.busy && transfer.aborting && transfer.stage == I2C_ASYNC_MAIN);
+
+	// late callbacks and polls do not touch an aborting transfer
+	HOST_Advance(10);
+	I2C_async_poll(&transfer);
+	I2C_async_complete(&transfer);
+	I2C_async_error(&transfer);
+	HOST_CHECK(transfer.aborting && transfer.stage == I2C_ASYNC_MAIN);
+
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_ABORTED);
+	I2C_async_abort_complete(&transfer);
+	HOST_CHECK(transfer.stage == I2C_ASYNC_DONE && transfer.status == HAL_TIMEOUT && !transfer.aborting);
+	HOST_CHECK(TEST_Hi2c.State == HAL_I2C_STATE_READY);
+
+	// handle is usable again
+	TEST_Slave.hang = 0;
+	HOST_CHECK(I2C_Transmit_message_async(&transfer, &frame, NULL) == HAL_OK);
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_TX_DONE);
+	I2C_async_complete(&transfer);
+	HOST_CHECK(transfer.stage == I2C_ASYNC_DONE && transfer.status == HAL_OK);
+	HOST_CHECK(HOST_I2C_BusyRejects(&TEST_Hi2c) == 0);
+}
+
+static void i2c_abort_pre_frame(void)
+{
+	static I2C_pre_post_frame prePost;
+	I2C_async transfer = {0};
+	I2C_frame frame;
+	HOST_I2C_Slave wake = {.address = 0xB0, .addressBytes = 1, .hang = 1};
+
+	TEST_Init(0xA0, 0);
+	HOST_I2C_Attach(&TEST_Hi2c, &wake);
+	memset(&prePost, 0, sizeof(prePost));
+	TEST_Frame(&prePost.table_pre[0], 0xB0, 0, 5);
+	prePost.size_pre = 1;
+	TEST_Frame(&frame, 0xA0, 1, 5);
+
+	HOST_CHECK(I2C_Transmit_message_async(&transfer, &frame, &prePost) == HAL_OK);
+	HOST_Advance(6);
+	I2C_async_poll(&transfer);
+	HOST_CHECK(transfer.aborting && transfer.stage == I2C_ASYNC_PRE && HOST_I2C_Starts(&TEST_Hi2c) == 1);
+
+	// timeout of a pre frame is skipped like its error, main frame starts only after the abort
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_ABORTED);
+	I2C_async_abort_complete(&transfer);
+	HOST_CHECK(transfer.stage == I2C_ASYNC_MAIN && HOST_I2C_Starts(&TEST_Hi2c) == 2);
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_TX_DONE);
+	I2C_async_complete(&transfer);
+	HOST_CHECK(transfer.stage == I2C_ASYNC_DONE && transfer.status == HAL_OK);
+	HOST_CHECK(HOST_I2C_BusyRejects(&TEST_Hi2c) == 0 && TEST_Slave.transfers == 1);
+}
+
+static void i2c_bus_abort(void)
+{
+	I2C_async hung = {0};
+	I2C_async next = {0};
+	I2C_frame hungFrame;
+	I2C_frame nextFrame;
+	HOST_I2C_Slave stuck = {.address = 0xB0, .addressBytes = 1, .hang = 1};
+
+	TEST_Init(0xA0, 0);
+	HOST_I2C_Attach(&TEST_Hi2c, &stuck);
+	TEST_Frame(&hungFrame, 0xB0, 1, 5);
+	TEST_Frame(&nextFrame, 0xA0, 1, 5);
+
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &hung, &hungFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &next, &nextFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(TEST_Bus.active == &hung && TEST_Bus.size == 1);
+
+	// next transaction stays queued while the handle is in HAL_I2C_STATE_ABORT
+	HOST_Advance(6);
+	I2C_bus_poll(&TEST_Bus);
+	HOST_CHECK(TEST_Bus.active == &hung && TEST_Bus.size == 1 && next.stage == I2C_ASYNC_QUEUED);
+	HOST_CHECK(HOST_I2C_Starts(&TEST_Hi2c) == 1 && HOST_I2C_BusyRejects(&TEST_Hi2c) == 0);
+
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_ABORTED);
+	I2C_bus_abort_complete(&TEST_Bus);
+	HOST_CHECK(hung.stage == I2C_ASYNC_DONE && hung.status == HAL_TIMEOUT);
+	HOST_CHECK(TEST_Bus.active == &next && HOST_I2C_Starts(&TEST_Hi2c) == 2);
+
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_TX_DONE);
+	I2C_bus_complete(&TEST_Bus);
+	HOST_CHECK(next.stage == I2C_ASYNC_DONE && next.status == HAL_OK);
+	HOST_CHECK(TEST_Bus.active == NULL && TEST_Bus.completed == 2 && HOST_I2C_BusyRejects(&TEST_Hi2c) == 0);
+}
+
+static void i2c_bus_merge(void)
+{
+	I2C_async blocker = {0};
+	I2C_async write = {0};
+	I2C_async read = {0};
+	I2C_frame blockerFrame;
+	I2C_frame writeFrame;
+	I2C_frame readFrame;
+	HOST_I2C_Slave other = {.address = 0xB0, .addressBytes = 1};
+
+	TEST_Init(0xA0, 0);
+	TEST_Slave.eeprom = 1;
+	TEST_Slave.writeCycle = 5;
+	HOST_I2C_Attach(&TEST_Hi2c, &other);
+	TEST_Frame(&blockerFrame, 0xB0, 1, 5);
+	TEST_Frame(&readFrame, 0xA1, 1, 5);
+
+	// EEPROM data write (address 0x10, byte 0x5A) and a read queued behind it stay two transfers,
+	// the write needs its STOP to start the write cycle
+	TEST_Frame(&writeFrame, 0xA0, 2, 5);
+	writeFrame.data[0] = 0x10;
+	writeFrame.data[1] = 0x5A;
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &blocker, &blockerFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &write, &writeFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_receive(&TEST_Bus, &read, &readFrame, NULL, 0) == HAL_OK);
+
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_TX_DONE);
+	I2C_bus_complete(&TEST_Bus);
+	HOST_CHECK(TEST_Bus.active == &write && TEST_Bus.merged_count == 0 && read.stage == I2C_ASYNC_QUEUED);
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_TX_DONE);
+	I2C_bus_complete(&TEST_Bus);
+	HOST_CHECK(write.status == HAL_OK && TEST_Slave.memory[0x10] == 0x5A && TEST_Slave.stops == 1);
+
+	// read during the write cycle is NACKed like on a real 24Cxx
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_NACK);
+	I2C_bus_error(&TEST_Bus);
+	HOST_CHECK(read.status == HAL_ERROR && TEST_Slave.nacks == 1);
+	HOST_CHECK(HOST_I2C_Starts(&TEST_Hi2c) == 3 && TEST_Bus.completed == 3);
+
+	// register pointer write marked by the caller goes with the read as one Mem_Read
+	HOST_Advance(6);
+	TEST_Frame(&writeFrame, 0xA0, 1, 5);
+	writeFrame.data[0] = 0x10;
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &blocker, &blockerFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_transmit_register(&TEST_Bus, &write, &writeFrame, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_receive(&TEST_Bus, &read, &readFrame, NULL, 0) == HAL_OK);
+
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_TX_DONE);
+	I2C_bus_complete(&TEST_Bus);
+	HOST_CHECK(TEST_Bus.active == &read && TEST_Bus.merged_count == 1 && TEST_Bus.size == 0);
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_RX_DONE);
+	I2C_bus_complete(&TEST_Bus);
+	HOST_CHECK(write.status == HAL_OK && read.status == HAL_OK && readFrame.data[0] == 0x5A);
+
+	// 3 transactions took 2 transfers, the register read used one addressed transfer and one STOP
+	HOST_CHECK(HOST_I2C_Starts(&TEST_Hi2c) == 5 && TEST_Bus.completed == 6);
+	HOST_CHECK(TEST_Slave.transfers == 2 && TEST_Slave.stops == 2);
+}
+
+static void i2c_bus_no_merge(void)
+{
+	I2C_async blocker = {0};
+	I2C_async write = {0};
+	I2C_async read = {0};
+	I2C_frame blockerFrame;
+	I2C_frame writeFrame;
+	I2C_frame readFrame;
+	HOST_I2C_Slave other = {.address = 0xB0, .addressBytes = 1};
+
+	TEST_Init(0xA0, 0);
+	HOST_I2C_Attach(&TEST_Hi2c, &other);
+	TEST_Frame(&blockerFrame, 0xB0, 1, 5);
+	TEST_Frame(&writeFrame, 0xA0, 1, 5);
+	TEST_Frame(&readFrame, 0xA1, 1, 5);
+	writeFrame.data[0] = 0x20;
+	TEST_Slave.memory[0x20] = 0x33;
+
+	// plain 1 byte write is not treated as a register pointer
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &blocker, &blockerFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &write, &writeFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_receive(&TEST_Bus, &read, &readFrame, NULL, 0) == HAL_OK);
+	for(uint8_t i = 0; i < 3; i++)
+	{
+		HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) != HOST_I2C_NONE);
+		I2C_bus_complete(&TEST_Bus);
+	}
+	HOST_CHECK(TEST_Bus.merged_count == 0 && HOST_I2C_Starts(&TEST_Hi2c) == 3 && TEST_Slave.stops == 2);
+	HOST_CHECK(read.status == HAL_OK && readFrame.data[0] == 0x33);
+
+	// read from another slave is never merged with the register write
+	TEST_Frame(&readFrame, 0xB1, 1, 5);
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &blocker, &blockerFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_transmit_register(&TEST_Bus, &write, &writeFrame, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_receive(&TEST_Bus, &read, &readFrame, NULL, 0) == HAL_OK);
+	for(uint8_t i = 0; i < 3; i++)
+	{
+		HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) != HOST_I2C_NONE);
+		I2C_bus_complete(&TEST_Bus);
+	}
+	HOST_CHECK(TEST_Bus.merged_count == 0 && HOST_I2C_Starts(&TEST_Hi2c) == 6 && TEST_Bus.completed == 6);
+}
+
+/**
+ * @brief	Per mille of bus busy time in 100 ms of a 200 Hz sensor: conversion trigger on 0xB0,
+ * 			then two 6 byte register reads from 0xA0 queued behind it
+ */
+static uint32_t TEST_Utilisation(uint8_t merge)
+{
+	static I2C_async transfers[5];
+	static I2C_frame frames[5];
+	uint64_t busy = HOST_I2C_BusyUs(&TEST_Hi2c);
+	uint32_t start = HAL_GetTick();
+
+	TEST_Frame(&frames[0], 0xB0, 2, 5);
+	for(uint8_t i = 0; i < 2; i++)
+	{
+		TEST_Frame(&frames[1 + 2 * i], 0xA0, 1, 5);
+		frames[1 + 2 * i].data[0] = (uint8_t)(0x10 * i);
+		TEST_Frame(&frames[2 + 2 * i], 0xA1, 6, 5);
+	}
+
+	for(uint8_t period = 0; period < 20; period++)
+	{
+		HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &transfers[0], &frames[0], NULL, 0) == HAL_OK);
+		for(uint8_t i = 1; i < 5; i += 2)
+		{
+			if(merge)
+				HOST_CHECK(I2C_bus_transmit_register(&TEST_Bus, &transfers[i], &frames[i], 0) == HAL_OK);
+			else
+				HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &transfers[i], &frames[i], NULL, 0) == HAL_OK);
+			HOST_CHECK(I2C_bus_receive(&TEST_Bus, &transfers[i + 1], &frames[i + 1], NULL, 0) == HAL_OK);
+		}
+
+		while(HOST_I2C_Process(&TEST_Hi2c) != HOST_I2C_NONE)
+			I2C_bus_complete(&TEST_Bus);
+		HOST_CHECK(TEST_Bus.active == NULL && transfers[4].status == HAL_OK);
+		HOST_Advance(5);
+	}
+
+	return (uint32_t)((HOST_I2C_BusyUs(&TEST_Hi2c) - busy) / (HAL_GetTick() - start));
+}
+
+static void i2c_bus_utilisation(void)
+{
+	HOST_I2C_Slave trigger = {.address = 0xB0, .addressBytes = 1};
+
+	TEST_Init(0xA0, 0);
+	HOST_I2C_Attach(&TEST_Hi2c, &trigger);
+
+	// 100 kHz: trigger 295 us, register write 205 us and read 655 us, Mem_Read 845 us (STOP and tBUF saved)
+	HOST_CHECK(TEST_Utilisation(0) == 403);
+	HOST_CHECK(TEST_Bus.merged_count == 0 && HOST_I2C_Starts(&TEST_Hi2c) == 100);
+	HOST_CHECK(TEST_Utilisation(1) == 397);
+	HOST_CHECK(TEST_Bus.merged_count == 40 && HOST_I2C_Starts(&TEST_Hi2c) == 160);
+	HOST_CHECK(TEST_Slave.stops == 120 && trigger.stops == 40);
+}
+
+static void i2c_bus_merged_hang(void)
+{
+	I2C_async blocker = {0};
+	I2C_async write = {0};
+	I2C_async read = {0};
+	I2C_async next = {0};
+	I2C_frame blockerFrame;
+	I2C_frame writeFrame;
+	I2C_frame readFrame;
+	I2C_frame nextFrame;
+	HOST_I2C_Slave other = {.address = 0xB0, .addressBytes = 1};
+
+	TEST_Init(0xA0, 1);
+	HOST_I2C_Attach(&TEST_Hi2c, &other);
+	TEST_Frame(&blockerFrame, 0xB0, 1, 5);
+	TEST_Frame(&writeFrame, 0xA0, 1, 5);
+	TEST_Frame(&readFrame, 0xA1, 2, 5);
+	TEST_Frame(&nextFrame, 0xB0, 1, 5);
+
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &blocker, &blockerFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_transmit_register(&TEST_Bus, &write, &writeFrame, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_receive(&TEST_Bus, &read, &readFrame, NULL, 0) == HAL_OK);
+	HOST_CHECK(I2C_bus_transmit(&TEST_Bus, &next, &nextFrame, NULL, 0) == HAL_OK);
+
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_TX_DONE);
+	I2C_bus_complete(&TEST_Bus);
+	HOST_CHECK(TEST_Bus.active == &read && TEST_Bus.merged_count == 1 && TEST_Hi2c.Mode == HAL_I2C_MODE_MEM);
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_NONE);
+
+	// Mem_Read can not be aborted, peripheral is reset and the queue goes on
+	HOST_Advance(6);
+	I2C_bus_poll(&TEST_Bus);
+	HOST_CHECK(HOST_I2C_Resets(&TEST_Hi2c) == 1);
+	HOST_CHECK(write.status == HAL_TIMEOUT && read.status == HAL_TIMEOUT && !read.aborting);
+	HOST_CHECK(TEST_Bus.active == &next && HOST_I2C_Starts(&TEST_Hi2c) == 3);
+
+	HOST_CHECK(HOST_I2C_Process(&TEST_Hi2c) == HOST_I2C_TX_DONE);
+	I2C_bus_complete(&TEST_Bus);
+	HOST_CHECK(next.stage == I2C_ASYNC_DONE && next.status == HAL_OK);
+	HOST_CHECK(TEST_Bus.active == NULL && TEST_Bus.completed == 4 && HOST_I2C_BusyRejects(&TEST_Hi2c) == 0);
+	HOST_CHECK(other.transfers == 2 && TEST_Hi2c.State == HAL_I2C_STATE_READY);
+}
+
+int main(int argc, char **argv)
+{
+	static const HOST_Test tests[] = {
+		HOST_TEST(i2c_abort_hang),
+		HOST_TEST(i2c_abort_pre_frame),
+		HOST_TEST(i2c_bus_abort),
+		HOST_TEST(i2c_bus_merge),
+		HOST_TEST(i2c_bus_no_merge),
+		HOST_TEST(i2c_bus_utilisation),
+		HOST_TEST(i2c_bus_merged_hang),
+	};
+
+	return HOST_RunTests(tests, HOST_TEST_COUNT(tests), argc, argv);
+}
@@ -0,0 +1,184 @@
+/**
+  * @file test_probe.c
+  * @brief Host tests of probes, built with DRIVERS_PROBE_ENABLE
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "host_test.h"
+#include "probe.h"
+#include "adc_driver.h"
+#include "can_driver.h"
+#include "pwm_driver.h"
+#include <stdio.h>
+#include <string.h>
+
+static void probe_stats(void)
+{
+	PROBE_Stats stats;
+	uint8_t data[8];
+
+	PROBE_Init();
+	PROBE_Record(PROBE_PWM_UPDATE, 30);
+	PROBE_Record(PROBE_PWM_UPDATE, 10);
+	PROBE_Record(PROBE_PWM_UPDATE, 0x2000000);
+	PROBE_Record(PROBE_COUNT, 5);										// ignored
+
+	PROBE_GetStats(PROBE_PWM_UPDATE, &stats);
+	HOST_CHECK(stats.count == 3 && stats.min == 10 && stats.max == 0x2000000);
+	HOST_CHECK(stats.sum == 40 + 0x2000000ULL);
+
+	// round robin from the first probe point, saturated fields
+	for(uint8_t i = 0; i <= PROBE_PWM_UPDATE; i++)
+		PROBE_GetData(data);
+	HOST_CHECK(data[0] == PROBE_PWM_UPDATE);
+	HOST_CHECK(data[1] == 10 && data[2] == 0);
+	HOST_CHECK(data[3] == 0xFF && data[4] == 0xFF && data[5] == 0xFF);
+	HOST_CHECK(data[6] == 0xFF && data[7] == 0xFF);
+
+	PROBE_Reset();
+	PROBE_GetStats(PROBE_PWM_UPDATE, &stats);
+	HOST_CHECK(stats.count == 0 && stats.sum == 0);
+}
+
+static void TEST_Handler(const CAN_RxFrame *frame, void *ctx)
+{
+	(void)frame;
+	(*(uint32_t*)ctx)++;
+}
+
+static void probe_hot_paths(void)
+{
+	static const uint8_t channels[] = {0};
+	static uint8_t memory[ADC_DMA_BUFF_BYTES(1, 4, 0)];
+	static ADC_DriverContextTypeDef dadc;
+	static CAN_RxRouteTable table;
+	static CAN_RxRing ring;
+	ADC_HandleTypeDef hadc;
+	DMA_HandleTypeDef dma;
+	ADC_ArenaTypeDef arena;
+	TIM_TypeDef tim = {0};
+	TIM_HandleTypeDef htim = { &tim };
+	PWM_Signal signal;
+	CAN_TypeDef instance;
+	CAN_Handle hcan = {0};
+	PROBE_Stats stats;
+	uint16_t value;
+	uint32_t handled = 0;
+	uint8_t data[8] = {0};
+
+	PROBE_Init();
+
+	// averaging is recorded only when it completes
+	HOST_ADC_Setup(&hadc, ADC1, &dma, channels, sizeof(channels), 1);
+	ADC_Arena_Init(&arena, memory, sizeof(memory));
+	HOST_CHECK(ADC_Init(&dadc, &hadc, &arena, 4) == HAL_OK);
+	HOST_CHECK(ADC_Averaging(&dadc, 0, &value) == ADC_NotStarted);
+	HAL_ADC_ConvHalfCpltCallback(&hadc);
+	HOST_CHECK(ADC_Averaging(&dadc, 0, &value) == ADC_OK);
+	PROBE_GetStats(PROBE_ADC_AVERAGING, &stats);
+	HOST_CHECK(stats.count == 1);
+
+	PWM_Initialize(&signal, 1000);
+	PWM_Update(&htim, &signal, TIM_CHANNEL_1);
+	PROBE_GetStats(PROBE_PWM_UPDATE, &stats);
+	HOST_CHECK(stats.count == 1);
+
+	// immediate handler is measured from interrupt entry, the whole FIFO drain separately
+	HOST_CAN_Setup(&hcan, &instance);
+	CAN_Init(&hcan);
+	CAN_RegisterImmediateHandler(&table, CAN_ID_STD, 0x10, TEST_Handler, &handled);
+	CAN_RegisterHandler(&table, CAN_ID_STD, 0x20, TEST_Handler, &handled);
+	HOST_CAN_Deliver(&hcan, CAN_ID_STD, 0x10, data, 8);
+	HOST_CAN_Deliver(&hcan, CAN_ID_STD, 0x20, data, 8);
+	CAN_HandleReceived(&hcan, &ring, &table, CAN_RX_FIFO0);
+	HOST_CHECK(handled == 1);
+	PROBE_GetStats(PROBE_CAN_HANDLE_RECEIVED, &stats);
+	HOST_CHECK(stats.count == 1);
+	PROBE_GetStats(PROBE_CAN_IMMEDIATE, &stats);
+	HOST_CHECK(stats.count == 1);
+}
+
+static CAN_Handle TEST_Hcan;
+static CAN_RxRing TEST_Ring;
+static CAN_RxRouteTable TEST_Table;
+static uint8_t TEST_Armed;								// immediate frame arrives after the next FIFO0 read
+static uint32_t TEST_Pending;							// FIFO0 frames still waiting when the immediate handler ran
+
+static void TEST_Immediate(const CAN_RxFrame *frame, void *ctx)
+{
+	(void)frame;
+	TEST_Pending += HAL_CAN_GetRxFifoFillLevel(&TEST_Hcan, CAN_RX_FIFO0);
+	(*(uint32_t*)ctx)++;
+}
+
+/**
+ * @brief	FIFO1 interrupt has higher priority and preempts the drain of FIFO0
+ */
+static void TEST_Fifo1Interrupt(CAN_Handle *hcan, uint32_t fifo)
+{
+	uint8_t data[8] = {0};
+
+	if(fifo != 0 || !TEST_Armed)
+		return;
+
+	TEST_Armed = 0;
+	HOST_CHECK(HOST_CAN_Deliver(hcan, CAN_ID_STD, 0x010, data, 8) == 1);
+	CAN_HandleReceived(hcan, &TEST_Ring, &TEST_Table, CAN_RX_FIFO1);
+}
+
+static void probe_can_flood(void)
+{
+	CAN_TypeDef instance;
+	PROBE_Stats immediate;
+	PROBE_Stats received;
+	uint32_t handled = 0;
+	uint32_t bulk = 0;
+	uint8_t data[8] = {0};
+
+	memset(&TEST_Hcan, 0, sizeof(TEST_Hcan));
+	memset(&TEST_Ring, 0, sizeof(TEST_Ring));
+	memset(&TEST_Table, 0, sizeof(TEST_Table));
+	TEST_Armed = 0;
+	TEST_Pending = 0;
+	PROBE_Init();
+
+	HOST_CAN_Setup(&TEST_Hcan, &instance);
+	CAN_Init(&TEST_Hcan);
+	CAN_RegisterImmediateHandler(&TEST_Table, CAN_ID_STD, 0x010, TEST_Immediate, &handled);
+	for(uint32_t id = 0x300; id < 0x304; id++)
+		CAN_RegisterHandler(&TEST_Table, CAN_ID_STD, id, TEST_Handler, &bulk);
+	HOST_CHECK(CAN_ConfigFilters(&TEST_Hcan, &TEST_Table, 0, 14, 0) == HAL_OK);
+	HOST_CAN_SetRxHook(&TEST_Hcan, TEST_Fifo1Interrupt);
+
+	// FIFO0 full and overrun by bulk frames, immediate frame comes while its first frame is handled
+	for(uint32_t round = 0; round < 1000; round++)
+	{
+		for(uint32_t id = 0x300; id < 0x304; id++)
+			HOST_CAN_Deliver(&TEST_Hcan, CAN_ID_STD, id, data, 8);
+		TEST_Armed = 1;
+		CAN_HandleReceived(&TEST_Hcan, &TEST_Ring, &TEST_Table, CAN_RX_FIFO0);
+		CAN_DispatchReceived(&TEST_Ring, &TEST_Table, 8);
+	}
+
+	// immediate handler never waited for the flood, the rest of FIFO0 was still pending every time
+	HOST_CHECK(handled == 1000 && TEST_Pending == 2 * 1000);
+	HOST_CHECK(bulk == 3 * 1000 && TEST_Ring.overruns == 1000);
+
+	PROBE_GetStats(PROBE_CAN_IMMEDIATE, &immediate);
+	PROBE_GetStats(PROBE_CAN_HANDLE_RECEIVED, &received);
+	HOST_CHECK(immediate.count == 1000 && received.count == 2 * 1000);
+	HOST_CHECK(immediate.max <= received.max);				// nested in the preempted FIFO0 drain
+	printf("probe_can_flood: PROBE_CAN_IMMEDIATE max %u ns, CAN_HandleReceived max %u ns\n", (unsigned)immediate.max,
+		   (unsigned)received.max);
+}
+
+int main(int argc, char **argv)
+{
+	static const HOST_Test tests[] = {
+		HOST_TEST(probe_stats),
+		HOST_TEST(probe_hot_paths),
+		HOST_TEST(probe_can_flood),
+	};
+
+	return HOST_RunTests(tests, HOST_TEST_COUNT(tests), argc, argv);
+}
@@ -0,0 +1,69 @@
+/**
+  * @file test_pwm.c
+  * @brief Host tests of PWM input capture, edges are injected into CCRx
+  * @author AGH EKO-ENERGIA
+  */
+
+#include "host_test.h"
+#include "pwm_driver.h"
+
+static TIM_TypeDef PWM_Tim;
+static TIM_HandleTypeDef PWM_Htim = { &PWM_Tim };
+
+/**
+ * @brief Captures one edge on channel 2 at counter value cnt, counter keeps running from the capture
+ */
+static void PWM_Edge(PWM_Signal *signal, uint32_t cnt)
+{
+	PWM_Tim.CCR2 = cnt;
+	PWM_Tim.CNT = cnt;
+	PWM_Update(&PWM_Htim, signal, TIM_CHANNEL_2);
+}
+
+static void pwm_duty(void)
+{
+	PWM_Signal signal;
+
+	PWM_Tim = (TIM_TypeDef){0};
+
+	IC_Val1 = IC_Val2 = 0;
+	Capture_count = 0;
+	PWM_Initialize(&signal, 1000);
+	HOST_CHECK(!signal.Read_Flag);
+
+	PWM_Edge(&signal, 0);											// first rising edge, nothing measured yet
+	HOST_CHECK(PWM_Tim.CNT == 0);
+	HOST_CHECK(((PWM_Tim.CCER >> TIM_CHANNEL_2) & 0xA) == TIM_INPUTCHANNELPOLARITY_FALLING);
+
+	PWM_Edge(&signal, 250);											// falling edge: high time
+	HOST_CHECK(((PWM_Tim.CCER >> TIM_CHANNEL_2) & 0xA) == TIM_INPUTCHANNELPOLARITY_RISING);
+
+	PWM_Edge(&signal, 1000);										// rising edge: period
+	HOST_CHECK(signal.Read_Flag);
+	HOST_CHECK(signal.PWM_Width > 0.2499f && signal.PWM_Width < 0.2501f);
+	HOST_CHECK(PWM_Tim.CNT == 0);
+}
+
+static void pwm_channel(void)
+{
+	PWM_Signal signal;
+
+	PWM_Tim = (TIM_TypeDef){0};
+
+	Capture_count = 0;
+	PWM_Initialize(&signal, 1000);
+	PWM_Tim.CCR4 = 123;
+	PWM_Update(&PWM_Htim, &signal, TIM_CHANNEL_4);
+	HOST_CHECK(IC_Val1 == 123);
+	HOST_CHECK(PWM_Tim.CCER == (TIM_INPUTCHANNELPOLARITY_FALLING << TIM_CHANNEL_4));
+}
+
+int main(int argc, char **argv)
+{
+	static const HOST_Test tests[] = {
+		HOST_TEST(pwm_duty),
+		HOST_TEST(pwm_channel),
+	};
+
+	return HOST_RunTests(tests, HOST_TEST_COUNT(tests), argc, argv);
+}
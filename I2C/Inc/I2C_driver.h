@@ -12,6 +12,7 @@
 #define MAX_PRE 10
 #define MAX_POST 10
 #define MAX_FRAME_LENGHT 32
+#define I2C_QUEUE_SIZE 8					// Transakcje oczekujące na jednej magistrali
 #define CURRENT_PRE(i) (Pre_post_send->table_pre[i])
 #define CURRENT_POST(i) (Pre_post_send->table_post[i])
 
@@ -36,8 +37,73 @@ typedef struct{							// Struktura umożliwiająca wysłanie ramki przed ramką
 }I2C_pre_post_frame;
 
 
+typedef enum{							// Etap transakcji asynchronicznej
+	I2C_ASYNC_IDLE = 0,
+	I2C_ASYNC_QUEUED,					// czeka w kolejce magistrali
+	I2C_ASYNC_PRE,						// ramki przed ramką główną
+	I2C_ASYNC_MAIN,						// ramka główna
+	I2C_ASYNC_POST,						// ramki po ramce głównej
+	I2C_ASYNC_DONE						// zakończono, wynik w status
+}I2C_async_stage;
+
+struct I2C_bus;
+
+typedef struct I2C_async{				// Transakcja bez blokowania CPU: ramki idą w przerwaniach, opóźnienia odmierza HAL_GetTick
+	I2C_frame* frame;					// Ramka główna
+	I2C_pre_post_frame* pre_post;		// Ramki przed i po ramce głównej
+	uint8_t receive;					// 1 - ramka główna jest odbierana
+	uint8_t use_dma;					// 1 - ramki z danymi przez DMA, ramki bez danych zawsze przez IT
+
+	volatile I2C_async_stage stage;
+	uint8_t index;						// Numer ramki w bieżącym etapie
+	volatile uint8_t busy;				// Trwa transfer, czekamy na przerwanie
+	volatile uint8_t waiting;			// Trwa opóźnienie po ramce
+	volatile uint8_t aborting;			// Timeout, czekamy na HAL_I2C_AbortCpltCallback zanim ruszy następna ramka
+	volatile uint32_t tick;				// Początek transferu lub opóźnienia
+	uint8_t delay;						// Bieżące opóźnienie [ms]
+	volatile HAL_StatusTypeDef status;	// Wynik transakcji, ważny w I2C_ASYNC_DONE
+
+	void (*Complete)(struct I2C_async* transfer);	// Opcjonalny, wołany po zakończeniu (również z przerwania)
+	void* ctx;
+
+	struct I2C_bus* bus;				// Magistrala, w której kolejce jest transakcja, NULL - poza kolejką
+	uint8_t priority;					// Mniejszy wygrywa, równe w kolejności zgłoszenia
+	uint8_t register_pointer;			// 1 - zapis to sam adres rejestru (I2C_bus_transmit_register), może iść razem z następnym odczytem
+	uint16_t mem_address;				// Rejestr odczytu połączonego z zapisem (HAL_I2C_Mem_Read)
+	uint8_t mem_size;					// Bajty adresu rejestru, 0 - zwykły odczyt
+	struct I2C_async* merged;			// Zapis adresu rejestru wykonany razem z tym odczytem
+}I2C_async;
+
+typedef struct I2C_bus{					// Kolejka transakcji jednej magistrali, kolejna startuje z przerwania zakończenia poprzedniej
+	I2C_HandleTypeDef* hi2c;
+	I2C_async* queue[I2C_QUEUE_SIZE];	// Posortowana po priorytecie, queue[0] idzie pierwsza
+	uint8_t size;
+	I2C_async* volatile active;			// Trwająca transakcja
+
+	uint32_t completed;					// Statystyki
+	uint32_t merged_count;
+	uint32_t dropped;					// Odrzucone przy pełnej kolejce
+}I2C_bus;
+
+
 HAL_StatusTypeDef I2C_Transmit_message(I2C_frame* Rx_frame, I2C_pre_post_frame* Pre_post_send);
 HAL_StatusTypeDef I2C_Receive_message(I2C_frame* Tx_frame, I2C_pre_post_frame* Pre_post_send);
 
+HAL_StatusTypeDef I2C_Transmit_message_async(I2C_async* transfer, I2C_frame* Tx_frame, I2C_pre_post_frame* Pre_post_send);
+HAL_StatusTypeDef I2C_Receive_message_async(I2C_async* transfer, I2C_frame* Rx_frame, I2C_pre_post_frame* Pre_post_send);
+void I2C_async_poll(I2C_async* transfer);
+void I2C_async_complete(I2C_async* transfer);
+void I2C_async_error(I2C_async* transfer);
+void I2C_async_abort_complete(I2C_async* transfer);
+
+void I2C_bus_init(I2C_bus* bus, I2C_HandleTypeDef* hi2c);
+HAL_StatusTypeDef I2C_bus_transmit(I2C_bus* bus, I2C_async* transfer, I2C_frame* Tx_frame, I2C_pre_post_frame* Pre_post_send, uint8_t priority);
+HAL_StatusTypeDef I2C_bus_transmit_register(I2C_bus* bus, I2C_async* transfer, I2C_frame* Tx_frame, uint8_t priority);
+HAL_StatusTypeDef I2C_bus_receive(I2C_bus* bus, I2C_async* transfer, I2C_frame* Rx_frame, I2C_pre_post_frame* Pre_post_send, uint8_t priority);
+void I2C_bus_poll(I2C_bus* bus);
+void I2C_bus_complete(I2C_bus* bus);
+void I2C_bus_error(I2C_bus* bus);
+void I2C_bus_abort_complete(I2C_bus* bus);
+
 
 #endif /* INC_I2C_DRIVER_H_ */
@@ -86,3 +86,504 @@ HAL_StatusTypeDef I2C_Receive_message(I2C_frame* Rx_frame, I2C_pre_post_frame* P
 
 	return HAL_OK;
 }
+
+
+
+static I2C_frame* I2C_async_current(I2C_async* transfer)		// Ramka bieżącego etapu
+{
+	switch (transfer->stage)
+	{
+	case I2C_ASYNC_PRE:
+		return &transfer->pre_post->table_pre[transfer->index];
+	case I2C_ASYNC_POST:
+		return &transfer->pre_post->table_post[transfer->index];
+	default:
+		return transfer->frame;
+	}
+}
+
+static void I2C_bus_next(I2C_bus* bus);
+
+static void I2C_async_report(I2C_async* transfer, HAL_StatusTypeDef status)
+{
+	transfer->busy = 0;
+	transfer->waiting = 0;
+	transfer->aborting = 0;
+	transfer->status = status;
+	transfer->stage = I2C_ASYNC_DONE;
+
+	if (transfer->Complete != NULL)
+	{
+		transfer->Complete(transfer);
+	}
+}
+
+static void I2C_async_finish(I2C_async* transfer, HAL_StatusTypeDef status)
+{
+	I2C_async* merged = transfer->merged;
+
+	transfer->merged = NULL;
+	transfer->mem_size = 0;
+
+	if (merged != NULL)										// Zapis adresu rejestru kończy się razem z odczytem, ale zgłaszany jest pierwszy
+	{
+		I2C_async_report(merged, status);
+	}
+	I2C_async_report(transfer, status);
+
+	if (transfer->bus != NULL && transfer->bus->active == transfer)	// Następna transakcja z kolejki startuje od razu, jeszcze w przerwaniu
+	{
+		transfer->bus->completed += (merged != NULL) ? 2 : 1;
+		I2C_bus_next(transfer->bus);
+	}
+}
+
+static HAL_StatusTypeDef I2C_async_start(I2C_async* transfer, I2C_frame* frame, uint8_t* data, uint8_t size, uint8_t receive)	// Start jednej ramki w przerwaniu
+{
+	transfer->busy = 1;
+	transfer->tick = HAL_GetTick();
+
+	if (receive && transfer->mem_size > 0)					// Zapis adresu rejestru i odczyt z repeated start
+	{
+		uint16_t mem_size = (transfer->mem_size == 2) ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT;
+		if (transfer->use_dma)
+			return HAL_I2C_Mem_Read_DMA(frame->hi2c, frame->addres, transfer->mem_address, mem_size, data, size);
+		return HAL_I2C_Mem_Read_IT(frame->hi2c, frame->addres, transfer->mem_address, mem_size, data, size);
+	}
+
+	if (receive)
+	{
+		if (transfer->use_dma)
+			return HAL_I2C_Master_Receive_DMA(frame->hi2c, frame->addres, data, size);
+		return HAL_I2C_Master_Receive_IT(frame->hi2c, frame->addres, data, size);
+	}
+
+	if (transfer->use_dma && size > 0)						// DMA nie przyjmie transferu o długości 0
+		return HAL_I2C_Master_Transmit_DMA(frame->hi2c, frame->addres, data, size);
+	return HAL_I2C_Master_Transmit_IT(frame->hi2c, frame->addres, data, size);
+}
+
+static void I2C_async_step(I2C_async* transfer)					// Start następnej ramki, gdy nie trwa transfer ani opóźnienie
+{
+	while (1)
+	{
+		switch (transfer->stage)
+		{
+		case I2C_ASYNC_PRE:
+			if (transfer->pre_post != NULL && transfer->index < transfer->pre_post->size_pre)
+			{
+				// Ramka przed ramką główną to sam adres, jak w I2C_Transmit_message
+				if (I2C_async_start(transfer, I2C_async_current(transfer), NULL, 0, 0) == HAL_OK)
+					return;
+				transfer->busy = 0;								// Błędy ramek pomocniczych są pomijane, np. NACK przy budzeniu AM2320
+				transfer->index++;
+				break;
+			}
+			transfer->stage = I2C_ASYNC_MAIN;
+			break;
+
+		case I2C_ASYNC_MAIN:
+			if (I2C_async_start(transfer, transfer->frame, transfer->frame->data, transfer->frame->size_data, transfer->receive) == HAL_OK)
+				return;
+			I2C_async_finish(transfer, HAL_ERROR);
+			return;
+
+		case I2C_ASYNC_POST:
+			if (transfer->pre_post != NULL && transfer->index < transfer->pre_post->size_post)
+			{
+				I2C_frame* frame = I2C_async_current(transfer);
+				if (I2C_async_start(transfer, frame, frame->data, frame->size_data, 0) == HAL_OK)
+					return;
+				transfer->busy = 0;
+				transfer->index++;
+				break;
+			}
+			I2C_async_finish(transfer, HAL_OK);
+			return;
+
+		default:
+			return;
+		}
+	}
+}
+
+static void I2C_async_next(I2C_async* transfer)					// Ramka zakończona: opóźnienie albo od razu następna ramka
+{
+	uint8_t delay = 0;
+
+	if (transfer->stage == I2C_ASYNC_MAIN)
+	{
+		transfer->stage = I2C_ASYNC_POST;
+		transfer->index = 0;
+	}
+	else
+	{
+		delay = I2C_async_current(transfer)->delay;
+		transfer->index++;
+	}
+
+	transfer->busy = 0;
+
+	if (delay > 0)
+	{
+		transfer->delay = delay;
+		transfer->tick = HAL_GetTick();
+		transfer->waiting = 1;
+		return;
+	}
+
+	I2C_async_step(transfer);
+}
+
+static void I2C_async_run(I2C_async* transfer)					// Start transakcji przygotowanej przez I2C_async_prepare
+{
+	transfer->index = 0;
+	transfer->busy = 0;
+	transfer->stage = I2C_ASYNC_PRE;
+
+	if (transfer->receive && transfer->frame->delay > 0)	// Jak HAL_Delay na początku I2C_Receive_message
+	{
+		transfer->delay = transfer->frame->delay;
+		transfer->tick = HAL_GetTick();
+		transfer->waiting = 1;
+		return;
+	}
+
+	transfer->waiting = 0;
+	I2C_async_step(transfer);
+}
+
+static HAL_StatusTypeDef I2C_async_prepare(I2C_async* transfer, I2C_frame* frame, I2C_pre_post_frame* Pre_post_send, uint8_t receive)
+{
+	if (frame->addres <= 0x7F)								// Adres wraz z bitem Write/Read ma dokładnie 8 bitów
+	{
+		assert_failed(__FILE__, __LINE__);
+	}
+
+	if (transfer->stage != I2C_ASYNC_IDLE && transfer->stage != I2C_ASYNC_DONE)
+	{
+		return HAL_BUSY;
+	}
+
+	transfer->frame = frame;
+	transfer->pre_post = Pre_post_send;
+	transfer->receive = receive;
+	transfer->status = HAL_BUSY;
+	transfer->aborting = 0;
+	transfer->bus = NULL;
+	transfer->mem_size = 0;
+	transfer->merged = NULL;
+	transfer->register_pointer = 0;
+	return HAL_OK;
+}
+
+static HAL_StatusTypeDef I2C_async_begin(I2C_async* transfer, I2C_frame* frame, I2C_pre_post_frame* Pre_post_send, uint8_t receive)
+{
+	if (I2C_async_prepare(transfer, frame, Pre_post_send, receive) != HAL_OK)
+	{
+		return HAL_BUSY;
+	}
+
+	I2C_async_run(transfer);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef I2C_Transmit_message_async(I2C_async* transfer, I2C_frame* Tx_frame, I2C_pre_post_frame* Pre_post_send) // Wysyłka jak I2C_Transmit_message, bez czekania
+/*
+ *
+ * ARGS:
+	 * transfer - stan transakcji, nie może być zmieniany do I2C_ASYNC_DONE
+	 * Tx_frame - struktura z informacją o ramce głównej
+	 * Pre_post_send - struktura z ramkami do wysyłki po i przed ramką główną
+ * RETURN:
+ 	 * HAL_OK - transakcja rozpoczęta, wynik w transfer->status lub w Complete
+ 	 * HAL_BUSY - poprzednia transakcja jeszcze trwa
+ *
+ */
+{
+	return I2C_async_begin(transfer, Tx_frame, Pre_post_send, 0);
+}
+
+HAL_StatusTypeDef I2C_Receive_message_async(I2C_async* transfer, I2C_frame* Rx_frame, I2C_pre_post_frame* Pre_post_send) // Odbiór jak I2C_Receive_message, bez czekania
+/*
+ *
+ * ARGS:
+	 * transfer - stan transakcji, Rx_frame->data jest ważne w I2C_ASYNC_DONE ze status HAL_OK
+	 * Rx_frame - struktura z informacją o ramce głównej
+	 * Pre_post_send - struktura z ramkami do wysyłki po i przed ramką główną
+ * RETURN:
+ 	 * HAL_OK - transakcja rozpoczęta
+ 	 * HAL_BUSY - poprzednia transakcja jeszcze trwa
+ *
+ */
+{
+	return I2C_async_begin(transfer, Rx_frame, Pre_post_send, 1);
+}
+
+static void I2C_async_abort_complete_locked(I2C_async* transfer)	// Ramka przerwana po timeoucie
+{
+	transfer->aborting = 0;
+
+	if (transfer->stage == I2C_ASYNC_MAIN)
+		I2C_async_finish(transfer, HAL_TIMEOUT);
+	else
+		I2C_async_next(transfer);								// Timeout ramki pomocniczej jest pomijany jak jej błąd
+}
+
+void I2C_async_poll(I2C_async* transfer)						// Wywołuj w pętli głównej: kończy opóźnienia i pilnuje timeoutu
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();										// Bez wyścigu z I2C_async_complete
+
+	uint32_t elapsed = HAL_GetTick() - transfer->tick;
+
+	if (transfer->waiting && elapsed > transfer->delay)		// > zamiast >=, bo tick mógł właśnie się zmienić, tak samo jak w HAL_Delay
+	{
+		transfer->waiting = 0;
+		I2C_async_step(transfer);
+	}
+	else if (transfer->busy && !transfer->aborting && elapsed > I2C_async_current(transfer)->timeout)
+	{
+		I2C_frame* frame = I2C_async_current(transfer);
+
+		// Do HAL_I2C_AbortCpltCallback uchwyt jest w stanie ABORT i odrzuca każdy start z HAL_BUSY,
+		// więc następna ramka lub transakcja rusza dopiero z I2C_async_abort_complete
+		if (HAL_I2C_Master_Abort_IT(frame->hi2c, frame->addres) == HAL_OK)
+		{
+			transfer->aborting = 1;
+		}
+		else
+		{
+			// HAL przerywa tylko tryb MASTER, odczyt połączony (HAL_I2C_Mem_Read, tryb MEM) zostaje w BUSY_RX,
+			// wtedy jedynym wyjściem jest reset peryferium, inaczej każda następna transakcja dostałaby HAL_BUSY
+			if (frame->hi2c->State != HAL_I2C_STATE_READY)
+			{
+				HAL_I2C_DeInit(frame->hi2c);
+				HAL_I2C_Init(frame->hi2c);
+			}
+			I2C_async_abort_complete_locked(transfer);			// Nic nie trwa, następna ramka może ruszyć
+		}
+	}
+
+	__set_PRIMASK(primask);
+}
+
+void I2C_async_complete(I2C_async* transfer)					// Wywołaj w HAL_I2C_MasterTxCpltCallback, HAL_I2C_MasterRxCpltCallback i HAL_I2C_MemRxCpltCallback
+{
+	if (!transfer->busy || transfer->aborting)
+		return;
+
+	I2C_async_next(transfer);
+}
+
+void I2C_async_error(I2C_async* transfer)						// Wywołaj w HAL_I2C_ErrorCallback
+{
+	if (!transfer->busy || transfer->aborting)
+		return;
+
+	if (transfer->stage == I2C_ASYNC_MAIN)
+		I2C_async_finish(transfer, HAL_ERROR);
+	else
+		I2C_async_next(transfer);								// Błędy ramek pomocniczych są pomijane, jak w wersji blokującej
+}
+
+void I2C_async_abort_complete(I2C_async* transfer)				// Wywołaj w HAL_I2C_AbortCpltCallback
+{
+	if (!transfer->aborting)
+		return;
+
+	I2C_async_abort_complete_locked(transfer);
+}
+
+
+
+static void I2C_bus_push(I2C_bus* bus, I2C_async* transfer)		// Za wszystkimi o tym samym lub wyższym priorytecie
+{
+	uint8_t i = bus->size;
+
+	while (i > 0 && bus->queue[i - 1]->priority > transfer->priority)
+	{
+		bus->queue[i] = bus->queue[i - 1];
+		i--;
+	}
+
+	bus->queue[i] = transfer;
+	bus->size++;
+}
+
+static I2C_async* I2C_bus_pop(I2C_bus* bus)
+{
+	I2C_async* transfer = bus->queue[0];
+
+	bus->size--;
+	for (uint8_t i = 0; i < bus->size; i++)
+	{
+		bus->queue[i] = bus->queue[i + 1];
+	}
+
+	return transfer;
+}
+
+static uint8_t I2C_bus_can_merge(I2C_async* write, I2C_async* read)	// Zapis adresu rejestru, po którym od razu idzie odczyt z tego samego układu
+{
+	// Tylko zapis oznaczony przez wywołującego: te same bajty mogą być danymi, np. adres i bajt do zapisu w 24C02,
+	// a Mem_Read nie wyśle STOP po zapisie, więc dane nie zostałyby zapisane
+	if (!write->register_pointer)
+		return 0;
+	if (write->receive || !read->receive)
+		return 0;
+	if (write->frame->size_data == 0 || write->frame->size_data > 2)
+		return 0;
+	if (write->pre_post != NULL && (write->pre_post->size_pre > 0 || write->pre_post->size_post > 0))
+		return 0;
+	if (read->pre_post != NULL && read->pre_post->size_pre > 0)
+		return 0;
+	if (read->frame->delay > 0)								// Układ potrzebuje czasu między zapisem a odczytem, np. AM2320
+		return 0;
+
+	return write->frame->hi2c == read->frame->hi2c && (write->frame->addres | 1) == (read->frame->addres | 1);
+}
+
+static void I2C_bus_next(I2C_bus* bus)							// Start pierwszej transakcji z kolejki, wołane z przerwania lub z sekcji krytycznej
+{
+	bus->active = NULL;
+
+	while (bus->active == NULL && bus->size > 0)
+	{
+		I2C_async* transfer = I2C_bus_pop(bus);
+
+		if (bus->size > 0 && I2C_bus_can_merge(transfer, bus->queue[0]))
+		{
+			I2C_async* read = I2C_bus_pop(bus);
+			uint8_t* reg = transfer->frame->data;
+
+			// Ramka główna zapisu staje się adresem rejestru, ramki po odczycie zostają
+			read->mem_size = transfer->frame->size_data;
+			read->mem_address = (read->mem_size == 2) ? (uint16_t)((reg[0] << 8) | reg[1]) : reg[0];
+			read->merged = transfer;
+			bus->merged_count++;
+			transfer = read;
+		}
+
+		bus->active = transfer;
+		I2C_async_run(transfer);							// Błąd startu kończy transakcję i wywołuje tę funkcję ponownie
+	}
+}
+
+static HAL_StatusTypeDef I2C_bus_submit(I2C_bus* bus, I2C_async* transfer, I2C_frame* frame, I2C_pre_post_frame* Pre_post_send,
+										uint8_t receive, uint8_t register_pointer, uint8_t priority)
+{
+	if (I2C_async_prepare(transfer, frame, Pre_post_send, receive) != HAL_OK)
+	{
+		return HAL_BUSY;
+	}
+	transfer->register_pointer = register_pointer;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();										// Kolejka jest zmieniana także w przerwaniu
+
+	if (bus->size >= I2C_QUEUE_SIZE)
+	{
+		bus->dropped++;
+		__set_PRIMASK(primask);
+		return HAL_ERROR;
+	}
+
+	transfer->bus = bus;
+	transfer->priority = priority;
+	transfer->stage = I2C_ASYNC_QUEUED;
+	I2C_bus_push(bus, transfer);
+
+	if (bus->active == NULL)
+	{
+		I2C_bus_next(bus);
+	}
+
+	__set_PRIMASK(primask);
+	return HAL_OK;
+}
+
+void I2C_bus_init(I2C_bus* bus, I2C_HandleTypeDef* hi2c)		// Pusta kolejka
+{
+	bus->hi2c = hi2c;
+	bus->size = 0;
+	bus->active = NULL;
+	bus->completed = 0;
+	bus->merged_count = 0;
+	bus->dropped = 0;
+}
+
+HAL_StatusTypeDef I2C_bus_transmit(I2C_bus* bus, I2C_async* transfer, I2C_frame* Tx_frame, I2C_pre_post_frame* Pre_post_send, uint8_t priority)
+/*
+ *
+ * ARGS:
+	 * bus - kolejka magistrali, Tx_frame->hi2c musi być bus->hi2c
+	 * transfer - stan transakcji, wynik w transfer->status lub w Complete
+	 * Pre_post_send - ramki przed i po ramce głównej, może być NULL
+	 * priority - mniejszy idzie wcześniej
+ * RETURN:
+ 	 * HAL_OK - transakcja w kolejce
+ 	 * HAL_BUSY - transfer jeszcze trwa
+ 	 * HAL_ERROR - kolejka pełna
+ *
+ */
+{
+	return I2C_bus_submit(bus, transfer, Tx_frame, Pre_post_send, 0, 0, priority);
+}
+
+HAL_StatusTypeDef I2C_bus_transmit_register(I2C_bus* bus, I2C_async* transfer, I2C_frame* Tx_frame, uint8_t priority)
+/*
+ *
+ * ARGS:
+	 * jak w I2C_bus_transmit, Tx_frame->data to tylko 1-2 bajty adresu rejestru, bez danych do zapisu
+	 * odczyt z tego samego układu czekający w kolejce zaraz za tym zapisem idzie razem z nim w HAL_I2C_Mem_Read
+ *
+ */
+{
+	return I2C_bus_submit(bus, transfer, Tx_frame, NULL, 0, 1, priority);
+}
+
+HAL_StatusTypeDef I2C_bus_receive(I2C_bus* bus, I2C_async* transfer, I2C_frame* Rx_frame, I2C_pre_post_frame* Pre_post_send, uint8_t priority)
+/*
+ *
+ * ARGS:
+	 * jak w I2C_bus_transmit, odczyt zaraz po I2C_bus_transmit_register do tego samego układu jest łączony w HAL_I2C_Mem_Read
+ *
+ */
+{
+	return I2C_bus_submit(bus, transfer, Rx_frame, Pre_post_send, 1, 0, priority);
+}
+
+void I2C_bus_poll(I2C_bus* bus)								// Wywołuj w pętli głównej zamiast I2C_async_poll
+{
+	I2C_async* active = bus->active;
+
+	if (active != NULL)
+	{
+		I2C_async_poll(active);
+	}
+}
+
+void I2C_bus_complete(I2C_bus* bus)							// Wywołaj w HAL_I2C_MasterTxCpltCallback, HAL_I2C_MasterRxCpltCallback i HAL_I2C_MemRxCpltCallback
+{
+	if (bus->active != NULL)
+	{
+		I2C_async_complete(bus->active);
+	}
+}
+
+void I2C_bus_error(I2C_bus* bus)								// Wywołaj w HAL_I2C_ErrorCallback
+{
+	if (bus->active != NULL)
+	{
+		I2C_async_error(bus->active);
+	}
+}
+
+void I2C_bus_abort_complete(I2C_bus* bus)						// Wywołaj w HAL_I2C_AbortCpltCallback
+{
+	if (bus->active != NULL)
+	{
+		I2C_async_abort_complete(bus->active);
+	}
+}
@@ -0,0 +1,65 @@
+/**
+  * @file probe.h
+  * @brief Cycle counting probes of drivers' hot paths
+  * @author AGH EKO-ENERGIA
+  *
+  * Probes are compiled in only when DRIVERS_PROBE_ENABLE is defined, otherwise
+  * PROBE_START / PROBE_STOP expand to nothing and cost no cycles.
+  * On target cycles are read from DWT->CYCCNT, on host build from monotonic clock (ns).
+  */
+
+#ifndef INC_PROBE_H_
+#define INC_PROBE_H_
+
+#include <stdint.h>
+
+/**
+ * Probe points
+ */
+typedef enum {
+	PROBE_ADC_AVERAGING = 0,
+	PROBE_CAN_HANDLE_SCHEDULED,
+	PROBE_CAN_HANDLE_RECEIVED,
+	PROBE_CAN_IMMEDIATE,								// RX interrupt entry to end of immediate handler
+	PROBE_PWM_UPDATE,
+	PROBE_COUNT
+}PROBE_Id;
+
+/**
+ * Statistics of one probe point
+ */
+typedef struct {
+	uint32_t min;										// shortest measured section
+	uint32_t max;										// longest measured section
+	uint64_t sum;										// sum of all measurements, mean = sum / count
+	uint32_t count;										// number of measurements
+}PROBE_Stats;
+
+#ifdef DRIVERS_PROBE_ENABLE
+
+#define PROBE_START(__ID__)		uint32_t probe_start_##__ID__ = PROBE_Now()
+#define PROBE_STOP(__ID__)		PROBE_Record((__ID__), PROBE_Now() - probe_start_##__ID__)
+
+#else
+
+#define PROBE_START(__ID__)		((void)0)
+#define PROBE_STOP(__ID__)		((void)0)
+
+#endif
+
+/**
+ * Probe functions
+ */
+void     PROBE_Init(void);
+uint32_t PROBE_Now(void);
+void     PROBE_Record(PROBE_Id id, uint32_t cycles);
+void     PROBE_Reset(void);
+void     PROBE_GetStats(PROBE_Id id, PROBE_Stats *stats);
+
+/**
+ * Dump of statistics, fits GetData of CAN_ScheduledMsg (DLC 8)
+ */
+void     PROBE_GetData(uint8_t *data);
+
+
+#endif /* INC_PROBE_H_ */
@@ -0,0 +1,146 @@
+/**
+  * @file probe.c
+  * @brief Cycle counting probes of drivers' hot paths
+  * @author AGH EKO-ENERGIA
+  */
+
+#if !defined(__arm__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L							// clock_gettime is hidden by -std=c11
+#endif
+
+#include "probe.h"
+
+#if defined(__arm__)
+#include "main.h"
+#else
+#include <time.h>
+#endif
+
+/**
+ * A point may be recorded from interrupts preempting each other (RX interrupts of both CAN FIFOs),
+ * so statistics are updated and copied with interrupts masked; host build has no interrupts
+ */
+#if defined(__arm__)
+#define PROBE_LOCK()			uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define PROBE_UNLOCK()			__set_PRIMASK(primask)
+#else
+#define PROBE_LOCK()			((void)0)
+#define PROBE_UNLOCK()			((void)0)
+#endif
+
+/**
+ * Statistics of all probe points
+ */
+static PROBE_Stats probeTable[PROBE_COUNT];
+
+/**
+ * @brief	Enables cycle counter and clears statistics
+ */
+void PROBE_Init(void)
+{
+#if defined(DWT)
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+	PROBE_Reset();
+}
+
+/**
+ * @brief	Current time stamp, differences are wrap safe
+ * @retval	DWT cycles on target, nanoseconds on host, 0 on cores without DWT (Cortex-M0)
+ */
+uint32_t PROBE_Now(void)
+{
+#if defined(DWT)
+	return DWT->CYCCNT;
+#elif !defined(__arm__)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief	Adds one measurement to statistics of probe point
+ */
+void PROBE_Record(PROBE_Id id, uint32_t cycles)
+{
+	if(id >= PROBE_COUNT)
+		return;
+
+	PROBE_Stats *stats = &probeTable[id];
+
+	PROBE_LOCK();
+	if(stats->count == 0 || cycles < stats->min)
+		stats->min = cycles;
+	if(cycles > stats->max)
+		stats->max = cycles;
+
+	stats->sum += cycles;
+	stats->count++;
+	PROBE_UNLOCK();
+}
+
+/**
+ * @brief	Clears statistics of all probe points
+ */
+void PROBE_Reset(void)
+{
+	PROBE_LOCK();
+	for(uint8_t i = 0; i < PROBE_COUNT; i++)
+	{
+		probeTable[i].min = 0;
+		probeTable[i].max = 0;
+		probeTable[i].sum = 0;
+		probeTable[i].count = 0;
+	}
+	PROBE_UNLOCK();
+}
+
+/**
+ * @brief	Copies statistics of probe point, e.g. for printing over UART
+ */
+void PROBE_GetStats(PROBE_Id id, PROBE_Stats *stats)
+{
+	if(id >= PROBE_COUNT)
+		return;
+
+	PROBE_LOCK();
+	*stats = probeTable[id];
+	PROBE_UNLOCK();
+}
+
+/**
+ * @brief	Packs statistics of next probe point (round robin) into 8 bytes
+ * 			[0] id, [1..2] min, [3..5] max, [6..7] mean | little endian, saturated
+ * 			Register it as GetData of a scheduled CAN message to stream the table
+ */
+void PROBE_GetData(uint8_t *data)
+{
+	static uint8_t next = 0;
+
+	PROBE_LOCK();
+	PROBE_Stats stats = probeTable[next];
+	PROBE_UNLOCK();
+	uint32_t mean = (stats.count == 0) ? 0 : (uint32_t)(stats.sum / stats.count);
+	uint32_t min = (stats.min > 0xFFFF) ? 0xFFFF : stats.min;
+	uint32_t max = (stats.max > 0xFFFFFF) ? 0xFFFFFF : stats.max;
+
+	if(mean > 0xFFFF)
+		mean = 0xFFFF;
+
+	data[0] = next;
+	data[1] = (uint8_t)(min);
+	data[2] = (uint8_t)(min >> 8);
+	data[3] = (uint8_t)(max);
+	data[4] = (uint8_t)(max >> 8);
+	data[5] = (uint8_t)(max >> 16);
+	data[6] = (uint8_t)(mean);
+	data[7] = (uint8_t)(mean >> 8);
+
+	next = (next + 1) % PROBE_COUNT;
+}
@@ -1,4 +1,5 @@
 #include "pwm_driver.h"
+#include "probe.h"
 #include"main.h"
 #include <math.h>
 #include <stdlib.h>
@@ -19,6 +20,8 @@ void PWM_Initialize(PWM_Signal* signal,int frequency) {
 
 void PWM_Update(TIM_HandleTypeDef *htim, PWM_Signal *PWM, uint32_t channel)
 {
+    PROBE_START(PROBE_PWM_UPDATE);
+
     if (Capture_count == 0)
     {
         IC_Val1 = HAL_TIM_ReadCapturedValue(htim, channel);
@@ -38,4 +41,6 @@ void PWM_Update(TIM_HandleTypeDef *htim, PWM_Signal *PWM, uint32_t channel)
     }
 
     PWM->Read_Flag = true;
+
+    PROBE_STOP(PROBE_PWM_UPDATE);
 }